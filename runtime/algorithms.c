@@ -0,0 +1,225 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "phirt.h"
+
+/* The kernels are instantiated for every type of elements by the macros below. Their loops keep LANES independent
+ * partial results, which the compiler can keep in vector registers without reassociating anything itself. */
+#define LANES 8
+/* Arrays shorter than this are sorted by insertion */
+#define INSERTION_SORT 64
+/* Length of the blocks, which sum adds in order before adding them pairwise */
+#define SUM_BLOCK 128
+
+/* Radix sort orders the elements by unsigned keys. Signed integers flip their sign bit, floating point numbers also
+ * flip all other bits if they are negative. NaNs thus end up before or after all numbers, depending on their sign. */
+static inline uint64_t key_f64 (double v)
+{
+	uint64_t k;
+	memcpy(&k, &v, sizeof(k));
+	return k ^ ((0 - (k >> 63)) | (UINT64_C(1) << 63));
+}
+
+static inline uint32_t key_f32 (float v)
+{
+	uint32_t k;
+	memcpy(&k, &v, sizeof(k));
+	return k ^ ((0 - (k >> 31)) | (UINT32_C(1) << 31));
+}
+
+static inline uint64_t key_i64 (int64_t v) { return (uint64_t)v ^ (UINT64_C(1) << 63); }
+static inline uint32_t key_i32 (int32_t v) { return (uint32_t)v ^ (UINT32_C(1) << 31); }
+static inline uint32_t key_u32 (uint32_t v) { return v; }
+static inline uint16_t key_i16 (int16_t v) { return (uint16_t)v ^ (uint16_t)0x8000; }
+static inline uint8_t key_i8 (int8_t v) { return (uint8_t)v ^ (uint8_t)0x80; }
+
+/* Bin of a value in [lo, hi) divided into bins, or -1 */
+static inline int64_t binIndex (double v, double lo, double hi, double scale, int64_t bins)
+{
+	if (!(v >= lo && v < hi))
+		return -1;
+	int64_t bin = (int64_t)((v - lo) * scale);
+	return bin < bins ? bin : bins - 1;
+}
+
+/* T is the type of the elements, K the unsigned type of their keys and A the type, in which integers are added
+ * without overflowing */
+#define PHIRT_ALGORITHMS(S, T, K, A, LOWEST, HIGHEST) \
+static int compare_##S (const void *lhs, const void *rhs) \
+{ \
+	K l = key_##S(*(const T*)lhs), r = key_##S(*(const T*)rhs); \
+	return (l > r) - (l < r); \
+} \
+\
+void phirt_sort_##S (T *a, int64_t n) \
+{ \
+	if (n < INSERTION_SORT) \
+	{ \
+		for (int64_t i = 1; i < n; i++) \
+		{ \
+			T v = a[i]; \
+			K k = key_##S(v); \
+			int64_t j = i; \
+			for (; j > 0 && key_##S(a[j-1]) > k; j--) \
+				a[j] = a[j-1]; \
+			a[j] = v; \
+		} \
+		return; \
+	} \
+	T *buffer = malloc(n * sizeof(T)); \
+	if (buffer == NULL) \
+	{ \
+		qsort(a, n, sizeof(T), compare_##S); \
+		return; \
+	} \
+	/* Count all digits in a single pass, then scatter by one byte of the key after the other */ \
+	int64_t counts[sizeof(K)][256] = {{0}}; \
+	for (int64_t i = 0; i < n; i++) \
+	{ \
+		K k = key_##S(a[i]); \
+		for (unsigned d = 0; d < sizeof(K); d++) \
+			counts[d][(k >> (8 * d)) & 0xFF]++; \
+	} \
+	T *src = a, *dst = buffer; \
+	for (unsigned d = 0; d < sizeof(K); d++) \
+	{ \
+		/* All keys share this byte */ \
+		if (counts[d][(key_##S(src[0]) >> (8 * d)) & 0xFF] == n) \
+			continue; \
+		int64_t offset = 0; \
+		for (unsigned b = 0; b < 256; b++) \
+		{ \
+			int64_t count = counts[d][b]; \
+			counts[d][b] = offset; \
+			offset += count; \
+		} \
+		for (int64_t i = 0; i < n; i++) \
+			dst[counts[d][(key_##S(src[i]) >> (8 * d)) & 0xFF]++] = src[i]; \
+		T *swap = src; \
+		src = dst; \
+		dst = swap; \
+	} \
+	if (src != a) \
+		memcpy(a, src, n * sizeof(T)); \
+	free(buffer); \
+} \
+\
+void phirt_scan_##S (T *a, int64_t n) \
+{ \
+	A sum = 0; \
+	for (int64_t i = 0; i < n; i++) \
+	{ \
+		sum += (A)a[i]; \
+		a[i] = (T)sum; \
+	} \
+} \
+\
+T phirt_sum_##S (const T *a, int64_t n) \
+{ \
+	if (n > SUM_BLOCK) \
+	{ \
+		int64_t half = n / 2 / LANES * LANES; \
+		return (T)((A)phirt_sum_##S(a, half) + (A)phirt_sum_##S(a + half, n - half)); \
+	} \
+	A lanes[LANES] = {0}; \
+	int64_t i = 0; \
+	for (; i + LANES <= n; i += LANES) \
+		for (unsigned j = 0; j < LANES; j++) \
+			lanes[j] += (A)a[i+j]; \
+	for (unsigned width = LANES / 2; width > 0; width /= 2) \
+		for (unsigned j = 0; j < width; j++) \
+			lanes[j] += lanes[j + width]; \
+	A sum = lanes[0]; \
+	for (; i < n; i++) \
+		sum += (A)a[i]; \
+	return (T)sum; \
+} \
+\
+PHIRT_LOCATION(S, T, minloc, <, HIGHEST) \
+PHIRT_LOCATION(S, T, maxloc, >, LOWEST) \
+\
+int64_t phirt_search_##S (const T *a, int64_t n, T x) \
+{ \
+	if (n <= 0) \
+		return 0; \
+	/* Halving the range without a branch lets the compiler use a conditional move */ \
+	const T *base = a; \
+	while (n > 1) \
+	{ \
+		int64_t half = n / 2; \
+		base = (base[half] < x) ? base + half : base; \
+		n -= half; \
+	} \
+	return (base - a) + (*base < x); \
+} \
+\
+void phirt_histogram_##S (const T *a, int64_t n, double lo, double hi, int64_t *counts, int64_t bins) \
+{ \
+	if (bins <= 0 || !(hi > lo)) \
+		return; \
+	double scale = bins / (hi - lo); \
+	if (bins > 256) \
+	{ \
+		for (int64_t i = 0; i < n; i++) \
+		{ \
+			int64_t bin = binIndex(a[i], lo, hi, scale, bins); \
+			if (bin >= 0) \
+				counts[bin]++; \
+		} \
+		return; \
+	} \
+	/* Runs of equal values would wait for each other's increments, so neighbours count into separate copies */ \
+	int64_t partial[4][256] = {{0}}; \
+	int64_t i = 0; \
+	for (; i + 4 <= n; i += 4) \
+		for (unsigned j = 0; j < 4; j++) \
+		{ \
+			int64_t bin = binIndex(a[i+j], lo, hi, scale, bins); \
+			if (bin >= 0) \
+				partial[j][bin]++; \
+		} \
+	for (; i < n; i++) \
+	{ \
+		int64_t bin = binIndex(a[i], lo, hi, scale, bins); \
+		if (bin >= 0) \
+			partial[0][bin]++; \
+	} \
+	for (int64_t b = 0; b < bins; b++) \
+		counts[b] += partial[0][b] + partial[1][b] + partial[2][b] + partial[3][b]; \
+}
+
+/* The first element, which no other element is OP than, and its index. NaNs are skipped, unless there are only NaNs. */
+#define PHIRT_LOCATION(S, T, NAME, OP, INIT) \
+int64_t phirt_##NAME##_##S (const T *a, int64_t n, T *value) \
+{ \
+	T lanes[LANES]; \
+	for (unsigned j = 0; j < LANES; j++) \
+		lanes[j] = INIT; \
+	int64_t i = 0; \
+	for (; i + LANES <= n; i += LANES) \
+		for (unsigned j = 0; j < LANES; j++) \
+			lanes[j] = (a[i+j] OP lanes[j]) ? a[i+j] : lanes[j]; \
+	T best = INIT; \
+	for (unsigned j = 0; j < LANES; j++) \
+		best = (lanes[j] OP best) ? lanes[j] : best; \
+	for (; i < n; i++) \
+		best = (a[i] OP best) ? a[i] : best; \
+	for (i = 0; i < n; i++) \
+		if (a[i] == best) \
+		{ \
+			*value = best; \
+			return i; \
+		} \
+	*value = n > 0 ? a[0] : 0; \
+	return n > 0 ? 0 : -1; \
+}
+
+PHIRT_ALGORITHMS(f64, double, uint64_t, double, -INFINITY, INFINITY)
+PHIRT_ALGORITHMS(f32, float, uint32_t, float, -INFINITY, INFINITY)
+PHIRT_ALGORITHMS(i64, int64_t, uint64_t, uint64_t, INT64_MIN, INT64_MAX)
+PHIRT_ALGORITHMS(i32, int32_t, uint32_t, uint32_t, INT32_MIN, INT32_MAX)
+PHIRT_ALGORITHMS(u32, uint32_t, uint32_t, uint32_t, 0, UINT32_MAX)
+PHIRT_ALGORITHMS(i16, int16_t, uint16_t, uint32_t, INT16_MIN, INT16_MAX)
+PHIRT_ALGORITHMS(i8, int8_t, uint8_t, uint32_t, INT8_MIN, INT8_MAX)
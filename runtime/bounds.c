@@ -0,0 +1,17 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "phirt.h"
+
+void phirt_bounds_error (int64_t index, int64_t length)
+{
+	fprintf(stderr, "Index %" PRId64 " out of bounds for length %" PRId64 ".\n", index, length);
+	abort();
+}
+
+void phirt_allocation_error (int64_t size)
+{
+	fprintf(stderr, "Could not allocate %" PRId64 " bytes for an array.\n", size);
+	abort();
+}
@@ -0,0 +1,63 @@
+#ifndef PHIRT_H_
+#define PHIRT_H_
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* Body of a parallel loop. It runs the iterations [first, last) of the loop. */
+typedef void (*phirt_loop_body)(int64_t first, int64_t last, void *env);
+
+/* Run the iterations [0, count) of a parallel loop on the thread pool and wait for all of them */
+void phirt_parallel_for (int64_t count, phirt_loop_body body, void *env);
+
+/* Serialise the combination of partial reductions */
+void phirt_critical_enter ();
+void phirt_critical_exit ();
+
+/* Spawned calls. Each caller counts its unfinished calls in a phirt_counter, which starts at 0. */
+typedef atomic_long phirt_counter;
+typedef void (*phirt_task_body)(void *frame);
+
+/* Run body(frame) concurrently to the caller, or right away if enough work is queued already */
+void phirt_spawn (phirt_counter *pending, phirt_task_body body, void *frame);
+/* Wait until all calls counted by pending have finished */
+void phirt_sync (phirt_counter *pending);
+
+/* Runtime configuration. Both setters return the previous value, 0 meaning automatic.
+ * The initial values are taken from the environment variables PHI_NUM_THREADS, PHI_CHUNK_SIZE
+ * and PHI_SPAWN_CUTOFF. The cutoff is the number of queued calls per thread, beyond which spawn runs calls
+ * sequentially. A new number of threads takes effect once no parallel loop or spawned call is running. */
+int phirt_set_num_threads (int threads);
+int phirt_set_chunk_size (int iterations);
+int phirt_set_spawn_cutoff (int tasks);
+int phirt_num_threads ();
+
+/* Called by programs compiled with --bounds-check for an index outside of [0, length). It does not return. */
+void phirt_bounds_error (int64_t index, int64_t length);
+
+/* Called when there is no memory for an array on the heap. It does not return either. */
+void phirt_allocation_error (int64_t size);
+
+/* Algorithms on arrays, for the types of elements f64 (Real), f32 (Float32), i64 (Int64), i32 (Int), u32 (UInt),
+ * i16 (Int16) and i8 (Int8). sort and scan work in place, scan computing the inclusive prefix sums. minloc and maxloc
+ * return the index of the first smallest or largest element and store it in value, or return -1 for no elements.
+ * search returns the index of the first element not less than x in a sorted array. histogram adds the number of
+ * elements in each of the bins, which divide [lo, hi) evenly, to counts. */
+#define PHIRT_DECLARE_ALGORITHMS(S, T) \
+void phirt_sort_##S (T *a, int64_t n); \
+void phirt_scan_##S (T *a, int64_t n); \
+T phirt_sum_##S (const T *a, int64_t n); \
+int64_t phirt_minloc_##S (const T *a, int64_t n, T *value); \
+int64_t phirt_maxloc_##S (const T *a, int64_t n, T *value); \
+int64_t phirt_search_##S (const T *a, int64_t n, T x); \
+void phirt_histogram_##S (const T *a, int64_t n, double lo, double hi, int64_t *counts, int64_t bins);
+
+PHIRT_DECLARE_ALGORITHMS(f64, double)
+PHIRT_DECLARE_ALGORITHMS(f32, float)
+PHIRT_DECLARE_ALGORITHMS(i64, int64_t)
+PHIRT_DECLARE_ALGORITHMS(i32, int32_t)
+PHIRT_DECLARE_ALGORITHMS(u32, uint32_t)
+PHIRT_DECLARE_ALGORITHMS(i16, int16_t)
+PHIRT_DECLARE_ALGORITHMS(i8, int8_t)
+
+#endif /* PHIRT_H_ */
@@ -0,0 +1,439 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "phirt.h"
+#include "scheduler.h"
+
+/* Every thread owns a deque of tasks. The owner works on the newest task, idle threads steal the oldest one. */
+typedef struct deque {
+	pthread_mutex_t lock;
+	task *tasks;
+	unsigned capacity;
+	unsigned head;
+	unsigned tail;
+} deque;
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_mutex_t idleLock;
+	pthread_cond_t idleCond;
+	pthread_mutex_t criticalLock;
+	pthread_t *threads;
+	deque *deques;
+	/* running is only set once the pool is complete, numThreads does not change while it is set */
+	atomic_int numThreads;
+	atomic_int running;
+	/* Threads within the runtime and spawned calls that have not finished. The pool is only stopped without them. */
+	atomic_long users;
+	/* A new number of threads was requested while the pool was in use */
+	atomic_int resize;
+	atomic_int shutdown;
+	atomic_int idle;
+	atomic_long queued;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.idleLock = PTHREAD_MUTEX_INITIALIZER,
+	.idleCond = PTHREAD_COND_INITIALIZER,
+	.criticalLock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static int requestedThreads = -1;
+/* Read by every parallel loop and spawn, and changed without the lock */
+static atomic_int requestedChunkSize = -1;
+static atomic_int requestedCutoff = -1;
+
+/* Index of the deque of the current thread. Threads outside the pool share deque 0. */
+static _Thread_local int self = 0;
+static _Thread_local unsigned seed = 1;
+
+static int readEnvironment (const char *name)
+{
+	const char *value = getenv(name);
+	if (value == NULL)
+		return 0;
+	int n = atoi(value);
+	return n > 0 ? n : 0;
+}
+
+static int pushTask (deque *d, task t)
+{
+	pthread_mutex_lock(&d->lock);
+	if (d->tail - d->head == d->capacity)
+	{
+		unsigned capacity = d->capacity == 0 ? 64 : 2*d->capacity;
+		task *tasks = malloc(capacity * sizeof(task));
+		if (tasks == NULL)
+		{
+			pthread_mutex_unlock(&d->lock);
+			return 0;
+		}
+		for (unsigned i = d->head; i != d->tail; i++)
+			tasks[i % capacity] = d->tasks[i % d->capacity];
+		free(d->tasks);
+		d->tasks = tasks;
+		d->capacity = capacity;
+	}
+	d->tasks[d->tail % d->capacity] = t;
+	d->tail++;
+	pthread_mutex_unlock(&d->lock);
+	atomic_fetch_add(&pool.queued, 1);
+	return 1;
+}
+
+static int popTask (deque *d, task *t)
+{
+	int found = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->tail != d->head)
+	{
+		d->tail--;
+		*t = d->tasks[d->tail % d->capacity];
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+static int stealTask (deque *d, task *t)
+{
+	int found = 0;
+	if (pthread_mutex_trylock(&d->lock) != 0)
+		return 0;
+	if (d->tail != d->head)
+	{
+		*t = d->tasks[d->head % d->capacity];
+		d->head++;
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+static int findTask (task *t)
+{
+	int n = atomic_load_explicit(&pool.numThreads, memory_order_relaxed);
+	if (popTask(&pool.deques[self], t))
+		goto found;
+	seed = seed * 1103515245 + 12345;
+	int start = (seed >> 16) % n;
+	for (int i = 0; i < n; i++)
+	{
+		int victim = (start + i) % n;
+		if (victim != self && stealTask(&pool.deques[victim], t))
+			goto found;
+	}
+	return 0;
+found:
+	atomic_fetch_sub(&pool.queued, 1);
+	return 1;
+}
+
+static void runTask (task *t)
+{
+	t->run(t->arg);
+	if (t->pending != NULL)
+		atomic_fetch_sub(t->pending, 1);
+	if (t->isUser)
+		leavePool();
+}
+
+static void wakeWorkers ()
+{
+	if (atomic_load(&pool.idle) == 0)
+		return;
+	pthread_mutex_lock(&pool.idleLock);
+	pthread_cond_broadcast(&pool.idleCond);
+	pthread_mutex_unlock(&pool.idleLock);
+}
+
+static void* workerMain (void *arg)
+{
+	self = (int)(intptr_t)arg;
+	seed = self + 1;
+	task t;
+	while (!atomic_load(&pool.shutdown))
+	{
+		if (findTask(&t))
+		{
+			runTask(&t);
+			continue;
+		}
+		atomic_fetch_add(&pool.idle, 1);
+		pthread_mutex_lock(&pool.idleLock);
+		while (atomic_load(&pool.queued) == 0 && !atomic_load(&pool.shutdown))
+			pthread_cond_wait(&pool.idleCond, &pool.idleLock);
+		pthread_mutex_unlock(&pool.idleLock);
+		atomic_fetch_sub(&pool.idle, 1);
+	}
+	return NULL;
+}
+
+/* Only called with pool.lock held, while nobody uses the pool */
+static void stopPool ()
+{
+	int n = atomic_load(&pool.numThreads);
+	atomic_store(&pool.shutdown, 1);
+	pthread_mutex_lock(&pool.idleLock);
+	pthread_cond_broadcast(&pool.idleCond);
+	pthread_mutex_unlock(&pool.idleLock);
+	for (int i = 1; i < n; i++)
+		pthread_join(pool.threads[i], NULL);
+	for (int i = 0; i < n; i++)
+	{
+		pthread_mutex_destroy(&pool.deques[i].lock);
+		free(pool.deques[i].tasks);
+	}
+	free(pool.deques);
+	free(pool.threads);
+	pool.deques = NULL;
+	pool.threads = NULL;
+}
+
+/* Only called with pool.lock held */
+static void startPool ()
+{
+	if (requestedThreads < 0)
+		requestedThreads = readEnvironment("PHI_NUM_THREADS");
+	/* Unless they were set already, possibly concurrently */
+	int unset = -1;
+	atomic_compare_exchange_strong(&requestedChunkSize, &unset, readEnvironment("PHI_CHUNK_SIZE"));
+	unset = -1;
+	atomic_compare_exchange_strong(&requestedCutoff, &unset, readEnvironment("PHI_SPAWN_CUTOFF"));
+	int n = requestedThreads;
+	if (n == 0)
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n < 1)
+		n = 1;
+
+	pool.deques = calloc(n, sizeof(deque));
+	pool.threads = calloc(n, sizeof(pthread_t));
+	if (pool.deques == NULL || pool.threads == NULL)
+	{
+		free(pool.deques);
+		free(pool.threads);
+		n = 1;
+		pool.deques = calloc(1, sizeof(deque));
+		pool.threads = NULL;
+	}
+	for (int i = 0; i < n; i++)
+		pthread_mutex_init(&pool.deques[i].lock, NULL);
+	atomic_store(&pool.shutdown, 0);
+	atomic_store(&pool.queued, 0);
+	atomic_store(&pool.numThreads, n);
+	for (int i = 1; i < n; i++)
+	{
+		if (pthread_create(&pool.threads[i], NULL, workerMain, (void*)(intptr_t)i) != 0)
+		{
+			/* Run with the threads we got. Tasks queued for the missing ones are stolen. */
+			atomic_store(&pool.numThreads, i);
+			break;
+		}
+	}
+	/* Publish the pool only now that it is complete */
+	atomic_store_explicit(&pool.running, 1, memory_order_release);
+}
+
+/* Stop the pool for a new number of threads, which is started on its next use. The workers of the pool cannot do
+ * this, as they would have to wait for themselves, and neither can any thread while another one uses the pool.
+ * Only called with pool.lock held. */
+static void resizePool ()
+{
+	if (!atomic_load(&pool.resize) || self != 0)
+		return;
+	if (!atomic_load(&pool.running))
+	{
+		atomic_store(&pool.resize, 0);
+		return;
+	}
+	/* Users increment the count before they look at running, so either they back off or we see them */
+	atomic_store(&pool.running, 0);
+	if (atomic_load(&pool.users) != 0)
+	{
+		atomic_store(&pool.running, 1);
+		return;
+	}
+	stopPool();
+	atomic_store(&pool.resize, 0);
+}
+
+int enterPool ()
+{
+	atomic_fetch_add(&pool.users, 1);
+	if (atomic_load(&pool.running) && !atomic_load(&pool.resize))
+		return atomic_load_explicit(&pool.numThreads, memory_order_relaxed);
+	atomic_fetch_sub(&pool.users, 1);
+	pthread_mutex_lock(&pool.lock);
+	resizePool();
+	if (!atomic_load(&pool.running))
+		startPool();
+	atomic_fetch_add(&pool.users, 1);
+	int n = atomic_load(&pool.numThreads);
+	pthread_mutex_unlock(&pool.lock);
+	return n;
+}
+
+void leavePool ()
+{
+	atomic_fetch_sub(&pool.users, 1);
+}
+
+int submitTask (int worker, task t)
+{
+	if (!pushTask(&pool.deques[worker % atomic_load_explicit(&pool.numThreads, memory_order_relaxed)], t))
+		return 0;
+	wakeWorkers();
+	return 1;
+}
+
+void helpUntilDone (atomic_long *pending)
+{
+	task t;
+	while (atomic_load(pending) > 0)
+	{
+		if (findTask(&t))
+			runTask(&t);
+		else
+			sched_yield();
+	}
+}
+
+int currentWorker ()
+{
+	return self;
+}
+
+/*--------------*\
+ * Parallel For *
+\*--------------*/
+
+typedef struct chunk {
+	phirt_loop_body body;
+	void *env;
+	int64_t first;
+	int64_t last;
+} chunk;
+
+static void runChunk (void *arg)
+{
+	chunk *c = arg;
+	c->body(c->first, c->last, c->env);
+}
+
+void phirt_parallel_for (int64_t count, phirt_loop_body body, void *env)
+{
+	if (count <= 0)
+		return;
+	int threads = enterPool();
+	int64_t chunkSize = atomic_load_explicit(&requestedChunkSize, memory_order_relaxed);
+	if (chunkSize <= 0)
+		chunkSize = count / (8 * (int64_t)threads);
+	if (chunkSize < 1)
+		chunkSize = 1;
+	int64_t numChunks = (count + chunkSize - 1) / chunkSize;
+	chunk *chunks = NULL;
+	if (threads > 1 && numChunks > 1)
+		chunks = malloc(numChunks * sizeof(chunk));
+	if (chunks == NULL)
+	{
+		leavePool();
+		body(0, count, env);
+		return;
+	}
+
+	/* Give every thread a contiguous block of chunks. Imbalances are evened out by stealing. */
+	atomic_long pending = numChunks;
+	for (int64_t i = 0; i < numChunks; i++)
+	{
+		chunks[i].body = body;
+		chunks[i].env = env;
+		chunks[i].first = i * chunkSize;
+		chunks[i].last = (i+1 == numChunks) ? count : (i+1) * chunkSize;
+		task t = { runChunk, &chunks[i], &pending, 0 };
+		int worker = (self + i * threads / numChunks) % threads;
+		if (!submitTask(worker, t))
+			runTask(&t);
+	}
+	helpUntilDone(&pending);
+	free(chunks);
+	leavePool();
+}
+
+void phirt_critical_enter ()
+{
+	pthread_mutex_lock(&pool.criticalLock);
+}
+
+void phirt_critical_exit ()
+{
+	pthread_mutex_unlock(&pool.criticalLock);
+}
+
+/*----------------*\
+ * Spawn and Sync *
+\*----------------*/
+
+void phirt_spawn (phirt_counter *pending, phirt_task_body body, void *frame)
+{
+	int threads = enterPool();
+	int requested = atomic_load_explicit(&requestedCutoff, memory_order_relaxed);
+	long cutoff = (requested > 0 ? requested : 4) * (long)threads;
+	/* Once there is enough work queued to keep every thread busy, further calls are not worth a task */
+	if (threads == 1 || atomic_load(&pool.queued) >= cutoff)
+	{
+		leavePool();
+		body(frame);
+		return;
+	}
+	/* The queued call keeps using the pool until it has finished */
+	atomic_fetch_add(pending, 1);
+	task t = { body, frame, pending, 1 };
+	if (!submitTask(currentWorker(), t))
+		runTask(&t);
+}
+
+void phirt_sync (phirt_counter *pending)
+{
+	enterPool();
+	helpUntilDone(pending);
+	leavePool();
+}
+
+/*---------------*\
+ * Configuration *
+\*---------------*/
+
+int phirt_set_num_threads (int threads)
+{
+	pthread_mutex_lock(&pool.lock);
+	int previous = requestedThreads < 0 ? readEnvironment("PHI_NUM_THREADS") : requestedThreads;
+	requestedThreads = threads > 0 ? threads : 0;
+	/* The pool is restarted with the new size on its next use. While it is in use, or when called by one of its
+	 * workers, it is resized once it is next entered from outside without any other users. */
+	atomic_store(&pool.resize, 1);
+	resizePool();
+	pthread_mutex_unlock(&pool.lock);
+	return previous;
+}
+
+int phirt_set_chunk_size (int iterations)
+{
+	int previous = atomic_exchange(&requestedChunkSize, iterations > 0 ? iterations : 0);
+	return previous < 0 ? readEnvironment("PHI_CHUNK_SIZE") : previous;
+}
+
+int phirt_set_spawn_cutoff (int tasks)
+{
+	int previous = atomic_exchange(&requestedCutoff, tasks > 0 ? tasks : 0);
+	return previous < 0 ? readEnvironment("PHI_SPAWN_CUTOFF") : previous;
+}
+
+int phirt_num_threads ()
+{
+	int threads = enterPool();
+	leavePool();
+	return threads;
+}
@@ -0,0 +1,22 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdatomic.h>
+
+typedef struct task {
+	void (*run)(void *arg);
+	void *arg;
+	/* Decremented once the task has finished */
+	atomic_long *pending;
+	/* Whether the task counts as a user of the pool until it has finished */
+	int isUser;
+} task;
+
+/* Start the pool if necessary and count the caller as its user until leavePool. Returns the number of threads. */
+int enterPool ();
+void leavePool ();
+int submitTask (int worker, task t);
+void helpUntilDone (atomic_long *pending);
+int currentWorker ();
+
+#endif /* SCHEDULER_H_ */
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <string.h>
+#include <llvm-c/Core.h>
+#include "stack.h"
+#include "ast.h"
+#include "codegen.h"
+#include "binaryops.h"
+#include "algorithms.h"
+
+extern LLVMContextRef phi_context;
+extern LLVMBuilderRef phi_builder;
+
+/* Built-in algorithms on arrays and slices, which call the kernel of the runtime for their type of elements */
+static const struct algorithm {
+	const char *name;
+	/* Number of values taken after the array or slice */
+	unsigned numArgs;
+	/* Whether the array is changed in place */
+	int inPlace;
+} algorithms[] = {
+	{"sort", 0, 1},
+	{"scan", 0, 1},
+	{"minloc", 0, 0},
+	{"maxloc", 0, 0},
+	{"search", 1, 0},
+	{"histogram", 3, 0},
+	{NULL, 0, 0}
+};
+
+static const struct algorithm* lookupAlgorithm (const char *name)
+{
+	for (const struct algorithm *a = algorithms; a->name != NULL; a++)
+		if (strcmp(a->name, name) == 0)
+			return a;
+	return NULL;
+}
+
+/* Suffix of the runtime kernels for a type of elements, or NULL if there are none */
+static const char* kernelSuffix (LLVMTypeRef element, int isUnsignedElement)
+{
+	switch (LLVMGetTypeKind(element))
+	{
+		case LLVMDoubleTypeKind:
+			return "f64";
+		case LLVMFloatTypeKind:
+			return "f32";
+		case LLVMIntegerTypeKind:
+			switch (LLVMGetIntTypeWidth(element))
+			{
+				case 64:
+					return "i64";
+				case 32:
+					return isUnsignedElement ? "u32" : "i32";
+				case 16:
+					return "i16";
+				case 8:
+					return "i8";
+			}
+			return NULL;
+		default:
+			return NULL;
+	}
+}
+
+/* Split an array or slice into a pointer to its elements and its length for a runtime kernel. Only array variables
+ * and slices can be changed in place, while constant tables are read where they are. */
+static LLVMValueRef kernelArgument (LLVMValueRef val, int inPlace, const char *name, LLVMValueRef *ptr,
+	LLVMValueRef *length)
+{
+	LLVMTypeRef type = LLVMTypeOf(val);
+	LLVMTypeRef element;
+	if (isSliceType(type))
+		element = LLVMGetElementType(LLVMStructGetTypeAtIndex(type, 0));
+	else if (LLVMGetTypeKind(type) == LLVMArrayTypeKind)
+		element = LLVMGetElementType(type);
+	else
+		return logError("The algorithms of the runtime only work on arrays and slices.", 0x2C0F);
+	if (kernelSuffix(element, isUnsigned(val)) == NULL)
+		return logError("The algorithms of the runtime only work on arrays and slices of numbers.", 0x2C10);
+	LLVMValueRef table = constantTable(unchangedSource(val));
+	if (inPlace && LLVMGetTypeKind(type) == LLVMArrayTypeKind && (unchangedSource(val) == NULL || table != NULL))
+	{
+		const char *format = "%s changes an array in place, so it needs an array variable or a slice.";
+		char msg[strlen(name) + strlen(format)];
+		sprintf(msg, format, name);
+		return logError(msg, 0x2C11);
+	}
+	if (table != NULL)
+	{
+		LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+		LLVMValueRef idxs[2] = {LLVMConstNull(i64), LLVMConstNull(i64)};
+		*ptr = LLVMBuildInBoundsGEP(phi_builder, unchangedSource(val), idxs, 2, "tablebegin");
+		*length = LLVMConstInt(i64, LLVMGetArrayLength(type), 0);
+	}
+	else if (!sliceArgument(val, LLVMPointerType(element, 0), ptr, length))
+		return NULL;
+	return *ptr;
+}
+
+/* Declaration of a runtime kernel, e.g. phirt_sort_f64 */
+static LLVMValueRef algorithmKernel (const char *name, LLVMValueRef array, LLVMTypeRef retType, LLVMTypeRef *params,
+	unsigned count)
+{
+	LLVMTypeRef element = LLVMGetElementType(params[0]);
+	const char *suffix = kernelSuffix(element, isUnsigned(array));
+	char kernel[strlen(name) + strlen(suffix) + 8];
+	sprintf(kernel, "phirt_%s_%s", name, suffix);
+	return getRuntimeFunction(kernel, retType, params, count);
+}
+
+/* a sum of an array or slice adds its elements pairwise in blocks */
+LLVMValueRef buildArraySum (LLVMValueRef array)
+{
+	LLVMValueRef args[2];
+	if (kernelArgument(array, 0, "sum", &args[0], &args[1]) == NULL)
+		return NULL;
+	LLVMTypeRef params[2] = {LLVMTypeOf(args[0]), LLVMTypeOf(args[1])};
+	LLVMTypeRef element = LLVMGetElementType(params[0]);
+	LLVMValueRef result = LLVMBuildCall(phi_builder, algorithmKernel("sum", array, element, params, 2), args, 2, "sum");
+	if (isUnsigned(array))
+		markUnsigned(result);
+	return result;
+}
+
+unsigned algorithmArguments (const char *name)
+{
+	const struct algorithm *a = lookupAlgorithm(name);
+	return a != NULL ? a->numArgs + 1 : 0;
+}
+
+/* a sort, a scan, a minloc, a maxloc, a x search, a lo hi counts histogram. minloc and maxloc also return the index
+ * of the element. */
+LLVMValueRef buildAlgorithm (const char *name, LLVMValueRef *values, LLVMValueRef *index)
+{
+	const struct algorithm *a = lookupAlgorithm(name);
+	LLVMValueRef array = values[0];
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMTypeRef f64 = LLVMDoubleTypeInContext(phi_context);
+	LLVMValueRef args[6];
+	/* The counts are split first, as copying the array would count as a change of them */
+	int isHistogram = (strcmp(a->name, "histogram") == 0);
+	if (isHistogram && kernelArgument(values[3], 1, a->name, &args[4], &args[5]) == NULL)
+		return NULL;
+	if (kernelArgument(array, a->inPlace, a->name, &args[0], &args[1]) == NULL)
+		return NULL;
+	LLVMTypeRef element = LLVMGetElementType(LLVMTypeOf(args[0]));
+	LLVMTypeRef params[6] = {LLVMTypeOf(args[0]), i64};
+	LLVMValueRef result;
+	if (a->inPlace)
+	{
+		LLVMValueRef kernel = algorithmKernel(a->name, array, LLVMVoidTypeInContext(phi_context), params, 2);
+		return LLVMBuildCall(phi_builder, kernel, args, 2, "");
+	}
+	else if (strcmp(a->name, "search") == 0)
+	{
+		args[2] = adaptConstant(values[1], element);
+		if (LLVMTypeOf(args[2]) != element)
+			return logError("search looks for a value of the same type as the elements.", 0x2C12);
+		params[2] = element;
+		result = LLVMBuildCall(phi_builder, algorithmKernel(a->name, array, i64, params, 3), args, 3, "index");
+	}
+	else if (isHistogram)
+	{
+		for (unsigned i = 1; i <= 2; i++)
+		{
+			LLVMTypeKind kind = LLVMGetTypeKind(LLVMTypeOf(values[i]));
+			if (kind != LLVMIntegerTypeKind && kind != LLVMFloatTypeKind && kind != LLVMDoubleTypeKind)
+				return logError("The bounds of a histogram must be numbers.", 0x2C13);
+		}
+		if (LLVMGetElementType(LLVMTypeOf(args[4])) != i64)
+			return logError("A histogram counts into an Int64 array or slice.", 0x2C13);
+		args[2] = buildConversion(values[1], f64, 0);
+		args[3] = buildConversion(values[2], f64, 0);
+		params[2] = params[3] = f64;
+		params[4] = LLVMTypeOf(args[4]);
+		params[5] = i64;
+		LLVMValueRef kernel = algorithmKernel(a->name, array, LLVMVoidTypeInContext(phi_context), params, 6);
+		return LLVMBuildCall(phi_builder, kernel, args, 6, "");
+	}
+	else
+	{
+		args[2] = CreateEntryPointAlloca(LLVMGetBasicBlockParent(LLVMGetInsertBlock(phi_builder)), element,
+			a->name);
+		params[2] = LLVMTypeOf(args[2]);
+		*index = LLVMBuildCall(phi_builder, algorithmKernel(a->name, array, i64, params, 3), args, 3, "index");
+		result = LLVMBuildLoad(phi_builder, args[2], a->name);
+		if (isUnsigned(array))
+			markUnsigned(result);
+	}
+	return result;
+}
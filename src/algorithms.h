@@ -0,0 +1,10 @@
+#ifndef ALGORITHMS_H_
+#define ALGORITHMS_H_
+
+#include <llvm-c/Core.h>
+
+unsigned algorithmArguments (const char *name);
+LLVMValueRef buildAlgorithm (const char *name, LLVMValueRef *values, LLVMValueRef *index);
+LLVMValueRef buildArraySum (LLVMValueRef array);
+
+#endif /* ALGORITHMS_H_ */
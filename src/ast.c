@@ -18,15 +18,49 @@ Expr* newExpression (void *expr, ExprType expr_type)
 	return e;
 }
 
+TypeDesc* newTypeDesc (int base, unsigned vecsize, unsigned arraysize)
+{
+	TypeDesc *td = malloc(sizeof(TypeDesc));
+	if (td == NULL)
+		return logError("Could not allocate Memory.", 0x10E);
+	td->base = base;
+	td->vecsize = vecsize;
+	td->arraysize = arraysize;
+	td->rows = 0;
+	td->param = 0;
+	td->vecParam = 0;
+	td->arrayParam = 0;
+	td->rowParam = 0;
+	td->slice = 0;
+	return td;
+}
+
+Param* newParam (char *name, TypeDesc *type)
+{
+	Param *p = malloc(sizeof(Param));
+	if (p == NULL)
+		return logError("Could not allocate Memory.", 0x10F);
+	p->name = name;
+	p->type = type;
+	return p;
+}
+
 Expr* newLiteralExpr (double val, int type)
 {
 	LiteralExpr *ne = malloc(sizeof(LiteralExpr));
 	if (ne == NULL)
 		return logError("Could not allocate Memory.", 0x101);
-	if (type == lit_real)
-		ne->val.real = val;
-	else
-		ne->val.integral = val;
+	ne->val.real = val;
+	ne->type = type;
+	return newExpression(ne, expr_literal);
+}
+
+Expr* newIntLiteralExpr (long long val, int type)
+{
+	LiteralExpr *ne = malloc(sizeof(LiteralExpr));
+	if (ne == NULL)
+		return logError("Could not allocate Memory.", 0x101);
+	ne->val.integral = val;
 	ne->type = type;
 	return newExpression(ne, expr_literal);
 }
@@ -50,10 +84,45 @@ Expr* newIdentExpr (char *name, IdFlag flag, unsigned size)
 	ie->name = name;
 	ie->flag = flag;
 	ie->size = size;
+	ie->sizeParam = 0;
+	ie->rows = 0;
+	ie->rowParam = 0;
+	ie->align = 0;
+	ie->field = NULL;
 	return newExpression(ie, expr_ident);
 }
 
-Expr* newAccessExpr (Expr *ie, Expr *idx)
+Expr* setSizeParam (Expr *e, unsigned param)
+{
+	if (e == NULL)
+		return NULL;
+	IdentExpr *ie = e->expr;
+	ie->sizeParam = param + 1;
+	return e;
+}
+
+Expr* setAlignment (Expr *e, unsigned align)
+{
+	if (e == NULL)
+		return NULL;
+	IdentExpr *ie = e->expr;
+	ie->align = align;
+	return e;
+}
+
+Expr* setField (Expr *e, char *field)
+{
+	if (e == NULL)
+	{
+		free(field);
+		return NULL;
+	}
+	IdentExpr *ie = e->expr;
+	ie->field = field;
+	return e;
+}
+
+Expr* newAccessExpr (Expr *ie, Expr *idx, Expr *mask)
 {
 	AccessExpr *ae = malloc(sizeof(AccessExpr));
 	if (ae == NULL)
@@ -61,7 +130,9 @@ Expr* newAccessExpr (Expr *ie, Expr *idx)
 	IdentExpr *ide = ie->expr;
 	ae->name = ide->name;
 	ae->flag = ide->flag;
+	ae->field = ide->field;
 	ae->idx = idx;
+	ae->mask = mask;
 	free(ie->expr);
 	free(ie);
 	return newExpression(ae, expr_access);
@@ -76,6 +147,8 @@ Expr* newProtoExpr (char *name, stack *in, stack *out, int isTemplate)
 	pe->inArgs = in;
 	pe->outArgs = out;
 	pe->isTemplate = isTemplate;
+	pe->isGenerator = 0;
+	pe->isStrict = 0;
 	return newExpression(pe, expr_proto);
 }
 
@@ -90,13 +163,13 @@ Expr* newFunctionExpr (Expr *proto, Expr *body, Expr *ret)
 	return newExpression(fe, expr_func);
 }
 
-Expr* newTemplateExpr (char *name, int type_name)
+Expr* newTemplateExpr (char *name, stack *args)
 {
 	TemplateExpr *te = malloc(sizeof(TemplateExpr));
 	if (te == NULL)
 		return logError("Could not allocate Memory.", 0x107);
 	te->name = name;
-	te->type_name = type_name;
+	te->args = args;
 	return newExpression(te, expr_template);
 }
 
@@ -122,6 +195,117 @@ Expr* newLoopExpr (Expr *Cond, Expr *Body, Expr *Else)
 	return newExpression(le, expr_loop);
 }
 
+Expr* newForExpr (char *var, Expr *Start, Expr *End, Expr *Step)
+{
+	ForExpr *fe = malloc(sizeof(ForExpr));
+	if (fe == NULL)
+		return logError("Could not allocate Memory.", 0x10A);
+	fe->var = var;
+	fe->Start = Start;
+	fe->End = End;
+	fe->Step = Step;
+	fe->Body = NULL;
+	fe->Else = NULL;
+	fe->vectorize = -1;
+	fe->unroll = -1;
+	fe->interleave = -1;
+	fe->parallel = 0;
+	fe->reductions = NULL;
+	return newExpression(fe, expr_for);
+}
+
+Expr* addLoopHint (Expr *e, LoopHint hint, int count)
+{
+	if (e == NULL)
+		return NULL;
+	ForExpr *fe = e->expr;
+	switch (hint)
+	{
+		case hint_vectorize:
+			fe->vectorize = count;
+			break;
+		case hint_unroll:
+			fe->unroll = count;
+			break;
+		case hint_interleave:
+			fe->interleave = count;
+			break;
+	}
+	return e;
+}
+
+Expr* setForBody (Expr *e, Expr *Body, Expr *Else)
+{
+	if (e == NULL)
+		return NULL;
+	ForExpr *fe = e->expr;
+	fe->Body = Body;
+	fe->Else = Else;
+	return e;
+}
+
+Expr* addReduction (Expr *e, int op, char *var)
+{
+	if (e == NULL)
+		return NULL;
+	ForExpr *fe = e->expr;
+	fe->reductions = push(var, op, fe->reductions);
+	return e;
+}
+
+Expr* setParallel (Expr *e)
+{
+	if (e == NULL)
+		return NULL;
+	ForExpr *fe = e->expr;
+	fe->parallel = 1;
+	return e;
+}
+
+Expr* setStrict (Expr *e)
+{
+	if (e == NULL)
+		return NULL;
+	FunctionExpr *fe = e->expr;
+	ProtoExpr *pe = fe->proto->expr;
+	pe->isStrict = 1;
+	return e;
+}
+
+Expr* newSpawnExpr (Expr *call)
+{
+	SpawnExpr *se = malloc(sizeof(SpawnExpr));
+	if (se == NULL)
+		return logError("Could not allocate Memory.", 0x10B);
+	se->call = call;
+	return newExpression(se, expr_spawn);
+}
+
+Expr* newForEachExpr (char *var, Expr *Source, Expr *Body, Expr *Else)
+{
+	ForEachExpr *fe = malloc(sizeof(ForEachExpr));
+	if (fe == NULL)
+		return logError("Could not allocate Memory.", 0x10D);
+	fe->var = var;
+	fe->Source = Source;
+	fe->Body = Body;
+	fe->Else = Else;
+	return newExpression(fe, expr_foreach);
+}
+
+Expr* newTableExpr (stack *elements, int isVector)
+{
+	TableExpr *te = malloc(sizeof(TableExpr));
+	if (te == NULL)
+	{
+		clearStack(&elements, clearElement);
+		return logError("Could not allocate Memory.", 0x110);
+	}
+	te->elements = elements;
+	te->isVector = isVector;
+	return newExpression(te, expr_table);
+}
+
 /*----------------------*\
  *	Clear Data	*
 \*----------------------*/
@@ -139,6 +323,7 @@ void clearIdentExpr (IdentExpr *ie)
 	if (ie == NULL)
 		return;
 	free(ie->name);
+	free(ie->field);
 }
 
 void clearAccessExpr (AccessExpr *ae)
@@ -146,18 +331,30 @@ void clearAccessExpr (AccessExpr *ae)
 	if (ae == NULL)
 		return;
 	free(ae->name);
+	free(ae->field);
 	clearExpr(ae->idx);
+	clearExpr(ae->mask);
 }
 
 void clearProtoExpr (ProtoExpr *pe)
 {
 	if (pe == NULL)
 		return;
-	clearStack(&(pe->inArgs), free);
-	clearStack(&(pe->outArgs), free);
+	clearStack(&(pe->inArgs), clearParam);
+	clearStack(&(pe->outArgs), clearParam);
 	free(pe->name);
 }
 
+void clearParam (void *p)
+{
+	if (p == NULL)
+		return;
+	Param *param = p;
+	free(param->name);
+	free(param->type);
+	free(param);
+}
+
 void clearFunctionExpr (FunctionExpr *fe)
 {
 	if (fe == NULL)
@@ -172,6 +369,7 @@ void clearTemplateExpr (TemplateExpr *te)
 	if (te == NULL)
 		return;
 	free(te->name);
+	clearStack(&te->args, free);
 }
 
 void clearCondExpr (CondExpr *ce)
@@ -192,6 +390,48 @@ void clearLoopExpr (LoopExpr *le)
 	clearExpr(le->Else);
 }
 
+void clearForExpr (ForExpr *fe)
+{
+	if (fe == NULL)
+		return;
+	free(fe->var);
+	clearExpr(fe->Start);
+	clearExpr(fe->End);
+	clearExpr(fe->Step);
+	clearExpr(fe->Body);
+	clearExpr(fe->Else);
+	clearStack(&(fe->reductions), free);
+}
+
+void clearSpawnExpr (SpawnExpr *se)
+{
+	if (se == NULL)
+		return;
+	clearExpr(se->call);
+}
+
+void clearForEachExpr (ForEachExpr *fe)
+{
+	if (fe == NULL)
+		return;
+	free(fe->var);
+	clearExpr(fe->Source);
+	clearExpr(fe->Body);
+	clearExpr(fe->Else);
+}
+
+void clearElement (void *e)
+{
+	clearExpr(e);
+}
+
+void clearTableExpr (TableExpr *te)
+{
+	if (te == NULL)
+		return;
+	clearStack(&te->elements, clearElement);
+}
+
 void clearExpr (Expr *e)
 {
 	if (e == NULL)
@@ -222,6 +462,18 @@ void clearExpr (Expr *e)
 		case expr_loop:
 			clearLoopExpr(e->expr);
 			break;
+		case expr_for:
+			clearForExpr(e->expr);
+			break;
+		case expr_spawn:
+			clearSpawnExpr(e->expr);
+			break;
+		case expr_foreach:
+			clearForEachExpr(e->expr);
+			break;
+		case expr_table:
+			clearTableExpr(e->expr);
+			break;
 		default:
 			break;
 	}
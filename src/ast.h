@@ -23,16 +23,63 @@ typedef enum Expressions
 	expr_func,
 	expr_template,
 	expr_conditional,
-	expr_loop
+	expr_loop,
+	expr_for,
+	expr_spawn,
+	expr_foreach,
+	expr_table
 } ExprType;
 
+typedef enum LoopHints
+{
+	hint_vectorize,
+	hint_unroll,
+	hint_interleave
+} LoopHint;
+
 enum Literals
 {
 	lit_real,
 	lit_int,
-	lit_bool
+	lit_bool,
+	lit_float32,
+	lit_int64,
+	lit_uint,
+	/* A complex number without real part, written as 2.5i */
+	lit_imaginary,
+	/* The value of an integer template parameter, whose index is stored as integral */
+	lit_template,
+	/* A function parameter passed on as written op:f, whose index is stored as integral */
+	lit_function,
+	/* A record built from the values of its fields, whose index is stored as integral */
+	lit_record
 };
 
+/* A type as written in the source, e.g. Real<4>[10] */
+typedef struct TypeDescAST {
+	/* One of the type tokens of the parser, e.g. type_real, type_template or type_record */
+	int base;
+	/* Number of vector lanes and array elements, 0 if the type is no vector or no array */
+	unsigned vecsize;
+	unsigned arraysize;
+	/* Number of rows of a matrix, whose columns are given by vecsize, 0 if the type is no matrix */
+	unsigned rows;
+	/* Index of the template parameter or the record, if base is type_template or type_record */
+	unsigned param;
+	/* 1 + index of the template parameter giving the number of lanes or elements, 0 if the size is fixed */
+	unsigned vecParam;
+	unsigned arrayParam;
+	unsigned rowParam;
+	/* A slice refers to elements owned by the caller, e.g. Real[], and has no fixed size */
+	int slice;
+} TypeDesc;
+
+/* Function parameter. The name is NULL for unnamed return values, the type is NULL for functions passed as op:f. */
+typedef struct ParamAST {
+	char *name;
+	TypeDesc *type;
+} Param;
+
 /* General Expression type */
 typedef struct Expr {
 	ExprType expr_type;
@@ -42,7 +89,7 @@ typedef struct Expr {
 /* Specific Expression types */
 typedef struct LiteralExprAST {
 	union {
-		int integral;
+		long long integral;
 		double real;
 	} val;
 	int type;
@@ -57,19 +104,35 @@ typedef struct IdentExprAST {
 	char *name;
 	IdFlag flag;
 	unsigned size;
+	/* 1 + index of the template parameter giving the size, 0 if the size is fixed */
+	unsigned sizeParam;
+	/* Number of rows of a new matrix, whose columns are given by the size, 0 for vectors */
+	unsigned rows;
+	unsigned rowParam;
+	/* Alignment of a new array in bytes, 0 for the default */
+	unsigned align;
+	/* Field of a record, written as name.field, or NULL */
+	char *field;
 } IdentExpr;
 
 typedef struct AccessExprAST {
 	char *name;
 	IdFlag flag;
+	char *field;
 	Expr *idx;
+	/* Bool vector selecting the lanes of a gather or scatter, or NULL */
+	Expr *mask;
 } AccessExpr;
 
 typedef struct ProtoExprAST {
 	stack *inArgs;
 	stack *outArgs;
 	char *name;
+	/* Number of template parameters, 0 for ordinary functions */
 	int isTemplate;
+	int isGenerator;
+	/* Ignore the floating-point optimisations given on the command line */
+	int isStrict;
 } ProtoExpr;
 
 typedef struct FuncExprAST {
@@ -80,7 +143,8 @@ typedef struct FuncExprAST {
 
 typedef struct TempExprAST {
 	char *name;
-	int type_name;
+	/* Template arguments, the last one first. Integers have no TypeDesc, but keep their value in misc. */
+	stack *args;
 } TemplateExpr;
 
 typedef struct CondExprAST {
@@ -95,19 +159,72 @@ typedef struct LoopExprAST {
 	Expr *Else;
 } LoopExpr;
 
+typedef struct ForExprAST {
+	char *var;
+	Expr *Start;
+	Expr *End;
+	Expr *Step;
+	Expr *Body;
+	Expr *Else;
+	/* -1 if the hint was not given, 0 if it was given without a count */
+	int vectorize;
+	int unroll;
+	int interleave;
+	int parallel;
+	/* Names of the reduced variables. misc holds the operator: + * or < for min and > for max. */
+	stack *reductions;
+} ForExpr;
+
+typedef struct SpawnExprAST {
+	/* Either an IdentExpr or a TemplateExpr naming the function */
+	Expr *call;
+} SpawnExpr;
+
+typedef struct ForEachExprAST {
+	char *var;
+	/* Call of the generator, which produces the values */
+	Expr *Source;
+	Expr *Body;
+	Expr *Else;
+} ForEachExpr;
+
+/* Array or vector literal with constant elements, written as {1, 2, 3} or <{1, 2, 3}> */
+typedef struct TableExprAST {
+	/* The elements, the last one first */
+	stack *elements;
+	int isVector;
+} TableExpr;
+
+TypeDesc* newTypeDesc (int base, unsigned vecsize, unsigned arraysize);
+Param* newParam (char *name, TypeDesc *type);
 Expr* newLiteralExpr (double val, int type);
+Expr* newIntLiteralExpr (long long val, int type);
 Expr* newBinaryExpr (int binop, Expr *LHS, Expr *RHS);
 Expr* newIdentExpr (char *name, IdFlag flag, unsigned size);
-Expr* newAccessExpr (Expr *ie, Expr *idx);
+Expr* setSizeParam (Expr *e, unsigned param);
+Expr* setAlignment (Expr *e, unsigned align);
+Expr* setField (Expr *e, char *field);
+Expr* newAccessExpr (Expr *ie, Expr *idx, Expr *mask);
 Expr* newProtoExpr (char *name, stack *in, stack *out, int isTemplate);
 Expr* newFunctionExpr (Expr *proto, Expr *body, Expr *ret);
-Expr* newTemplateExpr (char *name, int type_name);
+Expr* newTemplateExpr (char *name, stack *args);
 Expr* newCondExpr (Expr *Cond, Expr *True, Expr *False);
 Expr* newLoopExpr (Expr *Cond, Expr *body, Expr *Else);
+Expr* newForExpr (char *var, Expr *Start, Expr *End, Expr *Step);
+Expr* addLoopHint (Expr *e, LoopHint hint, int count);
+Expr* setForBody (Expr *e, Expr *Body, Expr *Else);
+Expr* addReduction (Expr *e, int op, char *var);
+Expr* setParallel (Expr *e);
+Expr* setStrict (Expr *e);
+Expr* newSpawnExpr (Expr *call);
+Expr* newForEachExpr (char *var, Expr *Source, Expr *Body, Expr *Else);
+Expr* newTableExpr (stack *elements, int isVector);
 
 void* logError (const char *msg, int code);
 void clearExpr (Expr *e);
 void clearFunctionExpr (FunctionExpr *fe);
 void clearProtoExpr (ProtoExpr *fe);
+void clearParam (void *p);
+void clearElement (void *e);
 
 #endif /* AST_H_ */
@@ -2,108 +2,282 @@
 #include <llvm-c/Core.h>
 #include "binaryops.h"
 #include "ast.h"
+#include "codegen.h"
 
 extern LLVMBuilderRef phi_builder;
 extern LLVMContextRef phi_context;
+extern LLVMModuleRef phi_module;
+extern int phi_fpFlags;
 
-LLVMValueRef buildAppropriateAddition (LLVMValueRef lhs, LLVMValueRef rhs)
+/* Repeat a scalar in every lane of a vector with the given number of lanes */
+LLVMValueRef buildSplat (LLVMValueRef scalar, unsigned size)
 {
-	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
-	LLVMTypeRef lhstype = LLVMTypeOf(lhs);
-	LLVMTypeRef rhstype = LLVMTypeOf(rhs);
-	LLVMTypeKind lhskind = LLVMGetTypeKind(lhstype);
-	LLVMTypeKind rhskind = LLVMGetTypeKind(rhstype);
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(phi_context);
+	LLVMTypeRef vectype = LLVMVectorType(LLVMTypeOf(scalar), size);
+	LLVMValueRef single = LLVMBuildInsertElement(phi_builder, LLVMGetUndef(vectype), scalar,
+		LLVMConstNull(i32), "splatinsert");
+	LLVMValueRef mask = LLVMConstNull(LLVMVectorType(i32, size));
+	LLVMValueRef splat = LLVMBuildShuffleVector(phi_builder, single, LLVMGetUndef(vectype), mask, "splat");
+	return isUnsigned(scalar) ? markUnsigned(splat) : splat;
+}
 
-	/* For Vector Types, check the element types */
-	if (lhskind == LLVMVectorTypeKind)
+/* If exactly one of the operands is a vector, turn the other one into a vector of the same size */
+static void broadcastScalar (LLVMValueRef *lhs, LLVMValueRef *rhs)
+{
+	LLVMTypeRef lhstype = LLVMTypeOf(*lhs);
+	LLVMTypeRef rhstype = LLVMTypeOf(*rhs);
+	int lhsIsVec = (LLVMGetTypeKind(lhstype) == LLVMVectorTypeKind);
+	int rhsIsVec = (LLVMGetTypeKind(rhstype) == LLVMVectorTypeKind);
+	if (lhsIsVec && !rhsIsVec)
+		*rhs = buildSplat(*rhs, LLVMGetVectorSize(lhstype));
+	else if (rhsIsVec && !lhsIsVec)
+		*lhs = buildSplat(*lhs, LLVMGetVectorSize(rhstype));
+}
+
+static LLVMTypeRef scalarType (LLVMTypeRef type)
+{
+	if (LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+		return LLVMGetElementType(type);
+	return type;
+}
+
+int isFloatingType (LLVMTypeRef type)
+{
+	LLVMTypeKind kind = LLVMGetTypeKind(scalarType(type));
+	return kind == LLVMFloatTypeKind || kind == LLVMDoubleTypeKind;
+}
+
+static int isNumericType (LLVMTypeRef type)
+{
+	type = scalarType(type);
+	if (LLVMGetTypeKind(type) == LLVMIntegerTypeKind)
+		return type != LLVMInt1TypeInContext(phi_context);
+	return isFloatingType(type);
+}
+
+/* Convert a number (or a vector of numbers) to the given type. The signedness of the value decides how integers
+ * are extended and converted to floating point, toUnsigned how floating point is converted to integers. */
+LLVMValueRef buildConversion (LLVMValueRef val, LLVMTypeRef type, int toUnsigned)
+{
+	LLVMTypeRef from = LLVMTypeOf(val);
+	int fromUnsigned = isUnsigned(val) || scalarType(from) == LLVMInt1TypeInContext(phi_context);
+	LLVMValueRef result;
+	if (from == type)
+		result = val;
+	else if (isFloatingType(from) && isFloatingType(type))
+		result = LLVMBuildFPCast(phi_builder, val, type, "fpcast");
+	else if (isFloatingType(type))
+		result = fromUnsigned ? LLVMBuildUIToFP(phi_builder, val, type, "uitofp")
+			: LLVMBuildSIToFP(phi_builder, val, type, "sitofp");
+	else if (isFloatingType(from))
+		result = toUnsigned ? LLVMBuildFPToUI(phi_builder, val, type, "fptoui")
+			: LLVMBuildFPToSI(phi_builder, val, type, "fptosi");
+	else
+		result = LLVMBuildIntCast2(phi_builder, val, type, !fromUnsigned, "intcast");
+	if (toUnsigned && !isFloatingType(type))
+		return markUnsigned(result);
+	return result == val ? result : markSigned(result);
+}
+
+/* A constant integer, which does not fit into the given type, keeps its own type */
+static int fitsInto (LLVMValueRef constant, LLVMTypeRef type)
+{
+	if (LLVMGetTypeKind(LLVMTypeOf(constant)) != LLVMIntegerTypeKind || isFloatingType(type))
+		return 1;
+	unsigned width = LLVMGetIntTypeWidth(type);
+	if (width >= 64)
+		return 1;
+	long long value = LLVMConstIntGetSExtValue(constant);
+	return value >= -(1LL << (width-1)) && value < (1LL << (width-1));
+}
+
+/* A literal may take the type of the other operand, as long as it does not turn a Real into an integer */
+static int adaptsTo (LLVMValueRef constant, LLVMTypeRef elemtype)
+{
+	if (!LLVMIsConstant(constant) || !isNumericType(LLVMTypeOf(constant)) || !isNumericType(elemtype))
+		return 0;
+	if (isFloatingType(LLVMTypeOf(constant)) && !isFloatingType(elemtype))
+		return 0;
+	return fitsInto(constant, elemtype);
+}
+
+LLVMValueRef adaptConstant (LLVMValueRef val, LLVMTypeRef type)
+{
+	if (LLVMTypeOf(val) == type || LLVMIsAInstruction(val) || !adaptsTo(val, scalarType(type)))
+		return val;
+	if ((LLVMGetTypeKind(type) == LLVMVectorTypeKind) != (LLVMGetTypeKind(LLVMTypeOf(val)) == LLVMVectorTypeKind))
+		return val;
+	return buildConversion(val, type, isUnsigned(val));
+}
+
+/* Bring two numbers (or vectors of the same size) to a common type. Literals take the type of the other operand,
+ * Real wins over integers, and otherwise the wider type is used. Returns 0 if the operands are no numbers. */
+static int promoteOperands (LLVMValueRef *lhs, LLVMValueRef *rhs, int *isUnsignedResult)
+{
+	LLVMTypeRef lhselem = scalarType(LLVMTypeOf(*lhs));
+	LLVMTypeRef rhselem = scalarType(LLVMTypeOf(*rhs));
+	if (!isNumericType(lhselem) || !isNumericType(rhselem))
+		return 0;
+	int lhsUnsigned = isUnsigned(*lhs);
+	int rhsUnsigned = isUnsigned(*rhs);
+	LLVMTypeRef common;
+	int commonUnsigned;
+	if (lhselem == rhselem)
 	{
-		if (rhskind != LLVMVectorTypeKind)
-			return logError("No addition available for vector and scalar.", 0x2511);
-		unsigned lhssize = LLVMGetVectorSize(lhstype);
-		unsigned rhssize = LLVMGetVectorSize(rhstype);
-		if (rhssize != lhssize)
-			return logError("No addition available for vectors of different size.", 0x2513);
-		lhstype = LLVMGetElementType(lhstype);
-		lhskind = LLVMGetTypeKind(lhstype);
-		rhstype = LLVMGetElementType(rhstype);
-		rhskind = LLVMGetTypeKind(rhstype);
+		common = lhselem;
+		commonUnsigned = lhsUnsigned || rhsUnsigned;
 	}
-	else if (rhskind == LLVMVectorTypeKind)
-		/* This part executes, if rhs is a vector, but lhs isn't. */
-		return logError("No addition available for scalar and vector.", 0x2512);
-
-	if (lhstype == booltype)
+	else if (!LLVMIsConstant(*rhs) && adaptsTo(*lhs, rhselem))
 	{
-		if (rhstype != booltype)
-			return logError("No addition available for Boolean and other type.", 0x2514);
-		return LLVMBuildXor(phi_builder, lhs, rhs, "xortmp");
+		common = rhselem;
+		commonUnsigned = rhsUnsigned;
 	}
-	else if (lhskind == LLVMDoubleTypeKind)
+	else if (!LLVMIsConstant(*lhs) && adaptsTo(*rhs, lhselem))
 	{
-		if (rhskind == LLVMIntegerTypeKind)
-			/* We need cannot use lhstype, because it was overwritten! */
-			rhs = LLVMBuildSIToFP(phi_builder, rhs, LLVMTypeOf(lhs), "sitofp");
-		return LLVMBuildFAdd(phi_builder, lhs, rhs, "faddtmp");
+		common = lhselem;
+		commonUnsigned = lhsUnsigned;
 	}
-	else if (lhskind == LLVMIntegerTypeKind)
+	else if (isFloatingType(lhselem) != isFloatingType(rhselem))
 	{
-		if (rhskind == LLVMDoubleTypeKind)
-		{
-			lhs = LLVMBuildSIToFP(phi_builder, lhs, LLVMTypeOf(rhs), "sitofp");
-			return LLVMBuildFAdd(phi_builder, lhs, rhs, "faddtmp");
-		}
-		return LLVMBuildAdd(phi_builder, lhs, rhs, "faddtmp");
+		common = isFloatingType(lhselem) ? lhselem : rhselem;
+		commonUnsigned = 0;
 	}
-
-	return logError("Incompatible Types for binary '+'.", 0x2515);
+	else if (isFloatingType(lhselem))
+	{
+		common = LLVMGetTypeKind(lhselem) == LLVMDoubleTypeKind ? lhselem : rhselem;
+		commonUnsigned = 0;
+	}
+	else
+	{
+		int lhsWider = LLVMGetIntTypeWidth(lhselem) > LLVMGetIntTypeWidth(rhselem);
+		common = lhsWider ? lhselem : rhselem;
+		commonUnsigned = lhsWider ? lhsUnsigned : rhsUnsigned;
+	}
+	LLVMTypeRef type = common;
+	if (LLVMGetTypeKind(LLVMTypeOf(*lhs)) == LLVMVectorTypeKind)
+		type = LLVMVectorType(common, LLVMGetVectorSize(LLVMTypeOf(*lhs)));
+	*lhs = buildConversion(*lhs, type, 0);
+	*rhs = buildConversion(*rhs, type, 0);
+	*isUnsignedResult = commonUnsigned && !isFloatingType(common);
+	return 1;
 }
 
-LLVMValueRef buildAppropriateSubtraction (LLVMValueRef lhs, LLVMValueRef rhs)
+/* Check that vectors have the same size. Scalars are first broadcast to the size of a vector operand. */
+static int sameShape (LLVMValueRef lhs, LLVMValueRef rhs)
 {
-	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
 	LLVMTypeRef lhstype = LLVMTypeOf(lhs);
 	LLVMTypeRef rhstype = LLVMTypeOf(rhs);
-	LLVMTypeKind lhskind = LLVMGetTypeKind(lhstype);
-	LLVMTypeKind rhskind = LLVMGetTypeKind(rhstype);
+	if (LLVMGetTypeKind(lhstype) != LLVMVectorTypeKind)
+		return 1;
+	return LLVMGetVectorSize(lhstype) == LLVMGetVectorSize(rhstype);
+}
+
+/* Bring the arguments of a built-in function to a common type and shape, as the operands of an operator */
+int promoteArguments (LLVMValueRef *args, unsigned numArgs, int *isUnsignedResult)
+{
+	*isUnsignedResult = isUnsigned(args[0]);
+	for (unsigned i = 1; i < numArgs; i++)
+	{
+		broadcastScalar(&args[0], &args[i]);
+		if (!sameShape(args[0], args[i]) || !promoteOperands(&args[0], &args[i], isUnsignedResult))
+			return 0;
+	}
+	/* Earlier arguments may still be scalars or of a narrower type */
+	LLVMTypeRef type = LLVMTypeOf(args[0]);
+	for (unsigned i = 1; i < numArgs; i++)
+	{
+		if (LLVMGetTypeKind(type) == LLVMVectorTypeKind && LLVMGetTypeKind(LLVMTypeOf(args[i])) != LLVMVectorTypeKind)
+			args[i] = buildSplat(args[i], LLVMGetVectorSize(type));
+		args[i] = buildConversion(args[i], type, 0);
+	}
+	return 1;
+}
+
+/* A product, which has not been used by anything yet, can be contracted with the following addition */
+static int isContractible (LLVMValueRef v)
+{
+	return (phi_fpFlags & fp_contract) && LLVMIsAInstruction(v)
+		&& LLVMGetInstructionOpcode(v) == LLVMFMul && !LLVMGetFirstUse(v);
+}
 
-	/* For Vector Types, check the element types */
-	if (lhskind == LLVMVectorTypeKind)
+/* Recompute the product with llvm.fmuladd, which LLVM emits as a fused multiply-add wherever the target has one. The
+ * product itself stays in place, as the stacks may still refer to it; it is removed as dead code otherwise. */
+static LLVMValueRef buildMultiplyAdd (LLVMValueRef product, LLVMValueRef addend, int negateProduct)
+{
+	LLVMValueRef args[3] = {LLVMGetOperand(product, 0), LLVMGetOperand(product, 1), addend};
+	if (negateProduct)
+		args[0] = LLVMBuildFNeg(phi_builder, args[0], "fnegtmp");
+	LLVMTypeRef type = LLVMTypeOf(addend);
+	unsigned id = LLVMLookupIntrinsicID("llvm.fmuladd", 12);
+	LLVMValueRef intrinsic = LLVMGetIntrinsicDeclaration(phi_module, id, &type, 1);
+	return LLVMBuildCall(phi_builder, intrinsic, args, 3, "fmatmp");
+}
+
+static LLVMValueRef buildFloatingAddition (LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	if (isContractible(lhs))
+		return buildMultiplyAdd(lhs, rhs, 0);
+	if (isContractible(rhs))
+		return buildMultiplyAdd(rhs, lhs, 0);
+	return LLVMBuildFAdd(phi_builder, lhs, rhs, "faddtmp");
+}
+
+static LLVMValueRef buildFloatingSubtraction (LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	if (isContractible(lhs))
+		return buildMultiplyAdd(lhs, LLVMBuildFNeg(phi_builder, rhs, "fnegtmp"), 0);
+	if (isContractible(rhs))
+		return buildMultiplyAdd(rhs, lhs, 1);
+	return LLVMBuildFSub(phi_builder, lhs, rhs, "fsubtmp");
+}
+
+static LLVMValueRef finishInteger (LLVMValueRef result, int isUnsignedResult)
+{
+	return isUnsignedResult ? markUnsigned(result) : markSigned(result);
+}
+
+LLVMValueRef buildAppropriateAddition (LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	broadcastScalar(&lhs, &rhs);
+	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
+	if (!sameShape(lhs, rhs))
+		return logError("No addition available for vectors of different size.", 0x2513);
+	LLVMTypeRef lhstype = scalarType(LLVMTypeOf(lhs));
+	LLVMTypeRef rhstype = scalarType(LLVMTypeOf(rhs));
+
+	if (lhstype == booltype)
 	{
-		if (rhskind != LLVMVectorTypeKind)
-			return logError("No subtraction available for vector and scalar.", 0x2521);
-		unsigned lhssize = LLVMGetVectorSize(lhstype);
-		unsigned rhssize = LLVMGetVectorSize(rhstype);
-		if (rhssize != lhssize)
-			return logError("No subtraction available for vectors of different size.", 0x2523);
-		lhstype = LLVMGetElementType(lhstype);
-		lhskind = LLVMGetTypeKind(lhstype);
-		rhstype = LLVMGetElementType(rhstype);
-		rhskind = LLVMGetTypeKind(rhstype);
+		if (rhstype != booltype)
+			return logError("No addition available for Boolean and other type.", 0x2514);
+		return LLVMBuildXor(phi_builder, lhs, rhs, "xortmp");
 	}
-	else if (rhskind == LLVMVectorTypeKind)
-		/* This part executes, if rhs is a vector, but lhs isn't. */
-		return logError("No subtraction available for scalar and vector.", 0x2522);
+	int isUnsignedResult;
+	if (!promoteOperands(&lhs, &rhs, &isUnsignedResult))
+		return logError("Incompatible Types for binary '+'.", 0x2515);
+	if (isFloatingType(LLVMTypeOf(lhs)))
+		return buildFloatingAddition(lhs, rhs);
+	return finishInteger(LLVMBuildAdd(phi_builder, lhs, rhs, "addtmp"), isUnsignedResult);
+}
+
+LLVMValueRef buildAppropriateSubtraction (LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	broadcastScalar(&lhs, &rhs);
+	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
+	if (!sameShape(lhs, rhs))
+		return logError("No subtraction available for vectors of different size.", 0x2523);
+	LLVMTypeRef lhstype = scalarType(LLVMTypeOf(lhs));
+	LLVMTypeRef rhstype = scalarType(LLVMTypeOf(rhs));
 
 	if (lhstype == booltype)
 		return logError("No subtraction available for Boolean and other type.", 0x2524);
 	else if (rhstype == booltype)
 		return logError("No subtraction available for other type and Boolean.", 0x2525);
-	else if (lhskind == LLVMDoubleTypeKind)
-	{
-		if (rhskind == LLVMIntegerTypeKind)
-			rhs = LLVMBuildSIToFP(phi_builder, rhs, LLVMTypeOf(lhs), "sitofp");
-		return LLVMBuildFSub(phi_builder, lhs, rhs, "fsubtmp");
-	}
-	else if (lhskind == LLVMIntegerTypeKind)
-	{
-		if (rhskind == LLVMDoubleTypeKind)
-		{
-			lhs = LLVMBuildSIToFP(phi_builder, lhs, LLVMTypeOf(rhs), "sitofp");
-			return LLVMBuildFSub(phi_builder, lhs, rhs, "fsubtmp");
-		}
-		return LLVMBuildSub(phi_builder, lhs, rhs, "ssubtmp");
-	}
-	return logError("Incompatible types for binary '-'.", 0x2526);
+	int isUnsignedResult;
+	if (!promoteOperands(&lhs, &rhs, &isUnsignedResult))
+		return logError("Incompatible types for binary '-'.", 0x2526);
+	if (isFloatingType(LLVMTypeOf(lhs)))
+		return buildFloatingSubtraction(lhs, rhs);
+	return finishInteger(LLVMBuildSub(phi_builder, lhs, rhs, "subtmp"), isUnsignedResult);
 }
 
 LLVMValueRef buildAppropriateMultiplication (LLVMValueRef lhs, LLVMValueRef rhs)
@@ -111,117 +285,74 @@ LLVMValueRef buildAppropriateMultiplication (LLVMValueRef lhs, LLVMValueRef rhs)
 	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
 	LLVMTypeRef lhstype = LLVMTypeOf(lhs);
 	LLVMTypeRef rhstype = LLVMTypeOf(rhs);
-	LLVMTypeKind lhskind = LLVMGetTypeKind(lhstype);
-	LLVMTypeKind rhskind = LLVMGetTypeKind(rhstype);
-
-	int lhsIsVec = (lhskind == LLVMVectorTypeKind);
-	int rhsIsVec = (rhskind == LLVMVectorTypeKind);
 
-	if (lhsIsVec)
+	/* A scalar Boolean selects the whole vector, everything else is applied to each lane */
+	if (lhstype != booltype && rhstype != booltype)
 	{
-		if (rhsIsVec)
-		{
-			if (LLVMGetVectorSize(lhstype) != LLVMGetVectorSize(rhstype))
-				return logError("No multiplication available for vectors of different size.", 0x2531);
-			lhstype = LLVMGetElementType(lhstype);
-			lhskind = LLVMGetTypeKind(lhstype);
-			rhstype = LLVMGetElementType(rhstype);
-			rhskind = LLVMGetTypeKind(rhstype);
-		}
-		else if (rhstype != booltype)
-			return logError("No multiplication available for vector and scalar.", 0x2532);
+		broadcastScalar(&lhs, &rhs);
+		if (!sameShape(lhs, rhs))
+			return logError("No multiplication available for vectors of different size.", 0x2531);
+		lhstype = LLVMTypeOf(lhs);
+		rhstype = LLVMTypeOf(rhs);
 	}
+	else if (LLVMGetTypeKind(lhstype) == LLVMVectorTypeKind && LLVMGetTypeKind(rhstype) == LLVMVectorTypeKind
+			&& LLVMGetVectorSize(lhstype) != LLVMGetVectorSize(rhstype))
+		return logError("No multiplication available for vectors of different size.", 0x2531);
+	lhstype = scalarType(lhstype);
+	rhstype = scalarType(rhstype);
 
+	/* A Boolean keeps or zeroes the other operand, a Boolean vector does so for each lane */
 	if (lhstype == booltype)
 	{
 		if (rhstype == booltype)
 			return LLVMBuildAnd(phi_builder, lhs, rhs, "andtmp");
-		else if (lhsIsVec)
-			return logError("Using Boolean Vectors as Conditional is currently unsupported.", 0x2533);
-		LLVMValueRef null = LLVMConstNull(rhstype);
-		return LLVMBuildSelect(phi_builder, lhs, rhs, null, "boolSelect");
+		LLVMValueRef null = LLVMConstNull(LLVMTypeOf(rhs));
+		LLVMValueRef result = LLVMBuildSelect(phi_builder, lhs, rhs, null, "boolSelect");
+		return isUnsigned(rhs) ? markUnsigned(result) : result;
 	}
 	else if (rhstype == booltype)
 	{
-		if (rhsIsVec)
-			return logError("Using Boolean Vectors as Conditional is currently unsupported.", 0x2534);
-		LLVMValueRef null = LLVMConstNull(lhstype);
-		return LLVMBuildSelect(phi_builder, rhs, lhs, null, "boolselect");
+		LLVMValueRef null = LLVMConstNull(LLVMTypeOf(lhs));
+		LLVMValueRef result = LLVMBuildSelect(phi_builder, rhs, lhs, null, "boolselect");
+		return isUnsigned(lhs) ? markUnsigned(result) : result;
 	}
-	else if (lhskind == LLVMDoubleTypeKind)
-	{
-		if (rhskind == LLVMIntegerTypeKind)
-			rhs = LLVMBuildSIToFP(phi_builder, rhs, LLVMTypeOf(lhs), "sitofp");
+	int isUnsignedResult;
+	if (!promoteOperands(&lhs, &rhs, &isUnsignedResult))
+		return logError("Incompatible Types for binary '*'.", 0x2536);
+	if (isFloatingType(LLVMTypeOf(lhs)))
 		return LLVMBuildFMul(phi_builder, lhs, rhs, "fmultmp");
-	}
-	else if (lhskind == LLVMIntegerTypeKind)
-	{
-		if (rhskind == LLVMDoubleTypeKind)
-		{
-			lhs = LLVMBuildSIToFP(phi_builder, lhs, LLVMTypeOf(rhs), "sitofp");
-			return LLVMBuildFMul(phi_builder, lhs, rhs, "fmultmp");
-		}
-		return LLVMBuildMul(phi_builder, lhs, rhs, "smultmp");
-	}
-	return logError("Incompatible Types for binary '*'.", 0x2536);
+	return finishInteger(LLVMBuildMul(phi_builder, lhs, rhs, "multmp"), isUnsignedResult);
 }
 
 LLVMValueRef buildAppropriateDivision (LLVMValueRef lhs, LLVMValueRef rhs)
 {
-	LLVMTypeRef lhstype = LLVMTypeOf(lhs);
-	LLVMTypeRef rhstype = LLVMTypeOf(rhs);
-	LLVMTypeKind lhskind = LLVMGetTypeKind(lhstype);
-	LLVMTypeKind rhskind = LLVMGetTypeKind(rhstype);
-
+	broadcastScalar(&lhs, &rhs);
 	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
-	if (lhstype == booltype)
+	if (scalarType(LLVMTypeOf(lhs)) == booltype)
 		return logError("Cannot divide Boolean.", 0x2541);
-	if (lhstype == booltype)
+	if (scalarType(LLVMTypeOf(rhs)) == booltype)
 		return logError("Cannot divide by Boolean.", 0x2542);
+	if (!sameShape(lhs, rhs))
+		return logError("No division available for vectors of different size.", 0x2543);
 
-	/* For Vector Types, check the element types */
-	if (lhskind == LLVMVectorTypeKind)
-	{
-		if (rhskind != LLVMVectorTypeKind)
-			return logError("No division available for vector and scalar.", 0x2543);
-		unsigned lhssize = LLVMGetVectorSize(lhstype);
-		unsigned rhssize = LLVMGetVectorSize(rhstype);
-		if (rhssize != lhssize)
-			return logError("No addition available for vectors of different size.", 0x2545);
-		lhstype = LLVMGetElementType(lhstype);
-		lhskind = LLVMGetTypeKind(lhstype);
-		rhstype = LLVMGetElementType(rhstype);
-		rhskind = LLVMGetTypeKind(rhstype);
-	}
-	else if (rhskind == LLVMVectorTypeKind)
-		/* This part executes if rhs is a vector, but lhs is not. */
-		return logError("No division available for scalar and vector.", 0x2544);
-
-	if (lhskind == LLVMDoubleTypeKind)
-	{
-		if (rhskind == LLVMIntegerTypeKind)
-			rhs = LLVMBuildSIToFP(phi_builder, rhs, LLVMTypeOf(lhs), "sitofp");
+	int isUnsignedResult;
+	if (!promoteOperands(&lhs, &rhs, &isUnsignedResult))
+		return logError("Incompatible types for binary '/'.", 0x2545);
+	if (isFloatingType(LLVMTypeOf(lhs)))
 		return LLVMBuildFDiv(phi_builder, lhs, rhs, "fdivtmp");
-	}
-	else if (lhskind == LLVMIntegerTypeKind)
-	{
-		if (rhskind == LLVMDoubleTypeKind)
-		{
-			lhs = LLVMBuildSIToFP(phi_builder, lhs, LLVMTypeOf(rhs), "sitofp");
-			return LLVMBuildFDiv(phi_builder, lhs, rhs, "fdivtmp");
-		}
-		return LLVMBuildSDiv(phi_builder, lhs, rhs, "sdivtmp");
-	}
-	return logError("Incompatible types for binary '/'.", 0x2545);
+	if (isUnsignedResult)
+		return markUnsigned(LLVMBuildUDiv(phi_builder, lhs, rhs, "udivtmp"));
+	return LLVMBuildSDiv(phi_builder, lhs, rhs, "sdivtmp");
 }
 
 LLVMValueRef buildAppropriateComparison (LLVMValueRef lhs, LLVMValueRef rhs)
 {
+	broadcastScalar(&lhs, &rhs);
 	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
-	LLVMTypeRef lhstype = LLVMTypeOf(lhs);
-	LLVMTypeRef rhstype = LLVMTypeOf(rhs);
-	LLVMTypeKind lhskind = LLVMGetTypeKind(lhstype);
-	LLVMTypeKind rhskind = LLVMGetTypeKind(rhstype);
+	if (!sameShape(lhs, rhs))
+		return logError("Cannot compare vectors of different size.", 0x2554);
+	LLVMTypeRef lhstype = scalarType(LLVMTypeOf(lhs));
+	LLVMTypeRef rhstype = scalarType(LLVMTypeOf(rhs));
 
 	if (lhstype == booltype)
 	{
@@ -232,116 +363,110 @@ LLVMValueRef buildAppropriateComparison (LLVMValueRef lhs, LLVMValueRef rhs)
 	}
 	else if (rhstype == booltype)
 		return logError("Cannot compare other type and Boolean.", 0x2552);
-	else if (lhskind == LLVMDoubleTypeKind)
-	{
-		if (rhskind == LLVMIntegerTypeKind)
-			rhs = LLVMBuildSIToFP(phi_builder, rhs, LLVMTypeOf(lhs), "sitofp");
+	int isUnsignedResult;
+	if (!promoteOperands(&lhs, &rhs, &isUnsignedResult))
+		return logError("Incompatible types for binary '<'.", 0x2553);
+	if (isFloatingType(LLVMTypeOf(lhs)))
 		return LLVMBuildFCmp(phi_builder, LLVMRealOLT, lhs, rhs, "lttmp");
-	}
-	else if (lhskind == LLVMIntegerTypeKind)
-	{
-		if (rhskind == LLVMDoubleTypeKind)
-		{
-			lhs = LLVMBuildSIToFP(phi_builder, lhs, LLVMTypeOf(rhs), "sitofp");
-			return LLVMBuildFCmp(phi_builder, LLVMRealOLT, lhs, rhs, "lttmp");
-		}
-		return LLVMBuildICmp(phi_builder, LLVMIntSLT, lhs, rhs, "lttmp");
-	}
-	return logError("Incompatible types for binary '<'.", 0x2553);
+	return LLVMBuildICmp(phi_builder, isUnsignedResult ? LLVMIntULT : LLVMIntSLT, lhs, rhs, "lttmp");
 }
 
 LLVMValueRef buildAppropriateEquality (LLVMValueRef lhs, LLVMValueRef rhs)
 {
-	LLVMTypeRef lhstype = LLVMTypeOf(lhs);
-	LLVMTypeRef rhstype = LLVMTypeOf(rhs);
-	LLVMTypeKind lhskind = LLVMGetTypeKind(lhstype);
-	LLVMTypeKind rhskind = LLVMGetTypeKind(rhstype);
-
-	if (lhskind == LLVMVectorTypeKind)
-	{
-		if (rhskind != LLVMVectorTypeKind)
-			return logError("No Equality available between scalar and Vector.", 0x2561);
-		if (LLVMGetVectorSize(lhstype) != LLVMGetVectorSize(rhstype))
-			return logError("No Equality available between vectors of different size.", 0x2563);
-		lhstype = LLVMGetElementType(lhstype);
-		lhskind = LLVMGetTypeKind(lhstype);
-		rhstype = LLVMGetElementType(rhstype);
-		rhskind = LLVMGetTypeKind(rhstype);
-	}
-	else if (rhskind == LLVMVectorTypeKind)
-		return logError("No Equality available between vector and scalar.", 0x2562);
+	broadcastScalar(&lhs, &rhs);
+	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
+	if (!sameShape(lhs, rhs))
+		return logError("No Equality available between vectors of different size.", 0x2563);
 
-	if (lhskind == LLVMDoubleTypeKind)
-	{
-		if (rhskind == LLVMIntegerTypeKind)
-			rhs = LLVMBuildSIToFP(phi_builder, rhs, LLVMTypeOf(lhs), "sitofp");
-		return LLVMBuildFCmp(phi_builder, LLVMRealOEQ, lhs, rhs, "feqtmp");
-	}
-	else if (lhskind == LLVMIntegerTypeKind)
-	{
-		if (rhskind == LLVMDoubleTypeKind)
-		{
-			lhs = LLVMBuildSIToFP(phi_builder, lhs, LLVMTypeOf(rhs), "sitofp");
-			return LLVMBuildFCmp(phi_builder, LLVMRealOEQ, lhs, rhs, "feqtmp");
-		}
+	if (scalarType(LLVMTypeOf(lhs)) == booltype && scalarType(LLVMTypeOf(rhs)) == booltype)
 		return LLVMBuildICmp(phi_builder, LLVMIntEQ, lhs, rhs, "seqtmp");
-	}
-	return logError("Incompatible types for binary '='.", 0x2564);
+	int isUnsignedResult;
+	if (!promoteOperands(&lhs, &rhs, &isUnsignedResult))
+		return logError("Incompatible types for binary '='.", 0x2564);
+	if (isFloatingType(LLVMTypeOf(lhs)))
+		return LLVMBuildFCmp(phi_builder, LLVMRealOEQ, lhs, rhs, "feqtmp");
+	return LLVMBuildICmp(phi_builder, LLVMIntEQ, lhs, rhs, "seqtmp");
 }
 
 LLVMValueRef buildAppropriateModulo (LLVMValueRef lhs, LLVMValueRef rhs)
 {
+	broadcastScalar(&lhs, &rhs);
 	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
-	LLVMTypeRef lhstype = LLVMTypeOf(lhs);
-	LLVMTypeRef rhstype = LLVMTypeOf(rhs);
-	LLVMTypeKind lhskind = LLVMGetTypeKind(lhstype);
-	LLVMTypeKind rhskind = LLVMGetTypeKind(rhstype);
-
-	LLVMValueRef zero = LLVMConstNull(rhstype);
 	LLVMValueRef naive;
 
 	/* Booleans are not supported for Modulo */
-	if (lhstype == booltype)
+	if (scalarType(LLVMTypeOf(lhs)) == booltype)
 		return logError("No Modulo available for Boolean and other type.", 0x2571);
-	if (rhstype == booltype)
+	if (scalarType(LLVMTypeOf(rhs)) == booltype)
 		return logError("No Modulo available for other type and Boolean.", 0x2572);
+	if (!sameShape(lhs, rhs))
+		return logError("No modulo available for vectors of different size.", 0x2575);
 
-	/* For Vector Types, check the element types */
-	if (lhskind == LLVMVectorTypeKind)
-	{
-		if (rhskind != LLVMVectorTypeKind)
-			return logError("No Modulo available for vector and scalar.", 0x2573);
-		unsigned lhssize = LLVMGetVectorSize(lhstype);
-		unsigned rhssize = LLVMGetVectorSize(rhstype);
-		if (rhssize != lhssize)
-			return logError("No modulo available for vectors of different size.", 0x2575);
-		lhstype = LLVMGetElementType(lhstype);
-		lhskind = LLVMGetTypeKind(lhstype);
-		rhstype = LLVMGetElementType(rhstype);
-		rhskind = LLVMGetTypeKind(rhstype);
-	}
-	else if (rhskind == LLVMVectorTypeKind)
-		return logError("No modulo available for scalar and vector.", 0x2574);
-
-	if (lhskind == LLVMDoubleTypeKind)
-	{
-		if (rhskind == LLVMIntegerTypeKind)
-			rhs = LLVMBuildSIToFP(phi_builder, rhs, LLVMTypeOf(lhs), "sitofp");
+	int isUnsignedResult;
+	if (!promoteOperands(&lhs, &rhs, &isUnsignedResult))
+		return logError("Incompatible types for binary '%'.", 0x2576);
+	if (isFloatingType(LLVMTypeOf(lhs)))
 		naive = LLVMBuildFRem(phi_builder, lhs, rhs, "naiveFRem");
-	}
-	else if (lhskind == LLVMIntegerTypeKind)
+	else if (isUnsignedResult)
+		naive = markUnsigned(LLVMBuildURem(phi_builder, lhs, rhs, "naiveURem"));
+	else
+		naive = LLVMBuildSRem(phi_builder, lhs, rhs, "naiveSRem");
+
+	LLVMValueRef isZero = buildAppropriateEquality(rhs, LLVMConstNull(LLVMTypeOf(rhs)));
+	return finishInteger(LLVMBuildSelect(phi_builder, isZero, lhs, naive, "remSelect"), isUnsignedResult);
+}
+
+LLVMValueRef buildAppropriateLogic (int op, LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	broadcastScalar(&lhs, &rhs);
+	int isUnsignedResult = 0;
+	if (LLVMTypeOf(lhs) != LLVMTypeOf(rhs) && !isFloatingType(LLVMTypeOf(lhs)) && !isFloatingType(LLVMTypeOf(rhs))
+			&& sameShape(lhs, rhs))
+		promoteOperands(&lhs, &rhs, &isUnsignedResult);
+	else
+		isUnsignedResult = isUnsigned(lhs) || isUnsigned(rhs);
+	LLVMTypeRef lhstype = LLVMTypeOf(lhs);
+	LLVMTypeRef rhstype = LLVMTypeOf(rhs);
+	if (lhstype != rhstype)
+		return logError("Logical operators need two operands of the same type.", 0x2581);
+	if (LLVMGetTypeKind(scalarType(lhstype)) != LLVMIntegerTypeKind)
+		return logError("Logical operators are only available for Bool and Int.", 0x2582);
+
+	switch (op)
 	{
-		if (rhskind == LLVMDoubleTypeKind)
-		{
-			lhs = LLVMBuildSIToFP(phi_builder, lhs, LLVMTypeOf(rhs), "sitofp");
-			naive = LLVMBuildFRem(phi_builder, lhs, rhs, "naiveFRem");
-		}
-		else
-			naive = LLVMBuildSRem(phi_builder, lhs, rhs, "naiveSRem");
+		case '&':
+			return finishInteger(LLVMBuildAnd(phi_builder, lhs, rhs, "andtmp"), isUnsignedResult);
+		case '|':
+			return finishInteger(LLVMBuildOr(phi_builder, lhs, rhs, "ortmp"), isUnsignedResult);
+		case '^':
+			return finishInteger(LLVMBuildXor(phi_builder, lhs, rhs, "xortmp"), isUnsignedResult);
 	}
-	else
-		return logError("Incompatible types for binary '%'.", 0x2576);
+	return logError("Unknown logical operator.", 0x2583);
+}
 
-	LLVMValueRef isZero = buildAppropriateEquality(rhs, zero);
-	return LLVMBuildSelect(phi_builder, isZero, lhs, naive, "remSelect");
+LLVMValueRef buildAppropriateNot (LLVMValueRef val)
+{
+	LLVMTypeRef type = LLVMTypeOf(val);
+	if (LLVMGetTypeKind(scalarType(type)) != LLVMIntegerTypeKind)
+		return logError("Logical operators are only available for Bool and Int.", 0x2584);
+	return finishInteger(LLVMBuildNot(phi_builder, val, "nottmp"), isUnsigned(val));
+}
+
+/* Shift the bits of lhs by rhs to the left ('<') or right ('>'). Right shifts of signed integers keep the sign. */
+LLVMValueRef buildAppropriateShift (int op, LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	broadcastScalar(&lhs, &rhs);
+	LLVMTypeRef lhstype = LLVMTypeOf(lhs);
+	if (!isNumericType(lhstype) || isFloatingType(lhstype) || !isNumericType(LLVMTypeOf(rhs))
+			|| isFloatingType(LLVMTypeOf(rhs)))
+		return logError("Shifts are only available for integers.", 0x2585);
+	if (!sameShape(lhs, rhs))
+		return logError("No shift available for vectors of different size.", 0x2586);
+	int lhsUnsigned = isUnsigned(lhs);
+	rhs = LLVMBuildIntCast2(phi_builder, rhs, lhstype, 0, "shiftamount");
+	if (op == '<')
+		return finishInteger(LLVMBuildShl(phi_builder, lhs, rhs, "shltmp"), lhsUnsigned);
+	if (lhsUnsigned)
+		return markUnsigned(LLVMBuildLShr(phi_builder, lhs, rhs, "lshrtmp"));
+	return LLVMBuildAShr(phi_builder, lhs, rhs, "ashrtmp");
 }
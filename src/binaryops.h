@@ -1,6 +1,12 @@
 #ifndef BINARYOPS_H_
 #define BINARYOPS_H_
 
+LLVMValueRef buildSplat (LLVMValueRef scalar, unsigned size);
+int isFloatingType (LLVMTypeRef type);
+LLVMValueRef buildConversion (LLVMValueRef val, LLVMTypeRef type, int toUnsigned);
+LLVMValueRef adaptConstant (LLVMValueRef val, LLVMTypeRef type);
+int promoteArguments (LLVMValueRef *args, unsigned numArgs, int *isUnsignedResult);
+
 LLVMValueRef buildAppropriateAddition (LLVMValueRef lhs, LLVMValueRef rhs);
 LLVMValueRef buildAppropriateSubtraction (LLVMValueRef lhs, LLVMValueRef rhs);
 LLVMValueRef buildAppropriateMultiplication (LLVMValueRef lhs, LLVMValueRef rhs);
@@ -8,5 +14,8 @@ LLVMValueRef buildAppropriateDivision (LLVMValueRef lhs, LLVMValueRef rhs);
 LLVMValueRef buildAppropriateComparison (LLVMValueRef lhs, LLVMValueRef rhs);
 LLVMValueRef buildAppropriateEquality (LLVMValueRef lhs, LLVMValueRef rhs);
 LLVMValueRef buildAppropriateModulo (LLVMValueRef lhs, LLVMValueRef rhs);
+LLVMValueRef buildAppropriateLogic (int op, LLVMValueRef lhs, LLVMValueRef rhs);
+LLVMValueRef buildAppropriateNot (LLVMValueRef val);
+LLVMValueRef buildAppropriateShift (int op, LLVMValueRef lhs, LLVMValueRef rhs);
 
 #endif /* BINARYOPS_H_ */
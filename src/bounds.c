@@ -0,0 +1,386 @@
+#include <stdlib.h>
+#include <llvm-c/Core.h>
+#include "stack.h"
+#include "ast.h"
+#include "codegen.h"
+#include "binaryops.h"
+#include "bounds.h"
+
+extern LLVMContextRef phi_context;
+extern LLVMBuilderRef phi_builder;
+
+/* Indexes into arrays, vectors and slices are checked at run time, if enabled by --bounds-check */
+static int checking = 0;
+
+/* A counted loop, whose body is being built */
+typedef struct CountedLoop {
+	LLVMValueRef var;
+	LLVMValueRef start, end, step;
+	LLVMIntPredicate pred;
+	/* Block between the guard and the body, where the indexes of all iterations are checked at once */
+	LLVMBasicBlockRef checkBlock;
+	/* Number of branches and loops around the body. Only accesses at the same depth run in every iteration. */
+	unsigned depth;
+	/* A generator, which yields in the body, need not be resumed for the remaining iterations */
+	int suspends;
+	/* Checks in the body, which a check in checkBlock can replace, the last one first */
+	stack *hoisted;
+} CountedLoop;
+
+typedef struct HoistedCheck {
+	/* The branch of the check in the body */
+	LLVMValueRef branch;
+	/* The check of the first and the last index in checkBlock, with the index and length reported if it fails */
+	LLVMValueRef inBounds;
+	LLVMValueRef index;
+	LLVMValueRef length;
+	/* The slice, whose length is read in checkBlock, or NULL for a constant length */
+	LLVMValueRef slice;
+} HoistedCheck;
+
+/* The counted loops around the code being built, the innermost first */
+static stack *loops = NULL;
+static unsigned branchDepth = 0;
+
+void setBoundsCheck (int enabled)
+{
+	checking = enabled;
+}
+
+int boundsChecking ()
+{
+	return checking;
+}
+
+void enterBranch ()
+{
+	branchDepth++;
+}
+
+void leaveBranch ()
+{
+	branchDepth--;
+}
+
+void enterCountedLoop (LLVMValueRef var, LLVMValueRef bounds[3], LLVMIntPredicate pred, LLVMBasicBlockRef checkBlock)
+{
+	branchDepth++;
+	if (!checking)
+		return;
+	CountedLoop *loop = malloc(sizeof(CountedLoop));
+	if (loop == NULL)
+	{
+		logError("Could not allocate Memory.", 0x305);
+		return;
+	}
+	loop->var = var;
+	loop->start = bounds[0];
+	loop->end = bounds[1];
+	loop->step = bounds[2];
+	loop->pred = pred;
+	loop->checkBlock = checkBlock;
+	loop->depth = branchDepth;
+	loop->suspends = 0;
+	loop->hoisted = NULL;
+	loops = push(loop, 0, loops);
+}
+
+void markSuspension ()
+{
+	for (stack *runner = loops; runner != NULL; runner = runner->next)
+		((CountedLoop*)runner->item)->suspends = 1;
+}
+
+static long long boundValue (CountedLoop *loop, LLVMValueRef bound)
+{
+	if (loop->pred == LLVMIntULT || loop->pred == LLVMIntUGT)
+		return LLVMConstIntGetZExtValue(bound);
+	return LLVMConstIntGetSExtValue(bound);
+}
+
+static CountedLoop* findLoop (LLVMValueRef var)
+{
+	for (stack *runner = loops; runner != NULL; runner = runner->next)
+		if (((CountedLoop*)runner->item)->var == var)
+			return runner->item;
+	return NULL;
+}
+
+/* The counted loop, whose induction variable plus a constant offset is the value, or NULL */
+static CountedLoop* inductionLoop (LLVMValueRef val, long long *offset)
+{
+	*offset = 0;
+	while (LLVMIsAInstruction(val))
+	{
+		LLVMOpcode op = LLVMGetInstructionOpcode(val);
+		if (op != LLVMAdd && op != LLVMSub)
+			break;
+		LLVMValueRef c = LLVMIsAConstantInt(LLVMGetOperand(val, 1));
+		if (c != NULL)
+		{
+			*offset += op == LLVMAdd ? LLVMConstIntGetSExtValue(c) : -LLVMConstIntGetSExtValue(c);
+			val = LLVMGetOperand(val, 0);
+		}
+		else if (op == LLVMAdd && (c = LLVMIsAConstantInt(LLVMGetOperand(val, 0))) != NULL)
+		{
+			*offset += LLVMConstIntGetSExtValue(c);
+			val = LLVMGetOperand(val, 1);
+		}
+		else
+			break;
+	}
+	return findLoop(val);
+}
+
+/* The range [lo, hi] of an integer, as far as it is known at compile time */
+static int valueRange (LLVMValueRef val, long long *lo, long long *hi)
+{
+	LLVMValueRef c = LLVMIsAConstantInt(val);
+	if (c != NULL)
+	{
+		*lo = *hi = isUnsigned(val) ? (long long)LLVMConstIntGetZExtValue(c) : LLVMConstIntGetSExtValue(c);
+		return 1;
+	}
+	if (!LLVMIsAInstruction(val))
+		return 0;
+	/* The induction variable of a loop with constant bounds stays between them */
+	CountedLoop *loop = findLoop(val);
+	if (loop != NULL)
+	{
+		LLVMValueRef start = LLVMIsAConstantInt(loop->start), end = LLVMIsAConstantInt(loop->end);
+		LLVMValueRef step = LLVMIsAConstantInt(loop->step);
+		if (start == NULL || end == NULL || step == NULL)
+			return 0;
+		int upwards = LLVMConstIntGetSExtValue(step) > 0;
+		*lo = upwards ? boundValue(loop, start) : boundValue(loop, end) + 1;
+		*hi = upwards ? boundValue(loop, end) - 1 : boundValue(loop, start);
+		return 1;
+	}
+	LLVMOpcode op = LLVMGetInstructionOpcode(val);
+	if (op == LLVMSExt || op == LLVMZExt || op == LLVMFreeze)
+		return valueRange(LLVMGetOperand(val, 0), lo, hi) && (op != LLVMZExt || *lo >= 0);
+	if (op != LLVMAdd && op != LLVMSub && op != LLVMURem && op != LLVMSRem && op != LLVMAnd)
+		return 0;
+	c = LLVMIsAConstantInt(LLVMGetOperand(val, 1));
+	if (c == NULL || LLVMConstIntGetSExtValue(c) < 0)
+		return 0;
+	long long value = LLVMConstIntGetSExtValue(c);
+	switch (op)
+	{
+		case LLVMURem:
+		case LLVMSRem:
+			if (value == 0)
+				return 0;
+			*lo = (op == LLVMSRem && (!valueRange(LLVMGetOperand(val, 0), lo, hi) || *lo < 0)) ? 1 - value : 0;
+			*hi = value - 1;
+			return 1;
+		case LLVMAnd:
+			*lo = 0;
+			*hi = value;
+			return 1;
+		default:
+			break;
+	}
+	if (!valueRange(LLVMGetOperand(val, 0), lo, hi))
+		return 0;
+	*lo += op == LLVMAdd ? value : -value;
+	*hi += op == LLVMAdd ? value : -value;
+	/* The sum must not wrap around */
+	unsigned width = LLVMGetIntTypeWidth(LLVMTypeOf(val));
+	long long limit = width < 64 ? 1LL << (width - 1) : 0;
+	return width >= 64 || (*lo >= -limit && *hi < limit);
+}
+
+/* Report the index out of bounds and abort. For a vector of indices, the first lane out of bounds is reported. */
+static LLVMBasicBlockRef buildFailure (LLVMValueRef index, LLVMValueRef inBounds, LLVMValueRef length)
+{
+	LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(phi_builder));
+	LLVMBasicBlockRef FailBlock = LLVMAppendBasicBlockInContext(phi_context, fn, "OutOfBounds");
+	LLVMPositionBuilderAtEnd(phi_builder, FailBlock);
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	if (LLVMGetTypeKind(LLVMTypeOf(index)) == LLVMVectorTypeKind)
+	{
+		LLVMTypeRef maskType = LLVMIntTypeInContext(phi_context, LLVMGetVectorSize(LLVMTypeOf(index)));
+		LLVMValueRef outside = LLVMBuildNot(phi_builder, inBounds, "outside");
+		LLVMValueRef args[2] = {LLVMBuildBitCast(phi_builder, outside, maskType, "outside"),
+				LLVMConstInt(LLVMInt1TypeInContext(phi_context), 0, 0)};
+		LLVMValueRef lane = callIntrinsic("llvm.cttz", &maskType, 1, args, 2, "lane");
+		index = LLVMBuildExtractElement(phi_builder, index, lane, "index");
+	}
+	LLVMTypeRef params[2] = {i64, i64};
+	LLVMValueRef report = getRuntimeFunction("phirt_bounds_error", LLVMVoidTypeInContext(phi_context), params, 2);
+	unsigned noreturn = LLVMGetEnumAttributeKindForName("noreturn", 8);
+	LLVMAddAttributeAtIndex(report, LLVMAttributeFunctionIndex, LLVMCreateEnumAttribute(phi_context, noreturn, 0));
+	LLVMValueRef args[2] = {index, length};
+	LLVMBuildCall(phi_builder, report, args, 2, "");
+	LLVMBuildUnreachable(phi_builder);
+	return FailBlock;
+}
+
+/* Continue in a new block, if the index is in bounds. Returns the branch. */
+static LLVMValueRef buildCheck (LLVMValueRef inBounds, LLVMValueRef index, LLVMValueRef length)
+{
+	LLVMValueRef cond = inBounds;
+	if (LLVMGetTypeKind(LLVMTypeOf(inBounds)) == LLVMVectorTypeKind)
+	{
+		LLVMTypeRef type = LLVMTypeOf(inBounds);
+		cond = callIntrinsic("llvm.vector.reduce.and", &type, 1, &inBounds, 1, "inbounds");
+	}
+	LLVMBasicBlockRef current = LLVMGetInsertBlock(phi_builder);
+	LLVMBasicBlockRef ContBlock = LLVMAppendBasicBlockInContext(phi_context, LLVMGetBasicBlockParent(current), "InBounds");
+	LLVMBasicBlockRef FailBlock = buildFailure(index, inBounds, length);
+	LLVMPositionBuilderAtEnd(phi_builder, current);
+	LLVMValueRef branch = LLVMBuildCondBr(phi_builder, cond, ContBlock, FailBlock);
+	LLVMPositionBuilderAtEnd(phi_builder, ContBlock);
+	return branch;
+}
+
+/* The operands of an element-wise operation must have the same length. Otherwise the first index beyond the
+ * shorter one is reported, whether or not indexes are checked. */
+void checkSameLength (LLVMValueRef length, LLVMValueRef other)
+{
+	if (length == other || (LLVMIsConstant(length) && LLVMIsConstant(other)))
+		return;
+	LLVMValueRef same = LLVMBuildICmp(phi_builder, LLVMIntEQ, length, other, "samelength");
+	LLVMValueRef less = LLVMBuildICmp(phi_builder, LLVMIntULT, length, other, "shorter");
+	LLVMValueRef shorter = LLVMBuildSelect(phi_builder, less, length, other, "shorter");
+	buildCheck(same, shorter, shorter);
+}
+
+/* Check the first and the last index of an access in every iteration of a loop with a step of 1 or -1, before
+ * the loop is entered */
+static HoistedCheck* hoistCheck (CountedLoop *loop, long long offset, LLVMValueRef length, LLVMValueRef slice)
+{
+	HoistedCheck *check = malloc(sizeof(HoistedCheck));
+	if (check == NULL)
+		return logError("Could not allocate Memory.", 0x305);
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	int isSigned = loop->pred == LLVMIntSLT || loop->pred == LLVMIntSGT;
+	LLVMBasicBlockRef current = LLVMGetInsertBlock(phi_builder);
+	LLVMPositionBuilderBefore(phi_builder, LLVMGetBasicBlockTerminator(loop->checkBlock));
+
+	/* The upper bound is exclusive */
+	LLVMValueRef first = LLVMBuildIntCast2(phi_builder, loop->start, i64, isSigned, "first");
+	LLVMValueRef last = LLVMBuildIntCast2(phi_builder, loop->end, i64, isSigned, "last");
+	last = LLVMBuildSub(phi_builder, last, LLVMBuildIntCast2(phi_builder, loop->step, i64, 1, "step"), "last");
+	LLVMValueRef shift = LLVMConstInt(i64, offset, 1);
+	first = LLVMBuildAdd(phi_builder, first, shift, "firstindex");
+	last = LLVMBuildAdd(phi_builder, last, shift, "lastindex");
+	/* A slice is kept as the pointer to its first element and its length */
+	if (slice != NULL)
+		length = LLVMBuildExtractValue(phi_builder, LLVMBuildLoad(phi_builder, slice, LLVMGetValueName(slice)), 1, "slicelength");
+	LLVMValueRef firstInBounds = LLVMBuildICmp(phi_builder, LLVMIntULT, first, length, "inbounds");
+	LLVMValueRef lastInBounds = LLVMBuildICmp(phi_builder, LLVMIntULT, last, length, "inbounds");
+	check->inBounds = LLVMBuildAnd(phi_builder, firstInBounds, lastInBounds, "inbounds");
+	check->index = LLVMBuildSelect(phi_builder, firstInBounds, last, first, "index");
+	check->length = length;
+	check->slice = slice;
+	check->branch = NULL;
+
+	LLVMPositionBuilderAtEnd(phi_builder, current);
+	return check;
+}
+
+/* Every access needs an index within [0, length). Only checks, which cannot be proven at compile time, are built.
+ * An induction variable, which runs through all of its values while the access runs in every iteration, is
+ * checked once before its loop. */
+void checkIndex (LLVMValueRef index, LLVMValueRef length, LLVMValueRef mask, LLVMValueRef slice)
+{
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMTypeRef i1 = LLVMInt1TypeInContext(phi_context);
+	LLVMTypeRef type = LLVMTypeOf(index);
+	if (LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+	{
+		unsigned lanes = LLVMGetVectorSize(type);
+		LLVMValueRef wide = LLVMBuildIntCast2(phi_builder, index, LLVMVectorType(i64, lanes), !isUnsigned(index), "index");
+		LLVMValueRef splat = buildSplat(length, lanes);
+		LLVMValueRef inBounds = LLVMBuildICmp(phi_builder, LLVMIntULT, wide, splat, "inbounds");
+		/* Lanes, which are not selected by the mask, are not accessed */
+		if (mask != NULL)
+			inBounds = LLVMBuildOr(phi_builder, inBounds, LLVMBuildNot(phi_builder, mask, "unselected"), "inbounds");
+		if (inBounds != LLVMConstAllOnes(LLVMVectorType(i1, lanes)))
+			buildCheck(inBounds, wide, length);
+		return;
+	}
+
+	long long lo, hi;
+	if (LLVMIsConstant(length) && valueRange(index, &lo, &hi) && lo >= 0 && hi < LLVMConstIntGetSExtValue(length))
+		return;
+	HoistedCheck *hoisted = NULL;
+	long long offset;
+	CountedLoop *loop = inductionLoop(index, &offset);
+	LLVMValueRef step = loop == NULL ? NULL : LLVMIsAConstantInt(loop->step);
+	if (loop != NULL && loop->checkBlock != NULL && loop->depth == branchDepth && step != NULL
+			&& (LLVMConstIntGetSExtValue(step) == 1 || LLVMConstIntGetSExtValue(step) == -1)
+			&& (slice != NULL || LLVMIsConstant(length)))
+	{
+		hoisted = hoistCheck(loop, offset, length, slice);
+		if (hoisted != NULL && hoisted->inBounds == LLVMConstInt(i1, 1, 0))
+		{
+			free(hoisted);
+			return;
+		}
+	}
+	LLVMValueRef wide = LLVMBuildIntCast2(phi_builder, index, i64, !isUnsigned(index), "index");
+	LLVMValueRef inBounds = LLVMBuildICmp(phi_builder, LLVMIntULT, wide, length, "inbounds");
+	LLVMValueRef branch = buildCheck(inBounds, wide, length);
+	if (hoisted != NULL)
+	{
+		hoisted->branch = branch;
+		loop->hoisted = push(hoisted, 0, loop->hoisted);
+	}
+}
+
+static int isStoredInLoop (LLVMValueRef variable, CountedLoop *loop)
+{
+	for (LLVMBasicBlockRef block = LLVMGetNextBasicBlock(loop->checkBlock); block != NULL; block = LLVMGetNextBasicBlock(block))
+		for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst != NULL; inst = LLVMGetNextInstruction(inst))
+			if (LLVMIsAStoreInst(inst) && LLVMGetOperand(inst, 1) == variable)
+				return 1;
+	return 0;
+}
+
+/* Replace the checks in the body, whose indexes are all checked before the loop */
+void leaveCountedLoop (LLVMValueRef var)
+{
+	branchDepth--;
+	if (loops == NULL || ((CountedLoop*)loops->item)->var != var)
+		return;
+	CountedLoop *loop = pop(&loops);
+	LLVMTypeRef i1 = LLVMInt1TypeInContext(phi_context);
+	LLVMBasicBlockRef current = LLVMGetInsertBlock(phi_builder);
+	LLVMValueRef jump = LLVMGetBasicBlockTerminator(loop->checkBlock);
+	LLVMPositionBuilderBefore(phi_builder, jump);
+	LLVMValueRef inBounds = NULL, index = NULL, length = NULL;
+	while (loop->hoisted != NULL)
+	{
+		HoistedCheck *check = pop(&loop->hoisted);
+		if (!loop->suspends && (check->slice == NULL || !isStoredInLoop(check->slice, loop)))
+		{
+			LLVMSetCondition(check->branch, LLVMConstInt(i1, 1, 0));
+			if (inBounds == NULL)
+			{
+				inBounds = check->inBounds;
+				index = check->index;
+				length = check->length;
+			}
+			else
+			{
+				index = LLVMBuildSelect(phi_builder, check->inBounds, index, check->index, "index");
+				length = LLVMBuildSelect(phi_builder, check->inBounds, length, check->length, "length");
+				inBounds = LLVMBuildAnd(phi_builder, inBounds, check->inBounds, "inbounds");
+			}
+		}
+		free(check);
+	}
+	if (inBounds != NULL)
+	{
+		LLVMBasicBlockRef BodyBlock = LLVMGetSuccessor(jump, 0);
+		LLVMBasicBlockRef FailBlock = buildFailure(index, inBounds, length);
+		LLVMInstructionEraseFromParent(jump);
+		LLVMPositionBuilderAtEnd(phi_builder, loop->checkBlock);
+		LLVMBuildCondBr(phi_builder, inBounds, BodyBlock, FailBlock);
+	}
+	LLVMPositionBuilderAtEnd(phi_builder, current);
+	free(loop);
+}
@@ -0,0 +1,16 @@
+#ifndef BOUNDS_H_
+#define BOUNDS_H_
+
+#include <llvm-c/Core.h>
+
+void setBoundsCheck (int enabled);
+int boundsChecking ();
+void enterCountedLoop (LLVMValueRef var, LLVMValueRef bounds[3], LLVMIntPredicate pred, LLVMBasicBlockRef checkBlock);
+void leaveCountedLoop (LLVMValueRef var);
+void enterBranch ();
+void leaveBranch ();
+void markSuspension ();
+void checkIndex (LLVMValueRef index, LLVMValueRef length, LLVMValueRef mask, LLVMValueRef slice);
+void checkSameLength (LLVMValueRef length, LLVMValueRef other);
+
+#endif /* BOUNDS_H_ */
@@ -1,6 +1,9 @@
 #include <llvm-c/Types.h>
 #include <llvm-c/Core.h>
 #include <llvm-c/Analysis.h>
+#include <llvm-c/DebugInfo.h>
+#include <llvm-c/Target.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -10,6 +13,13 @@
 #include "codegen.h"
 #include "binaryops.h"
 #include "templating.h"
+#include "records.h"
+#include "matrices.h"
+#include "complex.h"
+#include "bounds.h"
+#include "algorithms.h"
+#include "mathfunctions.h"
+#include "parallel.h"
 
 LLVMContextRef phi_context;
 LLVMModuleRef phi_module;
@@ -19,11 +29,78 @@ static stack *valueStack = NULL;
 static stack *namesInScope = NULL;
 static int scope = 0;
 
-LLVMTypeRef getAppropriateType (int typename)
+/* Wider vectors are split by LLVM into so many registers, that they are of no use */
+static const unsigned maxVectorSize = 64;
+
+/* Maximum number of expressions in both branches of an if to lower it to a select */
+static const unsigned selectThreshold = 8;
+
+/* Arrays larger than this many bytes are allocated on the heap, where they cannot overflow the stack */
+static unsigned long long maxStackArray = 65536;
+/* Heap arrays of the function being built, which are released before it returns */
+static stack *heapArrays = NULL;
+/* Variables, values and heap arrays of the functions, whose building was interrupted by a nested function */
+static stack *outerFunctions = NULL;
+
+/* Floating-point optimisations requested on the command line, and those allowed in the function being built */
+static int fpMode = 0;
+int phi_fpFlags = 0;
+
+void setMaxStackArray (unsigned long long bytes)
+{
+	maxStackArray = bytes;
+}
+
+void setFloatingPointMode (int flags)
 {
-	extern LLVMTypeRef templateType;
+	fpMode = flags;
+}
+
+int phi_vectorLibrary = veclib_none;
+
+void setVectorLibrary (int library)
+{
+	phi_vectorLibrary = library;
+}
+
+void setFloatingPointAttributes (LLVMValueRef function)
+{
+	static const struct {
+		int flag;
+		const char *name;
+	} attributes[] = {
+		{fp_reassoc, "unsafe-fp-math"},
+		{fp_nonans, "no-nans-fp-math"},
+		{fp_fast, "no-infs-fp-math"},
+		{fp_fast, "no-signed-zeros-fp-math"}
+	};
+	for (unsigned i = 0; i < sizeof(attributes) / sizeof(attributes[0]); i++)
+	{
+		if ((phi_fpFlags & attributes[i].flag) == 0)
+			continue;
+		const char *name = attributes[i].name;
+		LLVMAttributeRef attr = LLVMCreateStringAttribute(phi_context, name, strlen(name), "true", 4);
+		LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex, attr);
+	}
+}
+
+static int hasTemplateParams (TypeDesc *desc)
+{
+	return desc->base == type_template || desc->vecParam != 0 || desc->arrayParam != 0 || desc->rowParam != 0;
+}
+
+LLVMTypeRef getAppropriateType (TypeDesc *desc)
+{
+	/* Types in a template instance are resolved to the arguments of the template */
+	if (hasTemplateParams(desc))
+	{
+		TypeDesc resolved;
+		if (!resolveTemplateType(desc, &resolved))
+			return NULL;
+		return getAppropriateType(&resolved);
+	}
 	LLVMTypeRef type = NULL;
-	switch (typename & 0xFFF)
+	switch (desc->base)
 	{
 		case type_real:
 			type = LLVMDoubleTypeInContext(phi_context);
@@ -32,39 +109,741 @@ LLVMTypeRef getAppropriateType (int typename)
 			type = LLVMInt1TypeInContext(phi_context);
 			break;
 		case type_int:
+		case type_uint:
 			type = LLVMInt32TypeInContext(phi_context);
 			break;
-		case type_template:
-			type = templateType;
+		case type_float32:
+			type = LLVMFloatTypeInContext(phi_context);
+			break;
+		case type_int64:
+			type = LLVMInt64TypeInContext(phi_context);
+			break;
+		case type_int16:
+			type = LLVMInt16TypeInContext(phi_context);
+			break;
+		case type_int8:
+			type = LLVMInt8TypeInContext(phi_context);
+			break;
+		case type_record:
+			type = recordType(desc->param);
+			if (type == NULL)
+				return NULL;
+			break;
+		case type_complex:
+			if (desc->rows != 0)
+				return logError("Matrices can only be built from numbers.", 0x2D11);
+			type = complexType(desc->vecsize);
+			if (type == NULL)
+				return NULL;
 			break;
 		default:
 			return logError("Unknown Type Name!", 0x2101);
 	}
-	unsigned arraysize = (typename >> 16);
-	unsigned vecsize = (typename >> 12) & 0xF;
-	if (vecsize != 0 && arraysize != 0)
-		return logError("Vector size exceeds internal limit of 15.", 0x2102);
-	else if (vecsize != 0)
-		type = LLVMVectorType(type, vecsize);
-	else if (arraysize != 0)
-		type = LLVMArrayType(type, arraysize);
+	if (desc->rows != 0)
+	{
+		type = matrixType(type, desc->rows, desc->vecsize);
+		if (type == NULL)
+			return NULL;
+	}
+	else if (desc->vecsize != 0 && desc->base != type_complex)
+	{
+		if (desc->vecsize > maxVectorSize)
+			return logError("Vector size must be between 1 and 64.", 0x2102);
+		LLVMTypeKind kind = LLVMGetTypeKind(type);
+		if (kind != LLVMIntegerTypeKind && !isFloatingType(type))
+			return logError("Vectors can only be built from scalar types.", 0x2103);
+		type = LLVMVectorType(type, desc->vecsize);
+	}
+	if (desc->slice)
+	{
+		if (recordLayout(type) == layout_soa)
+			return logError("Records in SoA layout cannot be passed as a slice. Pass their fields instead.", 0x2E09);
+		LLVMTypeRef fields[2] = {LLVMPointerType(type, 0), LLVMInt64TypeInContext(phi_context)};
+		return LLVMStructTypeInContext(phi_context, fields, 2, 0);
+	}
+	if (desc->arraysize != 0)
+		type = recordArrayType(type, desc->arraysize);
 	return type;
 }
 
+/* A slice is kept as a pointer to its first element and the number of elements. Functions take these as two
+ * separate parameters, so pointer parameters always belong to a slice. */
+int isSliceType (LLVMTypeRef type)
+{
+	return LLVMGetTypeKind(type) == LLVMStructTypeKind && LLVMCountStructElementTypes(type) == 2
+			&& LLVMGetTypeKind(LLVMStructGetTypeAtIndex(type, 0)) == LLVMPointerTypeKind;
+}
+
+/* Multiple results are returned as an anonymous struct, while records are named structs */
+static int isMultipleValues (LLVMTypeRef type)
+{
+	return LLVMGetTypeKind(type) == LLVMStructTypeKind && LLVMIsLiteralStruct(type);
+}
+
+static int isSliceParam (LLVMValueRef function, unsigned i)
+{
+	return LLVMGetTypeKind(LLVMTypeOf(LLVMGetParam(function, i))) == LLVMPointerTypeKind;
+}
+
+static unsigned countArguments (LLVMValueRef function)
+{
+	unsigned numParams = LLVMCountParams(function);
+	unsigned numArgs = numParams;
+	for (unsigned i = 0; i < numParams; i++)
+		if (isSliceParam(function, i))
+			numArgs--;
+	return numArgs;
+}
+
+int isUnsignedType (TypeDesc *desc)
+{
+	TypeDesc resolved;
+	if (hasTemplateParams(desc) && resolveTemplateType(desc, &resolved))
+		return resolved.base == type_uint;
+	return desc->base == type_uint;
+}
+
+/* LLVM does not distinguish signed and unsigned integers. Instructions, which produce a UInt or point to one,
+ * carry the metadata phi.unsigned instead. Constants are shared by all their users, so the front end keeps the
+ * constants currently used as UInt in unsignedConstants, and the value stack marks them in misc. Other values are
+ * signed. */
+#define UNSIGNED_VALUE 4
+
+static stack *unsignedConstants = NULL;
+
+static unsigned unsignedKind ()
+{
+	return LLVMGetMDKindIDInContext(phi_context, "phi.unsigned", 12);
+}
+
+static void setUnsignedConstant (LLVMValueRef val, int isUnsignedConstant)
+{
+	stack **link = &unsignedConstants;
+	while (*link != NULL && (*link)->item != val)
+		link = &((*link)->next);
+	if (*link == NULL && isUnsignedConstant)
+		unsignedConstants = push(val, 0, unsignedConstants);
+	else if (*link != NULL && !isUnsignedConstant)
+		pop(link);
+}
+
+int isUnsigned (LLVMValueRef val)
+{
+	if (val == NULL)
+		return 0;
+	if (!LLVMIsAInstruction(val))
+	{
+		for (stack *c = unsignedConstants; c != NULL; c = c->next)
+			if (c->item == val)
+				return 1;
+		return 0;
+	}
+	return LLVMGetMetadata(val, unsignedKind()) != NULL;
+}
+
+LLVMValueRef markUnsigned (LLVMValueRef val)
+{
+	if (val == NULL)
+		return NULL;
+	if (!LLVMIsAInstruction(val))
+		setUnsignedConstant(val, 1);
+	else
+		LLVMSetMetadata(val, unsignedKind(), LLVMMDNodeInContext(phi_context, NULL, 0));
+	return val;
+}
+
+LLVMValueRef markSigned (LLVMValueRef val)
+{
+	if (val != NULL && !LLVMIsAInstruction(val))
+		setUnsignedConstant(val, 0);
+	return val;
+}
+
+static void pushValue (LLVMValueRef val, int role)
+{
+	valueStack = push(val, role | (isUnsigned(val) ? UNSIGNED_VALUE : 0), valueStack);
+}
+
+void clearValues ()
+{
+	clearStack(&valueStack, NULL);
+}
+
+/* A constant taken from the stack is used with the signedness it was pushed with */
+static LLVMValueRef popValue (stack **values)
+{
+	if (*values != NULL && !LLVMIsAInstruction((*values)->item))
+		setUnsignedConstant((*values)->item, (*values)->misc & UNSIGNED_VALUE);
+	return pop(values);
+}
+
+static int valueRole (stack *values)
+{
+	return values->misc & ~UNSIGNED_VALUE;
+}
+
+/* Functions remember which of their results are unsigned in the attribute phi-unsigned, one bit per result */
+static void markUnsignedResults (LLVMValueRef function, unsigned mask)
+{
+	if (mask == 0)
+		return;
+	char value[12];
+	sprintf(value, "%u", mask);
+	LLVMAttributeRef attr = LLVMCreateStringAttribute(phi_context, "phi-unsigned", 12, value, strlen(value));
+	LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex, attr);
+}
+
+static unsigned unsignedResults (LLVMValueRef function)
+{
+	LLVMAttributeRef attr = LLVMGetStringAttributeAtIndex(function, LLVMAttributeFunctionIndex, "phi-unsigned", 12);
+	if (attr == NULL)
+		return 0;
+	unsigned length;
+	return strtoul(LLVMGetStringAttributeValue(attr, &length), NULL, 10);
+}
+
+static void positionAtEntry (LLVMValueRef func)
+{
+	LLVMBasicBlockRef entryBlock = LLVMGetEntryBasicBlock(func);
+	LLVMValueRef firstInstr = LLVMGetFirstInstruction(entryBlock);
+	if (firstInstr == NULL)
+		LLVMPositionBuilderAtEnd(alloca_builder, entryBlock);
+	else
+		LLVMPositionBuilderBefore(alloca_builder, firstInstr);
+}
+
 LLVMValueRef CreateEntryPointAlloca (LLVMValueRef func, LLVMTypeRef varType, const char *name)
 {
-	LLVMBasicBlockRef entryBlock;
 	if (func == NULL)
-		entryBlock = LLVMGetInsertBlock(phi_builder);
-	else
-		entryBlock = LLVMGetEntryBasicBlock(func);
-	if (entryBlock == NULL)
+		func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(phi_builder));
+	if (LLVMCountBasicBlocks(func) == 0)
 		return logError("Attempting to Create Variable in empty function!", 0x2201);
-	LLVMPositionBuilderAtEnd(alloca_builder, entryBlock);
+	/* Keep all allocas at the top of the entry block, so that mem2reg can promote them */
+	positionAtEntry(func);
 	LLVMValueRef alloca = LLVMBuildAlloca(alloca_builder, varType, name);
 	return alloca;
 }
 
+LLVMValueRef lookupVariable (const char *name)
+{
+	size_t len = strlen(name);
+	for (stack *r = namesInScope; r != NULL; r = r->next)
+	{
+		const char *varName = LLVMGetValueName(r->item);
+		if (strncmp(varName, name, len) == 0)
+			return r->item;
+	}
+	return NULL;
+}
+
+/* Variables, loop counters and other named values, the innermost first */
+stack* variablesInScope ()
+{
+	return namesInScope;
+}
+
+void declareVariable (LLVMValueRef variable)
+{
+	namesInScope = push(variable, scope, namesInScope);
+}
+
+/* Variables are pointers to their storage. Any other value in scope is a read-only binding, like a loop counter. */
+int isReadOnly (LLVMValueRef variable)
+{
+	return LLVMGetTypeKind(LLVMTypeOf(variable)) != LLVMPointerTypeKind;
+}
+
+/* Whether a variable is an array or slice of records in AoS layout, whose fields are reached through an element */
+static int hasRecordElements (LLVMValueRef variable)
+{
+	LLVMTypeRef type = LLVMGetElementType(LLVMTypeOf(variable));
+	if (isSliceType(type))
+		type = LLVMStructGetTypeAtIndex(type, 0);
+	else if (LLVMGetTypeKind(type) != LLVMArrayTypeKind)
+		return 0;
+	return isRecordType(LLVMGetElementType(type));
+}
+
+/* Pointer to a field, written as name.field, of a record or of every element of an array in SoA layout */
+static LLVMValueRef fieldStorage (LLVMValueRef variable, const char *field)
+{
+	if (isReadOnly(variable))
+		return logError("Only records have fields.", 0x2E04);
+	if (hasRecordElements(variable))
+		return logError("The fields of an array in AoS layout can only be accessed element by element.", 0x2E06);
+	LLVMTypeRef type = LLVMGetElementType(LLVMTypeOf(variable));
+	if (!isRecordType(type) && soaElementType(type) == NULL)
+		return logError("Only records have fields.", 0x2E04);
+	int isUnsignedField;
+	int index = recordField(type, field, &isUnsignedField);
+	if (index < 0)
+		return logError("Unknown field of a record.", 0x2E05);
+	const char *recordName = LLVMGetValueName(variable);
+	char name[strlen(recordName) + strlen(field) + 2];
+	sprintf(name, "%s.%s", recordName, field);
+	LLVMValueRef ptr = LLVMBuildStructGEP(phi_builder, variable, index, name);
+	return isUnsignedField ? markUnsigned(ptr) : ptr;
+}
+
+static LLVMValueRef codegenOperand (Expr *e)
+{
+	stack *globalValueStack = valueStack;
+	valueStack = NULL;
+	LLVMValueRef val = codegen(e, 1);
+	clearStack(&valueStack, NULL);
+	valueStack = globalValueStack;
+	return val;
+}
+
+LLVMValueRef getRuntimeFunction (const char *name, LLVMTypeRef retType, LLVMTypeRef *params, unsigned count)
+{
+	LLVMValueRef function = LLVMGetNamedFunction(phi_module, name);
+	if (function != NULL)
+		return function;
+	LLVMTypeRef funcType = LLVMFunctionType(retType, params, count, 0);
+	return LLVMAddFunction(phi_module, name, funcType);
+}
+
+/* Variables live on the stack, except for arrays above maxStackArray. These are allocated on the heap when
+ * the function is entered, aligned to at least a cache line. */
+LLVMValueRef CreateVariable (LLVMTypeRef varType, unsigned align, const char *name)
+{
+	LLVMValueRef func = LLVMGetBasicBlockParent(LLVMGetInsertBlock(phi_builder));
+	unsigned long long size = LLVMABISizeOfType(LLVMGetModuleDataLayout(phi_module), varType);
+	int isArray = LLVMGetTypeKind(varType) == LLVMArrayTypeKind || soaElementType(varType) != NULL;
+	if (!isArray || size <= maxStackArray)
+	{
+		LLVMValueRef alloca = CreateEntryPointAlloca(func, varType, name);
+		if (alloca != NULL && align > LLVMGetAlignment(alloca))
+			LLVMSetAlignment(alloca, align);
+		return alloca;
+	}
+	if (align < 64)
+		align = 64;
+	/* aligned_alloc only takes multiples of the alignment */
+	size = (size + align - 1) / align * align;
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMTypeRef i8ptr = LLVMPointerType(LLVMInt8TypeInContext(phi_context), 0);
+	LLVMTypeRef params[2] = {i64, i64};
+	LLVMValueRef allocate = getRuntimeFunction("aligned_alloc", i8ptr, params, 2);
+	LLVMValueRef args[2] = {LLVMConstInt(i64, align, 0), LLVMConstInt(i64, size, 0)};
+	positionAtEntry(func);
+	LLVMValueRef memory = LLVMBuildCall(alloca_builder, allocate, args, 2, "heaparray");
+	unsigned kind = LLVMGetEnumAttributeKindForName("align", 5);
+	LLVMAddCallSiteAttribute(memory, LLVMAttributeReturnIndex, LLVMCreateEnumAttribute(phi_context, kind, align));
+	heapArrays = push(memory, 0, heapArrays);
+	return LLVMBuildBitCast(alloca_builder, memory, LLVMPointerType(varType, 0), name);
+}
+
+/* Move an instruction to the end of the block of the builder */
+static void moveInstruction (LLVMValueRef inst)
+{
+	size_t length;
+	const char *name = LLVMGetValueName2(inst, &length);
+	char copy[length + 1];
+	memcpy(copy, name, length);
+	copy[length] = '\0';
+	LLVMInstructionRemoveFromParent(inst);
+	LLVMInsertIntoBuilderWithName(phi_builder, inst, copy);
+}
+
+/* A failed allocation of a heap array is reported as soon as the function is entered. The allocations move into
+ * a new entry block, which checks them all at once, so that the check never ends up within the body. */
+void checkAllocations (LLVMValueRef function)
+{
+	if (heapArrays == NULL)
+		return;
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMBasicBlockRef BodyBlock = LLVMGetEntryBasicBlock(function);
+	LLVMBasicBlockRef AllocBlock = LLVMInsertBasicBlockInContext(phi_context, BodyBlock, "allocate");
+	LLVMPositionBuilderAtEnd(phi_builder, AllocBlock);
+	/* Allocas have to stay in the entry block to be promoted */
+	LLVMValueRef inst = LLVMGetFirstInstruction(BodyBlock);
+	while (inst != NULL)
+	{
+		LLVMValueRef next = LLVMGetNextInstruction(inst);
+		if (LLVMIsAAllocaInst(inst))
+			moveInstruction(inst);
+		inst = next;
+	}
+	LLVMValueRef failedSize = LLVMConstNull(i64);
+	for (stack *r = heapArrays; r != NULL; r = r->next)
+	{
+		LLVMValueRef memory = r->item;
+		moveInstruction(memory);
+		LLVMValueRef failed = LLVMBuildIsNull(phi_builder, memory, "nomemory");
+		failedSize = LLVMBuildSelect(phi_builder, failed, LLVMGetOperand(memory, 1), failedSize, "failedsize");
+	}
+	LLVMBasicBlockRef FailBlock = LLVMAppendBasicBlockInContext(phi_context, function, "OutOfMemory");
+	LLVMValueRef failed = LLVMBuildICmp(phi_builder, LLVMIntNE, failedSize, LLVMConstNull(i64), "nomemory");
+	LLVMBuildCondBr(phi_builder, failed, FailBlock, BodyBlock);
+
+	LLVMPositionBuilderAtEnd(phi_builder, FailBlock);
+	LLVMValueRef report = getRuntimeFunction("phirt_allocation_error", LLVMVoidTypeInContext(phi_context), &i64, 1);
+	unsigned noreturn = LLVMGetEnumAttributeKindForName("noreturn", 8);
+	LLVMAddAttributeAtIndex(report, LLVMAttributeFunctionIndex, LLVMCreateEnumAttribute(phi_context, noreturn, 0));
+	LLVMBuildCall(phi_builder, report, &failedSize, 1, "");
+	LLVMBuildUnreachable(phi_builder);
+}
+
+void releaseHeapArrays ()
+{
+	LLVMTypeRef i8ptr = LLVMPointerType(LLVMInt8TypeInContext(phi_context), 0);
+	LLVMValueRef release = getRuntimeFunction("free", LLVMVoidTypeInContext(phi_context), &i8ptr, 1);
+	for (stack *r = heapArrays; r != NULL; r = r->next)
+	{
+		LLVMValueRef memory = r->item;
+		LLVMBuildCall(phi_builder, release, &memory, 1, "");
+	}
+}
+
+/* A function built in the middle of another one, like the worker of a parallel loop, starts with none of its
+ * variables, values and heap arrays */
+void enterNestedFunction ()
+{
+	outerFunctions = push(namesInScope, 0, outerFunctions);
+	outerFunctions = push(valueStack, 0, outerFunctions);
+	outerFunctions = push(heapArrays, 0, outerFunctions);
+	namesInScope = NULL;
+	valueStack = NULL;
+	heapArrays = NULL;
+}
+
+void leaveNestedFunction ()
+{
+	clearStack(&namesInScope, NULL);
+	clearStack(&valueStack, NULL);
+	clearStack(&heapArrays, NULL);
+	heapArrays = pop(&outerFunctions);
+	valueStack = pop(&outerFunctions);
+	namesInScope = pop(&outerFunctions);
+}
+
+/* Values with the role 2 are results of a spawned call, which point into the frame of the call until the next sync */
+static int isDeferred (stack *values)
+{
+	return values != NULL && valueRole(values) == 2;
+}
+
+int hasDeferredValues ()
+{
+	for (stack *r = valueStack; r != NULL; r = r->next)
+		if (isDeferred(r))
+			return 1;
+	return 0;
+}
+
+/* Results which are still on the stack become ordinary values */
+void loadDeferredValues ()
+{
+	for (stack *r = valueStack; r != NULL; r = r->next)
+	{
+		if (isDeferred(r))
+		{
+			r->item = LLVMBuildLoad(phi_builder, r->item, "spawnresult");
+			r->misc = 1;
+		}
+	}
+}
+
+/* Operands are taken from the stack together, so that a constant used as UInt by one of them stays one */
+static int popOperands (LLVMValueRef *operands, int count)
+{
+	int isUnsignedOperand[count];
+	for (int i = count-1; i >= 0; i--)
+	{
+		if (isDeferred(valueStack))
+		{
+			logError("Results of a spawned call can only be used after sync.", 0x2A03);
+			return 0;
+		}
+		isUnsignedOperand[i] = valueStack->misc & UNSIGNED_VALUE;
+		operands[i] = popValue(&valueStack);
+	}
+	for (int i = 0; i < count; i++)
+		if (isUnsignedOperand[i])
+			markUnsigned(operands[i]);
+	return 1;
+}
+
+LLVMValueRef callIntrinsic (const char *name, LLVMTypeRef *overloads, unsigned numOverloads,
+		LLVMValueRef *args, unsigned numArgs, const char *resultName)
+{
+	unsigned id = LLVMLookupIntrinsicID(name, strlen(name));
+	LLVMValueRef intrinsic = LLVMGetIntrinsicDeclaration(phi_module, id, overloads, numOverloads);
+	return LLVMBuildCall(phi_builder, intrinsic, args, numArgs, resultName);
+}
+
+/* Whether any identifier or accessed variable in the expression satisfies the predicate */
+int anyName (Expr *e, int (*match) (const char*))
+{
+	if (e == NULL)
+		return 0;
+	switch (e->expr_type)
+	{
+		case expr_ident:
+		{
+			IdentExpr *ie = e->expr;
+			return match(ie->name);
+		}
+		case expr_access:
+		{
+			AccessExpr *ae = e->expr;
+			return match(ae->name) || anyName(ae->idx, match) || anyName(ae->mask, match);
+		}
+		case expr_binop:
+		{
+			BinaryExpr *be = e->expr;
+			return anyName(be->LHS, match) || anyName(be->RHS, match);
+		}
+		case expr_conditional:
+		{
+			CondExpr *ce = e->expr;
+			return anyName(ce->Cond, match) || anyName(ce->True, match) || anyName(ce->False, match);
+		}
+		case expr_loop:
+		{
+			LoopExpr *le = e->expr;
+			return anyName(le->Cond, match) || anyName(le->Body, match) || anyName(le->Else, match);
+		}
+		case expr_for:
+		{
+			ForExpr *fe = e->expr;
+			return anyName(fe->Start, match) || anyName(fe->End, match) || anyName(fe->Step, match)
+				|| anyName(fe->Body, match) || anyName(fe->Else, match);
+		}
+		case expr_foreach:
+		{
+			ForEachExpr *fe = e->expr;
+			return anyName(fe->Source, match) || anyName(fe->Body, match) || anyName(fe->Else, match);
+		}
+		case expr_spawn:
+		{
+			SpawnExpr *se = e->expr;
+			return anyName(se->call, match);
+		}
+		default:
+			return 0;
+	}
+}
+
+/* The variable an array value was loaded from, as long as nothing can have changed it since */
+LLVMValueRef unchangedSource (LLVMValueRef val)
+{
+	if (!LLVMIsALoadInst(val) || LLVMGetInstructionParent(val) != LLVMGetInsertBlock(phi_builder))
+		return NULL;
+	for (LLVMValueRef inst = LLVMGetNextInstruction(val); inst != NULL; inst = LLVMGetNextInstruction(inst))
+		if (LLVMIsAStoreInst(inst) || LLVMIsACallInst(inst))
+			return NULL;
+	return LLVMGetOperand(val, 0);
+}
+
+/* The global of a constant table, which a variable bound to it refers to through a freeze, or NULL */
+LLVMValueRef constantTable (LLVMValueRef variable)
+{
+	if (variable != NULL && LLVMIsAInstruction(variable) && LLVMGetInstructionOpcode(variable) == LLVMFreeze)
+		variable = LLVMGetOperand(variable, 0);
+	if (variable == NULL || !LLVMIsAGlobalVariable(variable) || !LLVMIsGlobalConstant(variable))
+		return NULL;
+	return variable;
+}
+
+/* Element of a constant table at a constant index, read at compile time */
+static LLVMValueRef tableElement (LLVMValueRef table, unsigned index)
+{
+	LLVMValueRef init = LLVMGetInitializer(table);
+	if (LLVMIsAConstantDataSequential(init))
+		return LLVMGetElementAsConstant(init, index);
+	if (LLVMIsAConstantAggregateZero(init))
+		return LLVMConstNull(LLVMGetElementType(LLVMTypeOf(init)));
+	return LLVMGetOperand(init, index);
+}
+
+/* Split an array or slice into the pointer and length passed for a slice parameter. Arrays stored in a
+ * variable are passed without a copy. */
+int sliceArgument (LLVMValueRef val, LLVMTypeRef ptrType, LLVMValueRef *ptr, LLVMValueRef *length)
+{
+	LLVMTypeRef type = LLVMTypeOf(val);
+	if (isSliceType(type) && LLVMStructGetTypeAtIndex(type, 0) == ptrType)
+	{
+		*ptr = LLVMBuildExtractValue(phi_builder, val, 0, "slicebegin");
+		*length = LLVMBuildExtractValue(phi_builder, val, 1, "slicelength");
+		return 1;
+	}
+	if (LLVMGetTypeKind(type) != LLVMArrayTypeKind || LLVMGetElementType(type) != LLVMGetElementType(ptrType))
+	{
+		logError("Only arrays and slices with the same type of elements can be passed as a slice.", 0x2409);
+		return 0;
+	}
+	/* The callee may write to the slice, so constant tables are passed as a copy */
+	LLVMValueRef array = unchangedSource(val);
+	if (array == NULL || constantTable(array) != NULL)
+	{
+		array = CreateVariable(type, 0, "slicetmp");
+		LLVMBuildStore(phi_builder, val, array);
+	}
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMValueRef idxs[2] = {LLVMConstNull(i64), LLVMConstNull(i64)};
+	*ptr = LLVMBuildInBoundsGEP(phi_builder, array, idxs, 2, "slicebegin");
+	*length = LLVMConstInt(i64, LLVMGetArrayLength(type), 0);
+	return 1;
+}
+
+/* Gather all arguments of a call from the value stack */
+static int popArguments (LLVMValueRef function, LLVMValueRef *args)
+{
+	/* Slice parameters are noalias, so no variable or slice may be passed for two of them */
+	unsigned numSlices = 0;
+	LLVMValueRef sliceSources[LLVMCountParams(function) + 1];
+	for (int i = LLVMCountParams(function)-1; i >= 0; i--)
+	{
+		if (isDeferred(valueStack))
+		{
+			logError("Results of a spawned call can only be used after sync.", 0x2A03);
+			return 0;
+		}
+		LLVMValueRef val = popValue(&valueStack);
+		if (val == NULL)
+			return 0;
+		if (i > 0 && isSliceParam(function, i-1))
+		{
+			LLVMValueRef source = unchangedSource(val);
+			if (source == NULL && isSliceType(LLVMTypeOf(val)))
+				source = val;
+			for (unsigned j = 0; source != NULL && constantTable(source) == NULL && j < numSlices; j++)
+				if (sliceSources[j] == source)
+				{
+					logError("The same array cannot be passed for two slice parameters. Pass a copy instead.", 0x240B);
+					return 0;
+				}
+			sliceSources[numSlices++] = source;
+			if (!sliceArgument(val, LLVMTypeOf(LLVMGetParam(function, i-1)), &args[i-1], &args[i]))
+				return 0;
+			i--;
+		}
+		else
+			args[i] = adaptConstant(val, LLVMTypeOf(LLVMGetParam(function, i)));
+	}
+	return 1;
+}
+
+LLVMValueRef codegenCallExpr (LLVMValueRef function)
+{
+	if (countArguments(function) > depth(valueStack))
+		return logError("Insufficient number of arguments given to function!", 0x2404);
+	unsigned numParams = LLVMCountParams(function);
+	LLVMValueRef argValues[numParams];
+	if (!popArguments(function, argValues))
+		return NULL;
+
+	LLVMValueRef result = LLVMBuildCall(phi_builder, function, argValues, numParams, "calltmp");
+	LLVMTypeRef returnType = LLVMTypeOf(result);
+	unsigned unsignedMask = unsignedResults(function);
+	/* If we only returned a single type, push and return that. */
+	if (!isMultipleValues(returnType))
+	{
+		if (unsignedMask & 1)
+			markUnsigned(result);
+		pushValue(result, 1);
+		return result;
+	}
+	unsigned numOfReturnTypes = LLVMCountStructElementTypes(returnType);
+	for (int i = numOfReturnTypes-1; i >= 0; i--)
+	{
+		LLVMValueRef structElement = LLVMBuildExtractValue(phi_builder, result, i, "structelem");
+		if (unsignedMask & (1u << i))
+			markUnsigned(structElement);
+		pushValue(structElement, 1);
+	}
+	return result;
+}
+
+/* Number of parameters passed at run time, i.e. all but the functions */
+static unsigned countValueParams (stack *params)
+{
+	unsigned count = 0;
+	for (; params != NULL; params = params->next)
+		if (((Param*)params->item)->type != NULL)
+			count++;
+	return count;
+}
+
+/* Take the functions passed to a template off the value stack, where they lie among the other arguments */
+static int popFunctionArguments (stack *params, LLVMValueRef *functions, unsigned numFunctions)
+{
+	stack **link = &valueStack;
+	for (; params != NULL && numFunctions > 0; params = params->next)
+	{
+		if (*link == NULL)
+		{
+			logError("Insufficient number of arguments given to function!", 0x2404);
+			return 0;
+		}
+		if (((Param*)params->item)->type != NULL)
+		{
+			link = &(*link)->next;
+			continue;
+		}
+		LLVMValueRef function = (*link)->item;
+		if (isDeferred(*link) || function == NULL || !LLVMIsAFunction(function))
+		{
+			logError("A function parameter must be given a function, written as name:f.", 0x300C);
+			return 0;
+		}
+		functions[--numFunctions] = pop(link);
+	}
+	return 1;
+}
+
+static LLVMValueRef instantiateTemplate (const char *name, stack *args)
+{
+	ProtoExpr *pe = templatePrototype(name);
+	if (pe == NULL)
+		return logError("Unknown template name.", 0x2801);
+	unsigned numFunctions = depth(pe->inArgs) - countValueParams(pe->inArgs);
+	LLVMValueRef functions[numFunctions + 1];
+	if (!popFunctionArguments(pe->inArgs, functions, numFunctions))
+		return NULL;
+	LLVMBasicBlockRef currentInsertBlock = LLVMGetInsertBlock(phi_builder);
+	stack *localValues = valueStack;
+	valueStack = NULL;
+	LLVMValueRef templateFunction = tryGetTemplate(name, args, functions, numFunctions);
+	valueStack = localValues;
+	LLVMPositionBuilderAtEnd(phi_builder, currentInsertBlock);
+	if (templateFunction == NULL)
+		return logError("Unknown template name.", 0x2801);
+	return templateFunction;
+}
+
+/* A record is built from the values of its fields, the last one on top of the stack */
+static LLVMValueRef codegenRecord (unsigned index)
+{
+	LLVMTypeRef type = recordType(index);
+	if (type == NULL)
+		return NULL;
+	unsigned numFields = LLVMCountStructElementTypes(type);
+	if (depth(valueStack) < numFields)
+		return logError("Not enough values given for the fields of the record.", 0x2E0A);
+	LLVMValueRef fields[numFields];
+	for (int i = numFields-1; i >= 0; i--)
+	{
+		if (isDeferred(valueStack))
+			return logError("Results of a spawned call can only be used after sync.", 0x2A03);
+		LLVMTypeRef fieldType = LLVMStructGetTypeAtIndex(type, i);
+		LLVMValueRef value = popValue(&valueStack);
+		if (value == NULL)
+			return NULL;
+		fields[i] = adaptConstant(value, fieldType);
+		if (LLVMTypeOf(fields[i]) != fieldType)
+			return logError("Type mismatch between a value and the field of a record.", 0x2E0B);
+	}
+	LLVMValueRef record = LLVMGetUndef(type);
+	for (unsigned i = 0; i < numFields; i++)
+		record = LLVMBuildInsertValue(phi_builder, record, fields[i], i, recordName(index));
+	pushValue(record, 0);
+	return record;
+}
+
 LLVMValueRef codegenLiteralExpr (LiteralExpr *le)
 {
 	LLVMValueRef val = NULL;
@@ -75,51 +854,401 @@ LLVMValueRef codegenLiteralExpr (LiteralExpr *le)
 			type = LLVMDoubleTypeInContext(phi_context);
 			val = LLVMConstReal(type, le->val.real);
 			break;
+		case lit_float32:
+			type = LLVMFloatTypeInContext(phi_context);
+			val = LLVMConstReal(type, le->val.real);
+			break;
+		case lit_imaginary:
+		{
+			type = LLVMDoubleTypeInContext(phi_context);
+			LLVMValueRef parts[2] = {LLVMConstReal(type, 0.0), LLVMConstReal(type, le->val.real)};
+			val = LLVMConstNamedStruct(complexType(0), parts, 2);
+			break;
+		}
 		case lit_int:
 			type = LLVMInt32TypeInContext(phi_context);
-			val = LLVMConstInt(type, le->val.integral, 1);
+			val = markSigned(LLVMConstInt(type, le->val.integral, 1));
+			break;
+		case lit_int64:
+			type = LLVMInt64TypeInContext(phi_context);
+			val = markSigned(LLVMConstInt(type, le->val.integral, 1));
+			break;
+		case lit_uint:
+			type = LLVMInt32TypeInContext(phi_context);
+			val = markUnsigned(LLVMConstInt(type, le->val.integral, 0));
 			break;
 		case lit_bool:
 			type = LLVMInt1TypeInContext(phi_context);
 			val = LLVMConstInt(type, (le->val.integral)!=0, 0);
 			break;
+		case lit_template:
+		{
+			/* A function parameter calls the function bound to it */
+			LLVMValueRef function = templateFunction(le->val.integral);
+			if (function != NULL)
+				return codegenCallExpr(function);
+			unsigned value;
+			if (!templateValue(le->val.integral, &value))
+				return NULL;
+			type = LLVMInt32TypeInContext(phi_context);
+			val = markSigned(LLVMConstInt(type, value, 0));
+			break;
+		}
+		case lit_function:
+			val = templateFunction(le->val.integral);
+			if (val == NULL)
+				return logError("Only function parameters can be passed on as functions.", 0x300B);
+			break;
+		case lit_record:
+			return codegenRecord(le->val.integral);
 		default:
 			return logError("Unknown literal type.", 0x2301);
 	}
-	valueStack = push(val, 0, valueStack);
+	pushValue(val, 0);
 	return val;
 }
 
-LLVMValueRef codegenCallExpr (LLVMValueRef function)
+/* An array literal becomes a private constant global in read-only data, which is shared by every call. A vector
+ * literal is a constant. */
+static LLVMValueRef codegenTableExpr (TableExpr *te)
+{
+	unsigned count = depth(te->elements);
+	LLVMValueRef elements[count];
+	int allUnsigned = 1, sameType = 1;
+	stack *runner = te->elements;
+	for (int i = count-1; i >= 0; i--, runner = runner->next)
+	{
+		LLVMValueRef val = codegenOperand(runner->item);
+		if (val == NULL)
+			return NULL;
+		allUnsigned = allUnsigned && isUnsigned(val);
+		if (!LLVMIsConstant(val))
+			return logError("The elements of an array or vector literal must be constants.", 0x2302);
+		LLVMTypeRef type = LLVMTypeOf(val);
+		if (LLVMGetTypeKind(type) != LLVMIntegerTypeKind && !isFloatingType(type))
+			return logError("The elements of an array or vector literal must be numbers or Booleans.", 0x2303);
+		elements[i] = val;
+		sameType = sameType && type == LLVMTypeOf(elements[count-1]);
+	}
+	int isUnsignedResult;
+	if (!sameType && !promoteArguments(elements, count, &isUnsignedResult))
+		return NULL;
+	LLVMValueRef table;
+	if (te->isVector)
+	{
+		if (count > maxVectorSize)
+			return logError("Vector size must be between 1 and 64.", 0x2102);
+		table = LLVMConstVector(elements, count);
+	}
+	else
+	{
+		LLVMValueRef init = LLVMConstArray(LLVMTypeOf(elements[0]), elements, count);
+		LLVMValueRef global = LLVMAddGlobal(phi_module, LLVMTypeOf(init), "table");
+		LLVMSetInitializer(global, init);
+		LLVMSetGlobalConstant(global, 1);
+		LLVMSetLinkage(global, LLVMPrivateLinkage);
+		LLVMSetUnnamedAddress(global, LLVMGlobalUnnamedAddr);
+		table = LLVMBuildLoad(phi_builder, global, "table");
+	}
+	if (allUnsigned)
+		table = markUnsigned(table);
+	pushValue(table, 0);
+	return table;
+}
+
+/* a sort, a scan, a minloc, a maxloc, a x search, a lo hi counts histogram */
+static LLVMValueRef codegenAlgorithm (const char *name, unsigned numArgs)
+{
+	if (depth(valueStack) < numArgs)
+	{
+		char msg[strlen(name) + 64];
+		sprintf(msg, "Insufficient number of arguments given to %s!", name);
+		return logError(msg, 0x2C01);
+	}
+	LLVMValueRef values[numArgs];
+	if (!popOperands(values, numArgs))
+		return NULL;
+	LLVMValueRef index = NULL;
+	LLVMValueRef result = buildAlgorithm(name, values, &index);
+	if (result == NULL)
+		return NULL;
+	/* minloc and maxloc push the element and its index like a function with two results */
+	if (index != NULL)
+		pushValue(index, 1);
+	/* Algorithms, which change the array in place, leave nothing on the stack */
+	if (LLVMGetTypeKind(LLVMTypeOf(result)) != LLVMVoidTypeKind)
+		pushValue(result, 1);
+	return result;
+}
+
+static LLVMValueRef codegenReduction (const char *name, unsigned numArgs)
+{
+	if (numArgs > depth(valueStack))
+		return logError("Insufficient number of arguments given to reduction!", 0x2C01);
+	LLVMValueRef args[2];
+	if (!popOperands(args, numArgs))
+		return NULL;
+	LLVMValueRef result = buildLaneReduction(name, args);
+	if (result == NULL)
+		return NULL;
+	pushValue(result, 1);
+	return result;
+}
+
+/* Number of elements of an array, vector or slice as an Int64 */
+static LLVMValueRef codegenLength ()
+{
+	if (valueStack == NULL)
+		return logError("Insufficient number of arguments given to length!", 0x2C01);
+	if (isDeferred(valueStack))
+		return logError("Results of a spawned call can only be used after sync.", 0x2A03);
+	LLVMValueRef val = popValue(&valueStack);
+	LLVMTypeRef type = LLVMTypeOf(val);
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMValueRef result;
+	if (isSliceType(type))
+		result = LLVMBuildExtractValue(phi_builder, val, 1, "length");
+	else if (LLVMGetTypeKind(type) == LLVMArrayTypeKind)
+		result = LLVMConstInt(i64, LLVMGetArrayLength(type), 0);
+	else if (LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+		result = LLVMConstInt(i64, LLVMGetVectorSize(type), 0);
+	else if (soaElementType(type) != NULL)
+		result = LLVMConstInt(i64, LLVMGetArrayLength(LLVMStructGetTypeAtIndex(type, 0)), 0);
+	else if (complexLanes(type) != 0)
+		result = LLVMConstInt(i64, complexLanes(type), 0);
+	else
+		return logError("Only arrays, vectors and slices have a length.", 0x2C0B);
+	pushValue(result, 1);
+	return result;
+}
+
+static LLVMValueRef codegenTranspose ()
+{
+	if (valueStack == NULL)
+		return logError("Insufficient number of arguments given to transpose!", 0x2D18);
+	if (isDeferred(valueStack))
+		return logError("Results of a spawned call can only be used after sync.", 0x2A03);
+	LLVMValueRef result = buildTranspose(popValue(&valueStack));
+	if (result == NULL)
+		return NULL;
+	pushValue(result, 1);
+	return result;
+}
+
+/* Pointer to the first element of a matrix in an array or slice, which is taken from the value stack together with
+ * the offset of that element and the stride between the columns */
+static LLVMValueRef matrixAddress (LLVMTypeRef type, unsigned isStore, LLVMValueRef *stride)
+{
+	if (depth(valueStack) < 3 + isStore)
+		return logError("A matrix is loaded from or saved to an array or slice, an offset and a stride.", 0x2D19);
+	stack *runner = valueStack;
+	for (unsigned i = 0; i < 3 + isStore; i++, runner = runner->next)
+		if (isDeferred(runner))
+			return logError("Results of a spawned call can only be used after sync.", 0x2A03);
+	LLVMValueRef strideVal = popValue(&valueStack);
+	LLVMValueRef offset = popValue(&valueStack);
+	LLVMValueRef array = popValue(&valueStack);
+	if (LLVMGetTypeKind(LLVMTypeOf(offset)) != LLVMIntegerTypeKind
+			|| LLVMGetTypeKind(LLVMTypeOf(strideVal)) != LLVMIntegerTypeKind)
+		return logError("The offset and the stride of a matrix in memory must be integers.", 0x2D1A);
+	if (LLVMIsConstant(strideVal) && LLVMConstIntGetSExtValue(strideVal) < (long long)matrixRows(type))
+		return logError("The stride of a matrix in memory must not be less than its number of rows.", 0x2D1B);
+	/* Saving into a copy of an array would be lost */
+	if (isStore && LLVMGetTypeKind(LLVMTypeOf(array)) == LLVMArrayTypeKind
+			&& (unchangedSource(array) == NULL || constantTable(unchangedSource(array)) != NULL))
+		return logError("Matrices can only be saved to array variables and slices.", 0x2D1C);
+
+	LLVMTypeRef element = LLVMGetElementType(LLVMStructGetTypeAtIndex(type, 0));
+	LLVMValueRef begin, length;
+	if (!sliceArgument(array, LLVMPointerType(element, 0), &begin, &length))
+		return NULL;
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	offset = buildConversion(offset, i64, 0);
+	*stride = buildConversion(strideVal, i64, 0);
+	if (boundsChecking())
+	{
+		/* The first and the last element of the matrix */
+		LLVMValueRef span = LLVMBuildMul(phi_builder, *stride, LLVMConstInt(i64, matrixColumns(type) - 1, 0), "span");
+		span = LLVMBuildAdd(phi_builder, span, LLVMConstInt(i64, matrixRows(type) - 1, 0), "span");
+		checkIndex(offset, length, NULL, NULL);
+		checkIndex(LLVMBuildAdd(phi_builder, offset, span, "lastelement"), length, NULL, NULL);
+	}
+	return LLVMBuildGEP(phi_builder, begin, &offset, 1, "matrixbegin");
+}
+
+/* a offset stride load:<Real<R,C>> */
+static LLVMValueRef codegenMatrixLoad (stack *args)
+{
+	if (args == NULL || args->next != NULL || args->item == NULL)
+		return logError("load expects the type of a matrix, e.g. load:<Real<4,4>>.", 0x2D1D);
+	LLVMTypeRef type = getAppropriateType(args->item);
+	if (type == NULL)
+		return NULL;
+	if (!isMatrixType(type))
+		return logError("load expects the type of a matrix, e.g. load:<Real<4,4>>.", 0x2D1D);
+	LLVMValueRef stride;
+	LLVMValueRef ptr = matrixAddress(type, 0, &stride);
+	if (ptr == NULL)
+		return NULL;
+	LLVMValueRef result = buildMatrixLoad(type, ptr, stride);
+	if (isUnsignedType(args->item))
+		markUnsigned(result);
+	pushValue(result, 1);
+	return result;
+}
+
+/* m a offset stride save */
+static LLVMValueRef codegenMatrixSave ()
+{
+	stack *matrix = valueStack;
+	for (int i = 0; i < 3 && matrix != NULL; i++)
+		matrix = matrix->next;
+	if (matrix == NULL || !isMatrixType(LLVMTypeOf(matrix->item)))
+		return logError("Only matrices can be saved.", 0x2D1E);
+	LLVMValueRef stride;
+	LLVMValueRef ptr = matrixAddress(LLVMTypeOf(matrix->item), 1, &stride);
+	if (ptr == NULL)
+		return NULL;
+	LLVMValueRef value = popValue(&valueStack);
+	buildMatrixStore(value, ptr, stride);
+	return value;
+}
+
+/* Built-in functions on complex numbers, besides abs and exp. complex builds one from its real and imaginary part. */
+static int isComplexFunction (const char *name)
+{
+	return strcmp(name, "complex") == 0 || strcmp(name, "re") == 0 || strcmp(name, "im") == 0
+		|| strcmp(name, "conj") == 0;
+}
+
+static LLVMValueRef codegenMathFunction (const char *name, unsigned numArgs)
+{
+	if (numArgs > depth(valueStack))
+		return logError("Insufficient number of arguments given to math function!", 0x2C07);
+	LLVMValueRef args[3];
+	if (!popOperands(args, numArgs))
+		return NULL;
+	LLVMValueRef result = buildMathFunction(name, args);
+	if (result == NULL)
+		return NULL;
+	pushValue(result, 1);
+	return result;
+}
+
+static LLVMValueRef codegenComplexFunction (const char *name)
+{
+	unsigned numArgs = strcmp(name, "complex") == 0 ? 2 : 1;
+	if (numArgs > depth(valueStack))
+		return logError("Insufficient number of arguments given to complex function!", 0x2C0D);
+	LLVMValueRef args[2];
+	if (!popOperands(args, numArgs))
+		return NULL;
+	LLVMValueRef result;
+	int isUnsignedResult;
+	if (numArgs == 1)
+		result = buildComplexFunction(name, args[0]);
+	else if (!promoteArguments(args, 2, &isUnsignedResult))
+		return logError("Complex numbers are built from two numbers or vectors of the same size.", 0x2C0E);
+	else
+	{
+		LLVMTypeRef type = LLVMTypeOf(args[0]);
+		LLVMTypeRef real = LLVMDoubleTypeInContext(phi_context);
+		if (LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+			real = LLVMVectorType(real, LLVMGetVectorSize(type));
+		result = buildComplex(buildConversion(args[0], real, 0), buildConversion(args[1], real, 0));
+	}
+	if (result == NULL)
+		return NULL;
+	pushValue(result, 1);
+	return result;
+}
+
+/* Built-in logical operators and shifts. They are applied bitwise to Int and lane-wise to vectors. */
+static int lookupLogicOp (const char *name)
+{
+	if (strcmp(name, "and") == 0)
+		return '&';
+	else if (strcmp(name, "or") == 0)
+		return '|';
+	else if (strcmp(name, "xor") == 0)
+		return '^';
+	else if (strcmp(name, "not") == 0)
+		return '!';
+	else if (strcmp(name, "shl") == 0)
+		return '<';
+	else if (strcmp(name, "shr") == 0)
+		return '>';
+	return 0;
+}
+
+static LLVMValueRef codegenLogicOp (int op)
 {
-	unsigned expectedArgs = LLVMCountParams(function);
-	if (expectedArgs > depth(valueStack))
-		return logError("Insufficient number of arguments given to function!", 0x2404);
-	/* Gather all arguments from the value stack */
-	LLVMValueRef argValues[expectedArgs];
-	for (int i = expectedArgs-1; i >= 0; i--)
-	{
-		LLVMValueRef val = pop(&valueStack);
-		if (val == NULL)
-			return NULL;
-		argValues[i] = val;
-	}
+	unsigned numArgs = (op == '!') ? 1 : 2;
+	if (numArgs > depth(valueStack))
+		return logError("Insufficient number of arguments given to logical operator!", 0x2C04);
+	LLVMValueRef args[2];
+	if (!popOperands(args, numArgs))
+		return NULL;
+	LLVMValueRef result;
+	if (op == '!')
+		result = buildAppropriateNot(args[0]);
+	else if (op == '<' || op == '>')
+		result = buildAppropriateShift(op, args[0], args[1]);
+	else
+		result = buildAppropriateLogic(op, args[0], args[1]);
+	if (result == NULL)
+		return NULL;
+	pushValue(result, 1);
+	return result;
+}
 
-	LLVMValueRef result = LLVMBuildCall(phi_builder, function, argValues, expectedArgs, "calltmp");
-	LLVMTypeRef returnType = LLVMTypeOf(result);
-	LLVMTypeKind returnKind = LLVMGetTypeKind(returnType);
-	/* If we only returned a single type, push and return that. */
-	if (returnKind != LLVMStructTypeKind)
-	{
-		valueStack = push(result, 1, valueStack);
-		return result;
-	}
-	unsigned numOfReturnTypes = LLVMCountStructElementTypes(returnType);
-	for (int i = numOfReturnTypes-1; i >= 0; i--)
+/* Built-in conversions between the numeric types, named after the type they convert to */
+static const struct conversion {
+	const char *name;
+	int type;
+} conversions[] = {
+	{"real", type_real},
+	{"float32", type_float32},
+	{"int", type_int},
+	{"int64", type_int64},
+	{"int16", type_int16},
+	{"int8", type_int8},
+	{"uint", type_uint},
+	{NULL, 0}
+};
+
+static int lookupConversion (const char *name)
+{
+	for (const struct conversion *c = conversions; c->name != NULL; c++)
+		if (strcmp(c->name, name) == 0)
+			return c->type;
+	return 0;
+}
+
+static LLVMValueRef codegenConversion (int base)
+{
+	if (valueStack == NULL)
+		return logError("No value found to be converted.", 0x2C05);
+	if (isDeferred(valueStack))
+		return logError("Results of a spawned call can only be used after sync.", 0x2A03);
+	LLVMValueRef val = popValue(&valueStack);
+	TypeDesc desc = {base, 0, 0, 0, 0, 0, 0, 0, 0};
+	LLVMTypeRef type = getAppropriateType(&desc);
+	LLVMTypeRef from = LLVMTypeOf(val);
+	LLVMTypeKind kind = LLVMGetTypeKind(from);
+	if (kind == LLVMVectorTypeKind)
 	{
-		LLVMValueRef structElement = LLVMBuildExtractValue(phi_builder, result, i, "structelem");
-		valueStack = push(structElement, 1, valueStack);
+		type = LLVMVectorType(type, LLVMGetVectorSize(from));
+		kind = LLVMGetTypeKind(LLVMGetElementType(from));
 	}
+	if (kind != LLVMIntegerTypeKind && !isFloatingType(from))
+		return logError("Only numbers and Booleans can be converted.", 0x2C06);
+	int toUnsigned = isUnsignedType(&desc);
+	LLVMValueRef result = buildConversion(val, type, toUnsigned);
+	/* Between Int and UInt, only the signedness changes */
+	if (result == val && isUnsigned(val) && !toUnsigned)
+		result = LLVMIsAInstruction(val) ? LLVMBuildFreeze(phi_builder, val, "signed") : markSigned(val);
+	pushValue(result, 1);
 	return result;
 }
 
@@ -133,39 +1262,111 @@ LLVMValueRef codegenIdentExpr (IdentExpr *ie)
 		stack *runner = valueStack;
 		while (runner != NULL)
 		{
-			runner->misc = 1;
+			if (!isDeferred(runner))
+				runner->misc = 1 | (runner->misc & UNSIGNED_VALUE);
 			runner = runner->next;
 		}
 		return valueStack->item;
 	}
+	else if (strncmp(ie->name, "yield", 6) == 0)
+	{
+		LLVMValueRef promise = generatorPromise();
+		if (promise == NULL)
+			return logError("Cannot yield outside of a generator.", 0x2B05);
+		syncSpawns();
+		LLVMValueRef value = popValue(&valueStack);
+		if (value == NULL)
+			return logError("No value found to be yielded.", 0x2B06);
+		value = adaptConstant(value, LLVMGetAllocatedType(promise));
+		if (LLVMTypeOf(value) != LLVMGetAllocatedType(promise))
+			return logError("Type mismatch between yielded value and generator.", 0x2B07);
+		LLVMBuildStore(phi_builder, value, promise);
+		markSuspension();
+		buildSuspend(0);
+		return value;
+	}
+	else if (strncmp(ie->name, "sync", 5) == 0)
+	{
+		syncSpawns();
+		if (valueStack == NULL)
+			return LLVMGetUndef(LLVMVoidTypeInContext(phi_context));
+		return valueStack->item;
+	}
 	/* Now see if the identifier should be a new Variable. If so, create it and push it on the stack. */
 	if (ie->flag == id_new)
 	{
-		LLVMValueRef topOfStack = pop(&valueStack);
+		int deferred = isDeferred(valueStack);
+		LLVMValueRef topOfStack = popValue(&valueStack);
 		if (topOfStack == NULL)
 			return logError("Cannot assign variable without value.", 0x2403);
-		LLVMValueRef alloca = CreateEntryPointAlloca(NULL, LLVMTypeOf(topOfStack), ie->name);
-		LLVMBuildStore(phi_builder, topOfStack, alloca);
+		LLVMValueRef table = deferred || !LLVMIsALoadInst(topOfStack) ? NULL : constantTable(LLVMGetOperand(topOfStack, 0));
+		if (table != NULL)
+		{
+			/* Tables are never written to, so the variable refers to the table instead of a copy */
+			LLVMValueRef variable = LLVMBuildFreeze(phi_builder, table, ie->name);
+			if (isUnsigned(topOfStack))
+				markUnsigned(variable);
+			namesInScope = push(variable, scope, namesInScope);
+			if (LLVMGetFirstUse(topOfStack) == NULL)
+				LLVMInstructionEraseFromParent(topOfStack);
+			return variable;
+		}
+		LLVMTypeRef type = LLVMTypeOf(topOfStack);
+		if (deferred)
+			type = LLVMGetElementType(type);
+		LLVMValueRef alloca = CreateVariable(type, 0, ie->name);
+		if (isUnsigned(topOfStack))
+			markUnsigned(alloca);
 		namesInScope = push(alloca, scope, namesInScope);
+		if (deferred)
+			return deferStore(topOfStack, alloca) == NULL ? NULL : topOfStack;
+		LLVMBuildStore(phi_builder, topOfStack, alloca);
 		return topOfStack;
 	}
-	else if (ie->flag == id_vec)
+	else if ((ie->flag == id_vec || ie->flag == id_array) && isDeferred(valueStack))
+		return logError("Results of a spawned call can only be used after sync.", 0x2A03);
+	unsigned size = ie->size;
+	if ((ie->flag == id_vec || ie->flag == id_array) && ie->sizeParam != 0 && !templateValue(ie->sizeParam - 1, &size))
+		return NULL;
+	unsigned rows = ie->rows;
+	if (ie->flag == id_vec && ie->rowParam != 0 && !templateValue(ie->rowParam - 1, &rows))
+		return NULL;
+	if (ie->flag == id_vec)
 	{
-		LLVMValueRef topOfStack = pop(&valueStack);
+		LLVMValueRef topOfStack = popValue(&valueStack);
 		if (topOfStack == NULL)
 			return logError("Cannot infer Vector Type without value.", 0x2404);
-		LLVMTypeRef vectorType = LLVMVectorType(LLVMTypeOf(topOfStack), ie->size);
+		if (rows == 0 && (size == 0 || size > maxVectorSize))
+			return logError("Vector size must be between 1 and 64.", 0x2102);
+		LLVMTypeRef type = LLVMTypeOf(topOfStack);
+		LLVMTypeRef vectorType;
+		if (rows != 0)
+			vectorType = matrixType(type, rows, size);
+		else if (isComplexType(type) && complexLanes(type) == 0)
+			vectorType = complexType(size);
+		else if (LLVMGetTypeKind(type) != LLVMIntegerTypeKind && !isFloatingType(type))
+			return logError("Vectors can only be built from scalar types.", 0x2103);
+		else
+			vectorType = LLVMVectorType(type, size);
+		if (vectorType == NULL)
+			return NULL;
 		LLVMValueRef vecAlloca = CreateEntryPointAlloca(NULL, vectorType, ie->name);
+		if (isUnsigned(topOfStack))
+			markUnsigned(vecAlloca);
 		namesInScope = push(vecAlloca, scope, namesInScope);
 		return vecAlloca;
 	}
 	else if (ie->flag == id_array)
 	{
-		LLVMValueRef topOfStack = pop(&valueStack);
+		LLVMValueRef topOfStack = popValue(&valueStack);
 		if (topOfStack == NULL)
 			return logError("Cannot infer Array Type without value.", 0x2404);
-		LLVMTypeRef arrayType = LLVMArrayType(LLVMTypeOf(topOfStack), ie->size);
-		LLVMValueRef arrAlloca = CreateEntryPointAlloca(NULL, arrayType, ie->name);
+		if (size == 0)
+			return logError("Array size must be positive.", 0x2104);
+		LLVMTypeRef arrayType = recordArrayType(LLVMTypeOf(topOfStack), size);
+		LLVMValueRef arrAlloca = CreateVariable(arrayType, ie->align, ie->name);
+		if (isUnsigned(topOfStack))
+			markUnsigned(arrAlloca);
 		namesInScope = push(arrAlloca, scope, namesInScope);
 		return arrAlloca;
 	}
@@ -173,107 +1374,605 @@ LLVMValueRef codegenIdentExpr (IdentExpr *ie)
 	/* Now test for an existing variable. */
 	if (ie->flag == id_var || ie->flag == id_any)
 	{
-		LLVMValueRef variableAlloca = NULL;
-		size_t len = strlen(ie->name);
-		for (stack *r = namesInScope; r != NULL; r = r->next)
+		LLVMValueRef variableAlloca = lookupVariable(ie->name);
+		if (ie->field != NULL)
+		{
+			if (variableAlloca == NULL)
+				return logError("Attempting to access a field of an unknown variable.", 0x2E07);
+			variableAlloca = fieldStorage(variableAlloca, ie->field);
+			if (variableAlloca == NULL)
+				return NULL;
+		}
+		if (variableAlloca != NULL && isReadOnly(variableAlloca))
 		{
-			variableAlloca = r->item;
-			const char *name = LLVMGetValueName(variableAlloca);
-			if (strncmp(name, ie->name, len) == 0)
+			if (ie->flag != id_var && valueStack != NULL && valueRole(valueStack) != 0)
+				return logError("Cannot assign to a read-only variable.", 0x2408);
+			pushValue(variableAlloca, 0);
+			return variableAlloca;
+		}
+		else if (variableAlloca != NULL)
+		{
+			if (ie->flag == id_var || valueStack == NULL || valueRole(valueStack) == 0)
 			{
-				if (ie->flag == id_var || valueStack == NULL || valueStack->misc == 0)
-				{
-					LLVMValueRef load = LLVMBuildLoad(phi_builder, variableAlloca, name);
-					valueStack = push(load, 0, valueStack);
-					return load;
-				}
-				else
-				{
-					LLVMValueRef topOfStack = pop(&valueStack);
-					if (LLVMTypeOf(topOfStack) != LLVMGetAllocatedType(variableAlloca))
-						return logError("Type mismatch in Variable assignment.", 0x2405);
-					LLVMBuildStore(phi_builder, topOfStack, variableAlloca);
-					return topOfStack;
-				}
+				const char *name = LLVMGetValueName(variableAlloca);
+				LLVMValueRef load = LLVMBuildLoad(phi_builder, variableAlloca, name);
+				if (isUnsigned(variableAlloca))
+					markUnsigned(load);
+				pushValue(load, 0);
+				return load;
+			}
+			else if (constantTable(variableAlloca) != NULL)
+				return logError("Cannot assign to a read-only variable.", 0x2408);
+			else
+			{
+				int deferred = isDeferred(valueStack);
+				LLVMValueRef topOfStack = popValue(&valueStack);
+				if (!deferred)
+					topOfStack = adaptConstant(topOfStack, LLVMGetElementType(LLVMTypeOf(variableAlloca)));
+				LLVMTypeRef type = LLVMTypeOf(topOfStack);
+				if (deferred)
+					type = LLVMGetElementType(type);
+				if (type != LLVMGetElementType(LLVMTypeOf(variableAlloca)))
+					return logError("Type mismatch in Variable assignment.", 0x2405);
+				if (deferred)
+					return deferStore(topOfStack, variableAlloca) == NULL ? NULL : topOfStack;
+				forgetDeferredStores(variableAlloca);
+				LLVMBuildStore(phi_builder, topOfStack, variableAlloca);
+				return topOfStack;
 			}
 		}
 		if (ie->flag == id_var)
 			return logError("Found explicit Variable request with unknown identifier name!", 0x2406);
 	}
 	LLVMValueRef function = LLVMGetNamedFunction(phi_module, ie->name);
+	if (ie->flag == id_func)
+	{
+		if (function == NULL)
+			return logError("Only known functions can be passed as name:f.", 0x240A);
+		pushValue(function, 0);
+		return function;
+	}
+	unsigned numArgs = mathArguments(ie->name);
+	if (numArgs != 0)
+		return codegenMathFunction(ie->name, numArgs);
 	if (function != NULL)
 		return codegenCallExpr(function);
+	/* Templates whose parameters are all functions are called without template arguments */
+	if (isTemplateName(ie->name))
+	{
+		function = instantiateTemplate(ie->name, NULL);
+		if (function == NULL)
+			return NULL;
+		return codegenCallExpr(function);
+	}
+	numArgs = reductionArguments(ie->name);
+	if (numArgs != 0)
+		return codegenReduction(ie->name, numArgs);
+	numArgs = algorithmArguments(ie->name);
+	if (numArgs != 0)
+		return codegenAlgorithm(ie->name, numArgs);
+	if (strncmp(ie->name, "length", 7) == 0)
+		return codegenLength();
+	if (strncmp(ie->name, "transpose", 10) == 0)
+		return codegenTranspose();
+	if (strncmp(ie->name, "save", 5) == 0)
+		return codegenMatrixSave();
+	int logicOp = lookupLogicOp(ie->name);
+	if (logicOp != 0)
+		return codegenLogicOp(logicOp);
+	int conversion = lookupConversion(ie->name);
+	if (conversion != 0)
+		return codegenConversion(conversion);
+	if (isComplexFunction(ie->name))
+		return codegenComplexFunction(ie->name);
 	return logError("Unrecognized identifier!", 0x2407);
 }
 
+/* With --bounds-check, the index must be within the elements of an array, vector or slice variable */
+static void checkAccess (LLVMValueRef variable, LLVMValueRef index, LLVMValueRef mask)
+{
+	if (!boundsChecking())
+		return;
+	LLVMTypeRef type = LLVMGetElementType(LLVMTypeOf(variable));
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	if (isSliceType(type))
+	{
+		LLVMValueRef slice = LLVMBuildLoad(phi_builder, variable, LLVMGetValueName(variable));
+		checkIndex(index, LLVMBuildExtractValue(phi_builder, slice, 1, "slicelength"), mask, variable);
+		return;
+	}
+	/* All fields of an array in SoA layout and both parts of a complex vector have the same number of elements */
+	if (soaElementType(type) != NULL || isComplexType(type))
+		type = LLVMStructGetTypeAtIndex(type, 0);
+	unsigned length = LLVMGetTypeKind(type) == LLVMVectorTypeKind ? LLVMGetVectorSize(type) : LLVMGetArrayLength(type);
+	checkIndex(index, LLVMConstInt(i64, length, 0), mask, NULL);
+}
+
+/* Pointer to an element of an array, vector or slice variable */
+static LLVMValueRef elementPointer (LLVMValueRef varAlloca, LLVMValueRef idxVal)
+{
+	if (isSliceType(LLVMGetElementType(LLVMTypeOf(varAlloca))))
+	{
+		LLVMValueRef slice = LLVMBuildLoad(phi_builder, varAlloca, LLVMGetValueName(varAlloca));
+		LLVMValueRef begin = LLVMBuildExtractValue(phi_builder, slice, 0, "slicebegin");
+		return LLVMBuildGEP(phi_builder, begin, &idxVal, 1, "geptmp");
+	}
+	LLVMValueRef idxs[2] = {LLVMConstNull(LLVMTypeOf(idxVal)), idxVal};
+	return LLVMBuildGEP(phi_builder, varAlloca, idxs, 2, "geptmp");
+}
+
+/* Access to the elements of an array at a vector of indices. Lanes, which are not selected by the mask,
+ * are read as zero and not written. */
+static LLVMValueRef codegenGatherScatter (AccessExpr *ae, LLVMValueRef varAlloca, LLVMValueRef idxVal)
+{
+	LLVMTypeRef vartype = LLVMGetElementType(LLVMTypeOf(varAlloca));
+	if (isSliceType(vartype))
+		vartype = LLVMStructGetTypeAtIndex(vartype, 0);
+	else if (LLVMGetTypeKind(vartype) != LLVMArrayTypeKind)
+		return logError("A vector of indices can only be used to access an array or slice.", 0x250A);
+	LLVMTypeRef elemtype = LLVMGetElementType(vartype);
+	LLVMTypeKind elemkind = LLVMGetTypeKind(elemtype);
+	if (elemkind == LLVMVectorTypeKind || elemkind == LLVMArrayTypeKind)
+		return logError("A vector of indices cannot be used on an array of vectors or arrays.", 0x250B);
+	if (elemkind == LLVMStructTypeKind)
+		return logError("A vector of indices cannot be used on an array of records or complex numbers.", 0x250E);
+
+	LLVMTypeRef i1 = LLVMInt1TypeInContext(phi_context);
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(phi_context);
+	unsigned lanes = LLVMGetVectorSize(LLVMTypeOf(idxVal));
+	LLVMTypeRef maskType = LLVMVectorType(i1, lanes);
+	LLVMValueRef mask = LLVMConstAllOnes(maskType);
+	if (ae->mask != NULL)
+	{
+		mask = codegenOperand(ae->mask);
+		if (mask == NULL)
+			return NULL;
+		if (LLVMTypeOf(mask) != maskType)
+			return logError("The mask must be a Bool vector of the same size as the indices.", 0x250C);
+	}
+
+	checkAccess(varAlloca, idxVal, mask);
+	LLVMValueRef ptrs = elementPointer(varAlloca, idxVal);
+	LLVMTypeRef types[2] = {LLVMVectorType(elemtype, lanes), LLVMTypeOf(ptrs)};
+	unsigned align = LLVMABIAlignmentOfType(LLVMGetModuleDataLayout(phi_module), elemtype);
+	LLVMValueRef alignment = LLVMConstInt(i32, align, 0);
+	if (ae->flag == id_var || valueStack == NULL || valueRole(valueStack) == 0)
+	{
+		LLVMValueRef args[4] = {ptrs, alignment, mask, LLVMConstNull(types[0])};
+		LLVMValueRef load = callIntrinsic("llvm.masked.gather", types, 2, args, 4, LLVMGetValueName(varAlloca));
+		if (isUnsigned(varAlloca))
+			markUnsigned(load);
+		pushValue(load, 0);
+		return load;
+	}
+	if (isDeferred(valueStack))
+		return logError("Results of a spawned call can only be used after sync.", 0x2A03);
+	LLVMValueRef value = adaptConstant(popValue(&valueStack), elemtype);
+	if (LLVMGetTypeKind(LLVMTypeOf(value)) != LLVMVectorTypeKind)
+		value = buildSplat(value, lanes);
+	else
+		value = adaptConstant(value, types[0]);
+	if (LLVMTypeOf(value) != types[0])
+		return logError("Type mismatch in Variable assignment.", 0x2405);
+	LLVMValueRef args[4] = {value, ptrs, alignment, mask};
+	callIntrinsic("llvm.masked.scatter", types, 2, args, 4, "");
+	return value;
+}
+
+/* An element of an array in SoA layout is spread over the arrays of its fields, and a lane of a complex vector over
+ * the vectors of its parts */
+static LLVMValueRef codegenSoaElement (AccessExpr *ae, LLVMValueRef varAlloca, LLVMValueRef idxVal, LLVMTypeRef recordType)
+{
+	unsigned numFields = LLVMCountStructElementTypes(recordType);
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(phi_context);
+	LLVMValueRef idxs[3] = {LLVMConstNull(i32), NULL, idxVal};
+	if (ae->flag == id_var || valueStack == NULL || valueRole(valueStack) == 0)
+	{
+		LLVMValueRef record = LLVMGetUndef(recordType);
+		for (unsigned i = 0; i < numFields; i++)
+		{
+			idxs[1] = LLVMConstInt(i32, i, 0);
+			LLVMValueRef ptr = LLVMBuildGEP(phi_builder, varAlloca, idxs, 3, "geptmp");
+			LLVMValueRef field = LLVMBuildLoad(phi_builder, ptr, "field");
+			record = LLVMBuildInsertValue(phi_builder, record, field, i, ae->name);
+		}
+		pushValue(record, 0);
+		return record;
+	}
+	if (isDeferred(valueStack))
+		return logError("Results of a spawned call can only be used after sync.", 0x2A03);
+	LLVMValueRef record = popValue(&valueStack);
+	if (LLVMTypeOf(record) != recordType)
+		return logError("Type mismatch in Variable assignment.", 0x2405);
+	for (unsigned i = 0; i < numFields; i++)
+	{
+		idxs[1] = LLVMConstInt(i32, i, 0);
+		LLVMValueRef ptr = LLVMBuildGEP(phi_builder, varAlloca, idxs, 3, "geptmp");
+		LLVMBuildStore(phi_builder, LLVMBuildExtractValue(phi_builder, record, i, "field"), ptr);
+	}
+	return record;
+}
+
 LLVMValueRef codegenAccessExpr (AccessExpr *ae)
 {
 	if (strncmp(ae->name, "store", 6) == 0)
 		return logError("Attempting to access a keyword as a vector.", 0x2501);
 
-	stack *globalValueStack = valueStack;
-	valueStack = NULL;
-	LLVMValueRef idxVal = codegen(ae->idx, 1);
-	clearStack(&valueStack, NULL);
-	valueStack = globalValueStack;
+	LLVMValueRef idxVal = codegenOperand(ae->idx);
 	if (idxVal == NULL)
 		return NULL;
 
 	LLVMTypeRef idxType = LLVMTypeOf(idxVal);
 	LLVMTypeKind idxKind = LLVMGetTypeKind(idxType);
+	int isGather = (idxKind == LLVMVectorTypeKind);
+	if (isGather)
+		idxKind = LLVMGetTypeKind(LLVMGetElementType(idxType));
 	if (idxKind != LLVMIntegerTypeKind)
 		return logError("Incompatible Type found in vector index.", 0x2504);
+	if (ae->mask != NULL && !isGather)
+		return logError("Only accesses with a vector of indices can be masked.", 0x250D);
 
-	LLVMValueRef varAlloca = NULL;
-	size_t len = strlen(ae->name);
-	for (stack *r = namesInScope; r != NULL; r = r->next)
-	{
-		varAlloca = r->item;
-		const char *name = LLVMGetValueName(varAlloca);
-		if (strncmp(name, ae->name, len) != 0)
-			continue;
+	LLVMValueRef varAlloca = lookupVariable(ae->name);
+	if (varAlloca == NULL)
+		return logError("Attempting to access an unknown vector!", 0x2509);
+	if (isReadOnly(varAlloca))
+		return logError("Cannot access variable that is not a vector or array.", 0x2505);
+	LLVMValueRef table = constantTable(varAlloca);
+	if (table != NULL && ae->flag != id_var && valueStack != NULL && valueRole(valueStack) != 0)
+		return logError("Cannot assign to a read-only variable.", 0x2408);
+	/* The field of an element in AoS layout is picked after the element */
+	const char *aosField = NULL;
+	if (ae->field != NULL && hasRecordElements(varAlloca))
+		aosField = ae->field;
+	else if (ae->field != NULL && (varAlloca = fieldStorage(varAlloca, ae->field)) == NULL)
+		return NULL;
+	const char *name = LLVMGetValueName(varAlloca);
 
-		LLVMTypeRef vartype = LLVMGetAllocatedType(varAlloca);
-		LLVMTypeKind varkind = LLVMGetTypeKind(vartype);
-		if (varkind != LLVMVectorTypeKind && varkind != LLVMArrayTypeKind)
-			return logError("Cannot access variable that is not a vector or array.", 0x2505);
-		else if (LLVMIsConstant(idxVal))
+	LLVMTypeRef vartype = LLVMGetElementType(LLVMTypeOf(varAlloca));
+	/* The elements of a matrix are accessed in column-major order */
+	if (isMatrixType(vartype))
+	{
+		LLVMValueRef elements = LLVMBuildStructGEP(phi_builder, varAlloca, 0, name);
+		varAlloca = isUnsigned(varAlloca) ? markUnsigned(elements) : elements;
+		vartype = LLVMGetElementType(LLVMTypeOf(varAlloca));
+	}
+	LLVMTypeKind varkind = LLVMGetTypeKind(vartype);
+	LLVMTypeRef soaElement = complexLanes(vartype) != 0 ? complexType(0) : soaElementType(vartype);
+	if (soaElement != NULL && !isGather)
+	{
+		checkAccess(varAlloca, idxVal, NULL);
+		return codegenSoaElement(ae, varAlloca, idxVal, soaElement);
+	}
+	if (varkind != LLVMVectorTypeKind && varkind != LLVMArrayTypeKind && !isSliceType(vartype))
+		return logError("Cannot access variable that is not a vector or array.", 0x2505);
+	else if (isGather && aosField != NULL)
+		return logError("Fields of records can only be gathered from arrays in SoA layout.", 0x2E08);
+	else if (isGather)
+		return codegenGatherScatter(ae, varAlloca, idxVal);
+	else if (LLVMIsConstant(idxVal))
+	{
+		int index = LLVMConstIntGetSExtValue(idxVal);
+		if (index < 0)
+			return logError("Negative index in Array access.", 0x2506);
+		if (varkind == LLVMArrayTypeKind)
 		{
-			int index = LLVMConstIntGetSExtValue(idxVal);
-			if (index < 0)
-				return logError("Negative index in Array access.", 0x2506);
-			if (varkind == LLVMArrayTypeKind)
-			{
-				int arrayLength = LLVMGetArrayLength(vartype);
-				if (index >= arrayLength)
-					return logError("Constant index beyond bounds of the array.", 0x2507);
-			}
-			else if (varkind == LLVMVectorTypeKind)
-			{
-				int vectorlength = LLVMGetVectorSize(vartype);
-				if (index >= vectorlength)
-					return logError("Constant index beyond bounds of the vector.", 0x2508);
-			}
+			int arrayLength = LLVMGetArrayLength(vartype);
+			if (index >= arrayLength)
+				return logError("Constant index beyond bounds of the array.", 0x2507);
 		}
-
-		LLVMValueRef zero = LLVMConstNull(idxType);
-		LLVMValueRef idxs[2] = {zero, idxVal};
-		if (ae->flag == id_var || valueStack == NULL || valueStack->misc == 0)
+		else if (varkind == LLVMVectorTypeKind)
 		{
-			LLVMValueRef ptr = LLVMBuildGEP(phi_builder, varAlloca, idxs, 2, "geptmp");
-			LLVMValueRef load = LLVMBuildLoad(phi_builder, ptr, name);
-			valueStack = push(load, 0, valueStack);
-			return load;
+			int vectorlength = LLVMGetVectorSize(vartype);
+			if (index >= vectorlength)
+				return logError("Constant index beyond bounds of the vector.", 0x2508);
 		}
+	}
+
+	checkAccess(varAlloca, idxVal, NULL);
+	if (table != NULL && LLVMIsConstant(idxVal))
+	{
+		LLVMValueRef element = tableElement(table, LLVMConstIntGetZExtValue(idxVal));
+		if (isUnsigned(varAlloca))
+			element = markUnsigned(element);
+		pushValue(element, 0);
+		return element;
+	}
+
+	LLVMValueRef ptr = elementPointer(varAlloca, idxVal);
+	if (aosField != NULL && (ptr = fieldStorage(ptr, aosField)) == NULL)
+		return NULL;
+	if (ae->flag == id_var || valueStack == NULL || valueRole(valueStack) == 0)
+	{
+		LLVMValueRef load = LLVMBuildLoad(phi_builder, ptr, name);
+		if (isUnsigned(varAlloca) || isUnsigned(ptr))
+			markUnsigned(load);
+		pushValue(load, 0);
+		return load;
+	}
+	else
+	{
+		int deferred = isDeferred(valueStack);
+		LLVMValueRef value = popValue(&valueStack);
+		if (!deferred)
+			value = adaptConstant(value, LLVMGetElementType(LLVMTypeOf(ptr)));
+		if (deferred)
+			return deferStore(value, ptr) == NULL ? NULL : value;
+		LLVMBuildStore(phi_builder, value, ptr);
+		return value;
+	}
+}
+
+LLVMValueRef buildOperator (int op, LLVMValueRef l, LLVMValueRef r)
+{
+	if (isMatrixType(LLVMTypeOf(l)) || isMatrixType(LLVMTypeOf(r)))
+		return buildMatrixOperator(op, l, r);
+	if (isComplexType(LLVMTypeOf(l)) || isComplexType(LLVMTypeOf(r)))
+		return buildComplexOperator(op, l, r);
+	switch (op)
+	{
+		case '+':
+			return buildAppropriateAddition(l, r);
+		case '-':
+			return buildAppropriateSubtraction(l, r);
+		case '*':
+			return buildAppropriateMultiplication(l, r);
+		case '/':
+			return buildAppropriateDivision(l, r);
+		case '<':
+			return buildAppropriateComparison(l, r);
+		case '=':
+			return buildAppropriateEquality(l, r);
+		case '%':
+			return buildAppropriateModulo(l, r);
+		default:
+			return logError("Unrecognized binary operator!", 0x2501);
+	}
+}
+
+/* Operators on whole arrays and slices work element by element. A tree of such operators is built as a single
+ * loop, which writes straight into the variable receiving the result. */
+static int isOperatorNode (Expr *e)
+{
+	if (e == NULL || e->expr_type != expr_binop)
+		return 0;
+	BinaryExpr *be = e->expr;
+	return be->op != ';' && be->op != ' ';
+}
+
+static LLVMValueRef arrayVariable (Expr *e)
+{
+	if (e == NULL || e->expr_type != expr_ident)
+		return NULL;
+	IdentExpr *ie = e->expr;
+	if (ie->flag != id_any && ie->flag != id_var)
+		return NULL;
+	LLVMValueRef var = lookupVariable(ie->name);
+	if (var == NULL || isReadOnly(var))
+		return NULL;
+	if (ie->field != NULL)
+	{
+		/* Only fields in SoA layout are stored as arrays */
+		int isUnsignedField;
+		if (hasRecordElements(var) || recordField(LLVMGetElementType(LLVMTypeOf(var)), ie->field, &isUnsignedField) < 0)
+			return NULL;
+		var = fieldStorage(var, ie->field);
+	}
+	LLVMTypeRef type = LLVMGetElementType(LLVMTypeOf(var));
+	if (LLVMGetTypeKind(type) != LLVMArrayTypeKind && !isSliceType(type))
+		return NULL;
+	return var;
+}
+
+static int isElementwise (Expr *e)
+{
+	if (!isOperatorNode(e))
+		return 0;
+	BinaryExpr *be = e->expr;
+	return arrayVariable(be->LHS) != NULL || arrayVariable(be->RHS) != NULL
+		|| isElementwise(be->LHS) || isElementwise(be->RHS);
+}
+
+/* A scalar, which is used for every element, or the first element and the number of elements of an array */
+typedef struct ElementwiseOperand {
+	LLVMValueRef value;
+	LLVMValueRef length;
+	/* Number of elements of a fixed size array, 0 for slices */
+	unsigned size;
+	int isUnsigned;
+} ElementwiseOperand;
+
+static unsigned countOperands (Expr *e)
+{
+	if (!isOperatorNode(e))
+		return 1;
+	BinaryExpr *be = e->expr;
+	return countOperands(be->LHS) + countOperands(be->RHS);
+}
+
+/* Set up an operand from a variable, or from an array or slice value if var is NULL */
+static void arrayOperand (LLVMValueRef var, LLVMValueRef val, ElementwiseOperand *op)
+{
+	LLVMTypeRef type = var != NULL ? LLVMGetElementType(LLVMTypeOf(var)) : LLVMTypeOf(val);
+	op->isUnsigned = isUnsigned(var != NULL ? var : val);
+	if (isSliceType(type))
+	{
+		if (var != NULL)
+			val = LLVMBuildLoad(phi_builder, var, LLVMGetValueName(var));
+		op->value = LLVMBuildExtractValue(phi_builder, val, 0, "slicebegin");
+		op->length = LLVMBuildExtractValue(phi_builder, val, 1, "slicelength");
+		op->size = 0;
+		return;
+	}
+	if (var == NULL)
+		var = unchangedSource(val);
+	if (var == NULL)
+	{
+		var = CreateVariable(type, 0, "elemtmp");
+		LLVMBuildStore(phi_builder, val, var);
+	}
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMValueRef idxs[2] = {LLVMConstNull(i64), LLVMConstNull(i64)};
+	op->value = LLVMBuildInBoundsGEP(phi_builder, var, idxs, 2, "arraybegin");
+	op->size = LLVMGetArrayLength(type);
+	op->length = LLVMConstInt(i64, op->size, 0);
+}
+
+/* Evaluate all operands, which are not combined element-wise, before the loop and in their order */
+static int prepareOperands (Expr *e, ElementwiseOperand *ops, unsigned *n)
+{
+	if (isOperatorNode(e))
+	{
+		BinaryExpr *be = e->expr;
+		return prepareOperands(be->LHS, ops, n) && prepareOperands(be->RHS, ops, n);
+	}
+	ElementwiseOperand *op = &ops[(*n)++];
+	LLVMValueRef var = arrayVariable(e);
+	if (var != NULL)
+	{
+		arrayOperand(var, NULL, op);
+		return 1;
+	}
+	LLVMValueRef val = codegenOperand(e);
+	if (val == NULL)
+		return 0;
+	LLVMTypeRef type = LLVMTypeOf(val);
+	if (LLVMGetTypeKind(type) == LLVMArrayTypeKind || isSliceType(type))
+		arrayOperand(NULL, val, op);
+	else
+	{
+		op->value = val;
+		op->length = NULL;
+		op->size = 0;
+	}
+	return 1;
+}
+
+static LLVMValueRef buildElement (Expr *e, ElementwiseOperand *ops, unsigned *n, LLVMValueRef i)
+{
+	if (isOperatorNode(e))
+	{
+		BinaryExpr *be = e->expr;
+		LLVMValueRef l = buildElement(be->LHS, ops, n, i);
+		if (l == NULL)
+			return NULL;
+		LLVMValueRef r = buildElement(be->RHS, ops, n, i);
+		if (r == NULL)
+			return NULL;
+		return buildOperator(be->op, l, r);
+	}
+	ElementwiseOperand *op = &ops[(*n)++];
+	if (op->length == NULL)
+		return op->value;
+	LLVMValueRef ptr = LLVMBuildGEP(phi_builder, op->value, &i, 1, "elemptr");
+	LLVMValueRef load = LLVMBuildLoad(phi_builder, ptr, "elem");
+	if (op->isUnsigned)
+		markUnsigned(load);
+	return load;
+}
+
+/* Store the elements of e into the array or slice variable dest, or into a new array named name if dest is NULL.
+ * Arrays must have the same size, while the loop stops at the end of the shortest slice. */
+static LLVMValueRef buildElementwiseLoop (Expr *e, LLVMValueRef dest, const char *name)
+{
+	unsigned numOps = countOperands(e) + 1;
+	ElementwiseOperand ops[numOps];
+	unsigned n = 0;
+	if (!prepareOperands(e, ops, &n))
+		return NULL;
+	if (dest != NULL)
+		arrayOperand(dest, NULL, &ops[n++]);
+
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMValueRef count = NULL;
+	unsigned size = 0;
+	for (unsigned k = 0; k < n; k++)
+	{
+		if (ops[k].length == NULL)
+			continue;
+		if (ops[k].size != 0 && size != 0 && ops[k].size != size)
+			return logError("Arrays of different sizes cannot be combined element-wise.", 0x2D01);
+		if (ops[k].size != 0)
+			size = ops[k].size;
+		if (count == NULL)
+			count = ops[k].length;
 		else
-		{
-			LLVMValueRef value = pop(&valueStack);
-			LLVMValueRef ptr = LLVMBuildGEP(phi_builder, varAlloca, idxs, 2, "geptmp");
-			LLVMBuildStore(phi_builder, value, ptr);
-			return value;
-		}
+			checkSameLength(ops[k].length, count);
+	}
+
+	LLVMBasicBlockRef Preheader = LLVMGetInsertBlock(phi_builder);
+	LLVMValueRef function = LLVMGetBasicBlockParent(Preheader);
+	LLVMBasicBlockRef LoopBlock = LLVMAppendBasicBlockInContext(phi_context, function, "elemLoop");
+	LLVMBasicBlockRef AfterBlock = LLVMAppendBasicBlockInContext(phi_context, function, "elemEnd");
+	LLVMValueRef zero = LLVMConstNull(i64);
+	LLVMBuildCondBr(phi_builder, LLVMBuildICmp(phi_builder, LLVMIntNE, count, zero, "notempty"), LoopBlock, AfterBlock);
+	LLVMPositionBuilderAtEnd(phi_builder, LoopBlock);
+	LLVMValueRef i = LLVMBuildPhi(phi_builder, i64, "i");
+	n = 0;
+	LLVMValueRef element = buildElement(e, ops, &n, i);
+	if (element == NULL)
+		return NULL;
+	LLVMValueRef target;
+	if (dest == NULL)
+	{
+		if (size == 0)
+			return logError("Element-wise operations on slices must be stored into an array or slice.", 0x2D02);
+		dest = CreateVariable(LLVMArrayType(LLVMTypeOf(element), size), 0, name);
+		if (isUnsigned(element))
+			markUnsigned(dest);
+		LLVMValueRef idxs[2] = {zero, i};
+		target = LLVMBuildGEP(phi_builder, dest, idxs, 2, "elemptr");
+	}
+	else
+	{
+		target = LLVMBuildGEP(phi_builder, ops[n].value, &i, 1, "elemptr");
+		if (LLVMTypeOf(element) != LLVMGetElementType(LLVMTypeOf(target)))
+			return logError("Type mismatch in Variable assignment.", 0x2405);
+	}
+	LLVMBuildStore(phi_builder, element, target);
+	LLVMValueRef next = LLVMBuildNUWAdd(phi_builder, i, LLVMConstInt(i64, 1, 0), "next");
+	LLVMBasicBlockRef LoopEnd = LLVMGetInsertBlock(phi_builder);
+	LLVMBuildCondBr(phi_builder, LLVMBuildICmp(phi_builder, LLVMIntULT, next, count, "more"), LoopBlock, AfterBlock);
+	LLVMAddIncoming(i, &zero, &Preheader, 1);
+	LLVMAddIncoming(i, &next, &LoopEnd, 1);
+	LLVMPositionBuilderAtEnd(phi_builder, AfterBlock);
+	return dest;
+}
+
+/* Match "... store r" and "... r:!", which receive the elements of an element-wise operation without a temporary */
+static int matchElementwiseStore (BinaryExpr *be, Expr **tree, LLVMValueRef *dest)
+{
+	if (be->RHS->expr_type != expr_ident)
+		return 0;
+	IdentExpr *target = be->RHS->expr;
+	*tree = be->LHS;
+	*dest = NULL;
+	if (target->flag == id_any && be->LHS->expr_type == expr_binop)
+	{
+		BinaryExpr *command = be->LHS->expr;
+		if (command->op != ' ' || command->RHS->expr_type != expr_ident)
+			return 0;
+		IdentExpr *store = command->RHS->expr;
+		if (strncmp(store->name, "store", 6) != 0 || (*dest = arrayVariable(be->RHS)) == NULL
+				|| constantTable(*dest) != NULL)
+			return 0;
+		*tree = command->LHS;
 	}
-	return logError("Attempting to access an unknown vector!", 0x2509);
+	else if (target->flag != id_new)
+		return 0;
+	return isElementwise(*tree);
+}
+
+static LLVMValueRef codegenElementwiseStore (Expr *tree, LLVMValueRef dest, const char *name)
+{
+	LLVMValueRef var = buildElementwiseLoop(tree, dest, name);
+	if (var == NULL)
+		return NULL;
+	if (dest == NULL)
+		namesInScope = push(var, scope, namesInScope);
+	LLVMValueRef val = LLVMBuildLoad(phi_builder, var, name);
+	if (isUnsigned(var))
+		markUnsigned(val);
+	return val;
 }
 
 LLVMValueRef codegenBinaryExpr (BinaryExpr *be)
@@ -281,9 +1980,31 @@ LLVMValueRef codegenBinaryExpr (BinaryExpr *be)
 	stack *globalValueStack = valueStack;
 	valueStack = NULL;
 
+	Expr tree = {expr_binop, be};
+	Expr *elements;
+	LLVMValueRef dest;
+	if (be->op == ' ' && matchElementwiseStore(be, &elements, &dest))
+		return codegenElementwiseStore(elements, dest, ((IdentExpr*)be->RHS->expr)->name);
+	else if (be->op != ';' && isElementwise(&tree))
+	{
+		LLVMValueRef array = buildElementwiseLoop(&tree, NULL, "elemtmp");
+		if (array == NULL)
+			return NULL;
+		LLVMValueRef val = LLVMBuildLoad(phi_builder, array, "elemtmp");
+		if (isUnsigned(array))
+			markUnsigned(val);
+		valueStack = globalValueStack;
+		pushValue(val, 0);
+		return val;
+	}
+
 	LLVMValueRef l = codegen(be->LHS, 0);
+	int deferred = isDeferred(valueStack);
+	int lhsUnsigned = isUnsigned(l);
 	if (be->op != ' ')
 		clearStack(&valueStack, NULL);
+	if (be->op == ';')
+		clearStack(&unsignedConstants, NULL);
 	if (l == NULL)
 		return NULL;
 
@@ -291,7 +2012,8 @@ LLVMValueRef codegenBinaryExpr (BinaryExpr *be)
 	if (r == NULL)
 		return NULL;
 
-	LLVMValueRef val = NULL;
+	if (be->op != ';' && be->op != ' ' && (deferred || isDeferred(valueStack)))
+		return logError("Results of a spawned call can only be used after sync.", 0x2A03);
 	switch (be->op)
 	{
 		case ';':
@@ -299,32 +2021,13 @@ LLVMValueRef codegenBinaryExpr (BinaryExpr *be)
 			return r;
 		case ' ':
 			return r;
-		case '+':
-			val = buildAppropriateAddition(l, r);
-			break;
-		case '-':
-			val = buildAppropriateSubtraction(l, r);
-			break;
-		case '*':
-			val = buildAppropriateMultiplication(l, r);
-			break;
-		case '/':
-			val = buildAppropriateDivision(l, r);
-			break;
-		case '<':
-			val = buildAppropriateComparison(l, r);
-			break;
-		case '=':
-			val = buildAppropriateEquality(l, r);
-			break;
-		case '%':
-			val = buildAppropriateModulo(l, r);
-			break;
-		default:
-			return logError("Unrecognized binary operator!", 0x2501);
 	}
+	if (lhsUnsigned)
+		markUnsigned(l);
+	LLVMValueRef val = buildOperator(be->op, l, r);
 	clearStack(&valueStack, NULL);
-	valueStack = push(val, 0, globalValueStack);
+	valueStack = globalValueStack;
+	pushValue(val, 0);
 	return val;
 }
 
@@ -335,45 +2038,106 @@ LLVMValueRef codegenProtoExpr (ProtoExpr *pe)
 		declareNewTemplate(pe);
 		return NULL;
 	}
-	int numOfInputArgs = depth(pe->inArgs);
 	int numOfOutputArgs = depth(pe->outArgs);
-	LLVMTypeRef args[numOfInputArgs];
-	stack *runner = pe->inArgs;
-	for (int i = numOfInputArgs-1; i >= 0; i--)
+	int numOfParams = 0;
+	stack *runner;
+	for (runner = pe->inArgs; runner != NULL; runner = runner->next)
+	{
+		TypeDesc *type = ((Param*)runner->item)->type;
+		if (type != NULL)
+			numOfParams += type->slice ? 2 : 1;
+	}
+	LLVMTypeRef args[numOfParams];
+	runner = pe->inArgs;
+	for (int i = numOfParams-1; i >= 0; i--)
 	{
-		args[i] = getAppropriateType(runner->misc);
+		/* Functions passed as parameters are bound at compile time */
+		while (((Param*)runner->item)->type == NULL)
+			runner = runner->next;
+		LLVMTypeRef type = getAppropriateType(((Param*)runner->item)->type);
+		if (type == NULL)
+			return NULL;
+		if (isSliceType(type))
+		{
+			args[i--] = LLVMStructGetTypeAtIndex(type, 1);
+			type = LLVMStructGetTypeAtIndex(type, 0);
+		}
+		args[i] = type;
 		runner = runner->next;
 	}
 
+	for (runner = pe->outArgs; runner != NULL; runner = runner->next)
+		if (((Param*)runner->item)->type->slice)
+			return logError("A slice cannot be returned, as it refers to the memory of the caller.", 0x2105);
+
 	LLVMTypeRef retType;
+	if (pe->isGenerator && numOfOutputArgs != 1)
+		return logError("A generator must yield exactly one type of value.", 0x2B02);
 	if (numOfOutputArgs == 0)
 		retType = LLVMVoidTypeInContext(phi_context);
 	else if (numOfOutputArgs == 1)
-		retType = getAppropriateType((pe->outArgs)->misc);
+	{
+		retType = getAppropriateType(((Param*)pe->outArgs->item)->type);
+		if (retType == NULL)
+			return NULL;
+	}
 	else
 	{
 		LLVMTypeRef rettypes[numOfOutputArgs];
 		stack *runner = pe->outArgs;
 		for (int i = numOfOutputArgs-1; i >= 0; i--)
 		{
-			rettypes[i] = getAppropriateType(runner->misc);
+			rettypes[i] = getAppropriateType(((Param*)runner->item)->type);
+			if (rettypes[i] == NULL)
+				return NULL;
 			runner = runner->next;
 		}
 		retType = LLVMStructTypeInContext(phi_context, rettypes, numOfOutputArgs, 0);
 	}
-	LLVMTypeRef funcType = LLVMFunctionType(retType, args, numOfInputArgs, 0);
-	return LLVMAddFunction(phi_module, pe->name, funcType);
+	/* A generator returns its handle, which is typed after the values it yields */
+	if (pe->isGenerator)
+		retType = LLVMPointerType(retType, 0);
+	LLVMTypeRef funcType = LLVMFunctionType(retType, args, numOfParams, 0);
+	LLVMValueRef function = LLVMAddFunction(phi_module, pe->name, funcType);
+	unsigned unsignedMask = 0;
+	runner = pe->outArgs;
+	for (int i = numOfOutputArgs-1; i >= 0; i--)
+	{
+		if (isUnsignedType(((Param*)runner->item)->type))
+			unsignedMask |= 1u << i;
+		runner = runner->next;
+	}
+	markUnsignedResults(function, unsignedMask);
+	return function;
+}
+
+static void addParamAttribute (LLVMValueRef function, unsigned i, const char *name)
+{
+	unsigned kind = LLVMGetEnumAttributeKindForName(name, strlen(name));
+	LLVMAddAttributeAtIndex(function, i+1, LLVMCreateEnumAttribute(phi_context, kind, 0));
+}
+
+static LLVMValueRef finishFunction (LLVMValueRef function, int isGenerator)
+{
+	checkAllocations(function);
+	int verified = LLVMVerifyFunction(function, LLVMPrintMessageAction);
+	if (verified == 1)
+	{
+		LLVMDeleteFunction(function);
+		return NULL;
+	}
+	/* Generators are only optimised with the whole module, where they are split into coroutines first */
+	if (isGenerator)
+		return function;
+	extern LLVMPassManagerRef phi_passManager;
+	LLVMRunFunctionPassManager(phi_passManager, function);
+	return function;
 }
 
-LLVMValueRef codegenFuncExpr (FunctionExpr *fe)
+static LLVMValueRef buildFunction (FunctionExpr *fe)
 {
 	ProtoExpr *pe = fe->proto->expr;
-	/* Test if function is Template */
-	if (pe->isTemplate)
-	{
-		defineNewTemplate(fe);
-		return NULL;
-	}
+	pe->isGenerator = anyName(fe->body, isYield);
 	/* Test if a function has been declared before */
 	LLVMValueRef function = LLVMGetNamedFunction(phi_module, pe->name);
 	if (function == NULL)
@@ -384,13 +2148,21 @@ LLVMValueRef codegenFuncExpr (FunctionExpr *fe)
 	}
 	else if (LLVMCountBasicBlocks(function) != 0)
 		return logError("Cannot redefine function. This definition will be ignored.", 0x2601);
+	setFloatingPointAttributes(function);
 	unsigned paramCount = LLVMCountParams(function);
-	if (paramCount != depth(pe->inArgs))
+	if (countArguments(function) != countValueParams(pe->inArgs))
 		return logError("Mismatch between prototype and definition!", 0x2602);
+	LLVMTypeRef funcType = LLVMGetElementType(LLVMTypeOf(function));
+	LLVMTypeRef returnType = LLVMGetReturnType(funcType);
+	if (pe->isGenerator != (LLVMGetTypeKind(returnType) == LLVMPointerTypeKind))
+		return logError("Generators and ordinary functions cannot be declared as each other.", 0x2B01);
 
 	/* Build function body recursively */
+	clearStack(&unsignedConstants, NULL);
 	LLVMBasicBlockRef bodyBlock = LLVMAppendBasicBlockInContext(phi_context, function, "bodyEntry");
 	LLVMPositionBuilderAtEnd(phi_builder, bodyBlock);
+	if (pe->isGenerator)
+		beginGenerator(function, LLVMGetElementType(returnType));
 
 	/* Give names to the function arguments. That way we can refer back to them in the function body. */
 	LLVMValueRef args[paramCount];
@@ -398,11 +2170,33 @@ LLVMValueRef codegenFuncExpr (FunctionExpr *fe)
 	stack *argStack = pe->inArgs;
 	for (int i = paramCount-1; i >= 0; i--)
 	{
-		LLVMTypeRef argType = getAppropriateType(argStack->misc);
-		char *name = argStack->item;
+		while (((Param*)argStack->item)->type == NULL)
+			argStack = argStack->next;
+		Param *param = argStack->item;
+		LLVMTypeRef argType = getAppropriateType(param->type);
+		char *name = param->name;
 		LLVMValueRef v = args[i];
-		LLVMSetValueName2(v, name, strlen(name));
-		LLVMValueRef alloca = CreateEntryPointAlloca(function, argType, name);
+		if (isSliceType(argType))
+		{
+			/* The language keeps slices from escaping, and a slice that is written must not overlap any
+			 * other slice passed to the same call. A generator keeps its arguments beyond the first call. */
+			if (!pe->isGenerator)
+			{
+				addParamAttribute(function, i-1, "noalias");
+				addParamAttribute(function, i-1, "nocapture");
+			}
+			char lengthName[strlen(name) + 8];
+			sprintf(lengthName, "%s.length", name);
+			LLVMSetValueName2(v, lengthName, strlen(lengthName));
+			v = LLVMBuildInsertValue(phi_builder, LLVMGetUndef(argType), args[--i], 0, "slice");
+			v = LLVMBuildInsertValue(phi_builder, v, args[i+1], 1, "slice");
+			LLVMSetValueName2(args[i], name, strlen(name));
+		}
+		else
+			LLVMSetValueName2(v, name, strlen(name));
+		LLVMValueRef alloca = CreateVariable(argType, 0, name);
+		if (isUnsignedType(param->type))
+			markUnsigned(alloca);
 		LLVMBuildStore(phi_builder, v, alloca);
 		namesInScope = push(alloca, scope, namesInScope);
 		argStack = argStack->next;
@@ -411,11 +2205,14 @@ LLVMValueRef codegenFuncExpr (FunctionExpr *fe)
 	/* Optionally, create variables for all named output parameters */
 	argStack = pe->outArgs;
 	do {
-		LLVMTypeRef argType = getAppropriateType(argStack->misc);
-		char *name = argStack->item;
+		Param *param = argStack->item;
+		LLVMTypeRef argType = getAppropriateType(param->type);
+		char *name = param->name;
 		if (name != NULL)
 		{
-			LLVMValueRef alloca = CreateEntryPointAlloca(function, argType, name);
+			LLVMValueRef alloca = CreateVariable(argType, 0, name);
+			if (isUnsignedType(param->type))
+				markUnsigned(alloca);
 			namesInScope = push(alloca, scope, namesInScope);
 		}
 		argStack = argStack->next;
@@ -427,6 +2224,18 @@ LLVMValueRef codegenFuncExpr (FunctionExpr *fe)
 		LLVMDeleteFunction(function);
 		return NULL;
 	}
+	/* A function returns only after all of its spawned calls have finished */
+	syncSpawns();
+	if (pe->isGenerator)
+	{
+		if (fe->ret != NULL)
+		{
+			LLVMDeleteFunction(function);
+			return logError("Generators cannot return values with \"from\".", 0x2B04);
+		}
+		endGenerator(function);
+		return finishFunction(function, 1);
+	}
 	LLVMValueRef ret;
 	if (fe->ret != NULL)
 	{
@@ -437,12 +2246,11 @@ LLVMValueRef codegenFuncExpr (FunctionExpr *fe)
 			LLVMDeleteFunction(function);
 			return NULL;
 		}
+		syncSpawns();
 	}
 	else
 		ret = body; /* Use the last value of the body as default return value */
-	LLVMTypeRef funcType = LLVMGetElementType(LLVMTypeOf(function));
-	LLVMTypeRef returnType = LLVMGetReturnType(funcType);
-	if (LLVMGetTypeKind(returnType) == LLVMStructTypeKind)
+	if (isMultipleValues(returnType))
 	{
 		unsigned countOfRetValues = LLVMCountStructElementTypes(returnType);
 		if (valueStack == NULL || countOfRetValues < depth(valueStack))
@@ -453,62 +2261,268 @@ LLVMValueRef codegenFuncExpr (FunctionExpr *fe)
 		LLVMValueRef retValues[countOfRetValues];
 		for (int i = countOfRetValues-1; i >= 0; i--)
 		{
-			retValues[i] = pop(&valueStack);
+			retValues[i] = popValue(&valueStack);
 			if (retValues[i] == NULL)
 			{
 				LLVMDeleteFunction(function);
 				return NULL;
 			}
+			retValues[i] = adaptConstant(retValues[i], LLVMStructGetTypeAtIndex(returnType, i));
 		}
+		releaseHeapArrays();
 		LLVMBuildAggregateRet(phi_builder, retValues, countOfRetValues);
 	}
-	else if (valueStack != NULL)
-		LLVMBuildRet(phi_builder, pop(&valueStack));
 	else
-		LLVMBuildRet(phi_builder, ret);
-	int verified = LLVMVerifyFunction(function, LLVMPrintMessageAction);
-	if (verified == 1)
 	{
-		LLVMDeleteFunction(function);
+		if (valueStack != NULL)
+			ret = popValue(&valueStack);
+		releaseHeapArrays();
+		LLVMBuildRet(phi_builder, adaptConstant(ret, returnType));
+	}
+	return finishFunction(function, 0);
+}
+
+LLVMValueRef codegenFuncExpr (FunctionExpr *fe)
+{
+	ProtoExpr *pe = fe->proto->expr;
+	/* Test if function is Template */
+	if (pe->isTemplate)
+	{
+		defineNewTemplate(fe);
 		return NULL;
 	}
-	extern LLVMPassManagerRef phi_passManager;
-	LLVMRunFunctionPassManager(phi_passManager, function);
+	/* Templates may be instantiated while another function is built, which keeps its own spawned calls and coroutine */
+	ParallelState outer = saveParallelState();
+	stack *outerHeapArrays = heapArrays;
+	int outerFpFlags = phi_fpFlags;
+	heapArrays = NULL;
+	phi_fpFlags = pe->isStrict ? 0 : fpMode;
+	LLVMValueRef function = buildFunction(fe);
+	clearStack(&heapArrays, NULL);
+	restoreParallelState(outer);
+	heapArrays = outerHeapArrays;
+	phi_fpFlags = outerFpFlags;
 	return function;
 }
 
 LLVMValueRef codegenTemplateExpr (TemplateExpr *te)
 {
-	LLVMBasicBlockRef currentInsertBlock = LLVMGetInsertBlock(phi_builder);
-	stack *localValues = valueStack;
-	valueStack = NULL;
-	LLVMValueRef templateFunction = tryGetTemplate(te->name, te->type_name);
-	valueStack = localValues;
-	LLVMPositionBuilderAtEnd(phi_builder, currentInsertBlock);
+	if (strncmp(te->name, "load", 5) == 0 && !isTemplateName(te->name))
+		return codegenMatrixLoad(te->args);
+	LLVMValueRef templateFunction = instantiateTemplate(te->name, te->args);
 	if (templateFunction == NULL)
-		return logError("Unknown template name.", 0x2801);
+		return NULL;
 	return codegenCallExpr(templateFunction);
 }
 
-LLVMValueRef codegenCondExpr (CondExpr *ce)
+LLVMValueRef codegenSpawnExpr (SpawnExpr *se)
 {
-	LLVMValueRef cond = codegen(ce->Cond, 0);
-	if (cond == NULL)
+	LLVMValueRef function;
+	if (se->call->expr_type == expr_template)
+	{
+		TemplateExpr *te = se->call->expr;
+		function = instantiateTemplate(te->name, te->args);
+	}
+	else
+	{
+		IdentExpr *ie = se->call->expr;
+		function = LLVMGetNamedFunction(phi_module, ie->name);
+		if (function == NULL && isTemplateName(ie->name))
+			function = instantiateTemplate(ie->name, NULL);
+		else if (function == NULL)
+			return logError("Only calls to known functions can be spawned.", 0x2A01);
+	}
+	if (function == NULL)
+		return NULL;
+
+	if (countArguments(function) > depth(valueStack))
+		return logError("Insufficient number of arguments given to spawned function!", 0x2A02);
+	unsigned numArgs = LLVMCountParams(function);
+	LLVMTypeRef returnType = LLVMGetReturnType(LLVMGetElementType(LLVMTypeOf(function)));
+	unsigned numResults = 1;
+	if (isMultipleValues(returnType))
+		numResults = LLVMCountStructElementTypes(returnType);
+	else if (LLVMGetTypeKind(returnType) == LLVMVoidTypeKind)
+		numResults = 0;
+
+	/* Gather all arguments from the value stack */
+	LLVMValueRef argValues[numArgs];
+	if (!popArguments(function, argValues))
+		return NULL;
+	LLVMValueRef frame = buildSpawn(function, argValues, numResults);
+	if (frame == NULL)
 		return NULL;
 
-	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
+	/* Push the results in the same order as a call would */
+	LLVMValueRef result = NULL;
+	for (int i = numResults-1; i >= 0; i--)
+	{
+		result = LLVMBuildStructGEP(phi_builder, frame, numArgs+i, "spawnresult");
+		pushValue(result, 2);
+	}
+	if (result == NULL)
+		return LLVMGetUndef(LLVMVoidTypeInContext(phi_context));
+	return result;
+}
+
+static int isSpeculatable (Expr *e, unsigned *budget)
+{
+	if (e == NULL || *budget == 0)
+		return 0;
+	(*budget)--;
+	switch (e->expr_type)
+	{
+		case expr_literal:
+			return 1;
+		case expr_ident:
+		{
+			/* Only plain reads of existing variables are free of side effects */
+			IdentExpr *ie = e->expr;
+			if (ie->flag != id_any && ie->flag != id_var)
+				return 0;
+			if (strncmp(ie->name, "store", 6) == 0)
+				return 0;
+			return lookupVariable(ie->name) != NULL;
+		}
+		case expr_binop:
+		{
+			/* Division and Modulo may trap, so they must stay behind a branch */
+			BinaryExpr *be = e->expr;
+			if (be->op == '/' || be->op == '%')
+				return 0;
+			return isSpeculatable(be->LHS, budget) && isSpeculatable(be->RHS, budget);
+		}
+		default:
+			return 0;
+	}
+}
+
+static LLVMValueRef buildTruthValue (LLVMValueRef cond, const char *name)
+{
 	LLVMTypeRef condtype = LLVMTypeOf(cond);
-	if (condtype != booltype)
+	LLVMTypeKind condkind = LLVMGetTypeKind(condtype);
+	if (condkind == LLVMVectorTypeKind)
 	{
-		LLVMTypeKind condkind = LLVMGetTypeKind(condtype);
-		LLVMValueRef zero = LLVMConstNull(condtype);
-		if (condkind == LLVMDoubleTypeKind)
-			cond = LLVMBuildFCmp(phi_builder, LLVMRealONE, cond, zero, "ifcond");
-		else
-			return logError("Incompatible Type in conditional expression.", 0x2701);
+		condtype = LLVMGetElementType(condtype);
+		condkind = LLVMGetTypeKind(condtype);
+	}
+	if (condtype == LLVMInt1TypeInContext(phi_context))
+		return cond;
+	if (isFloatingType(condtype))
+		return LLVMBuildFCmp(phi_builder, LLVMRealONE, cond, LLVMConstNull(LLVMTypeOf(cond)), name);
+	return logError("Incompatible Type in conditional expression.", 0x2701);
+}
+
+/* Both branches of an if must leave the same number of values of the same types behind. Returns -1 otherwise. */
+static int matchBranchValues (stack *trueValues, stack *falseValues)
+{
+	int count = depth(trueValues);
+	if (count != (int)depth(falseValues))
+	{
+		logError("Both branches of an if must leave the same number of values behind.", 0x2705);
+		return -1;
+	}
+	for (; trueValues != NULL; trueValues = trueValues->next, falseValues = falseValues->next)
+	{
+		trueValues->item = adaptConstant(trueValues->item, LLVMTypeOf(falseValues->item));
+		falseValues->item = adaptConstant(falseValues->item, LLVMTypeOf(trueValues->item));
+		if (LLVMTypeOf(trueValues->item) != LLVMTypeOf(falseValues->item))
+		{
+			logError("Both branches of an if must leave values of the same types behind.", 0x2706);
+			return -1;
+		}
+	}
+	return count;
+}
+
+/* Drop the values left by the branches of an if and restore the values from before it */
+static LLVMValueRef abandonBranches (stack *outerValues, stack *trueValues, stack *falseValues)
+{
+	clearStack(&trueValues, NULL);
+	clearStack(&falseValues, NULL);
+	valueStack = outerValues;
+	return NULL;
+}
+
+LLVMValueRef codegenSelectExpr (LLVMValueRef cond, CondExpr *ce, stack *outerValues)
+{
+	LLVMValueRef trueVal = codegen(ce->True, 1);
+	stack *trueValues = valueStack;
+	valueStack = NULL;
+	LLVMValueRef falseVal = codegen(ce->False, 1);
+	stack *falseValues = valueStack;
+	valueStack = outerValues;
+	if (trueVal == NULL || falseVal == NULL)
+		return abandonBranches(outerValues, trueValues, falseValues);
+
+	int isVectorCond = (LLVMGetTypeKind(LLVMTypeOf(cond)) == LLVMVectorTypeKind);
+	if (isVectorCond)
+	{
+		/* Scalars are used for every lane */
+		unsigned size = LLVMGetVectorSize(LLVMTypeOf(cond));
+		for (stack *s = trueValues; s != NULL; s = s->next)
+			if (LLVMGetTypeKind(LLVMTypeOf(s->item)) != LLVMVectorTypeKind)
+				s->item = buildSplat(s->item, size);
+		for (stack *s = falseValues; s != NULL; s = s->next)
+			if (LLVMGetTypeKind(LLVMTypeOf(s->item)) != LLVMVectorTypeKind)
+				s->item = buildSplat(s->item, size);
+	}
+	int count = matchBranchValues(trueValues, falseValues);
+	if (count < 0)
+		return abandonBranches(outerValues, trueValues, falseValues);
+	if (count == 0)
+		return LLVMGetUndef(LLVMVoidTypeInContext(phi_context));
+	LLVMValueRef trueVals[count], falseVals[count];
+	int isUnsignedVal[count];
+	for (int i = count-1; i >= 0; i--)
+	{
+		isUnsignedVal[i] = (trueValues->misc | falseValues->misc) & UNSIGNED_VALUE;
+		trueVals[i] = popValue(&trueValues);
+		falseVals[i] = popValue(&falseValues);
+	}
+
+	LLVMValueRef val = NULL;
+	for (int i = 0; i < count; i++)
+	{
+		LLVMTypeRef type = LLVMTypeOf(trueVals[i]);
+		if (isVectorCond && (LLVMGetTypeKind(type) != LLVMVectorTypeKind
+				|| LLVMGetVectorSize(type) != LLVMGetVectorSize(LLVMTypeOf(cond))))
+			return logError("Values selected by a vector condition must be vectors of the same size.", 0x2703);
+		val = LLVMBuildSelect(phi_builder, cond, trueVals[i], falseVals[i], "iftmp");
+		if (isUnsignedVal[i])
+			markUnsigned(val);
+		pushValue(val, 1);
 	}
+	return val;
+}
+
+
+LLVMValueRef codegenCondExpr (CondExpr *ce)
+{
+	if (branchesNeedSync(ce))
+		syncSpawns();
+	stack *outerValues = valueStack;
+	valueStack = NULL;
+	LLVMValueRef cond = codegen(ce->Cond, 0);
+	clearStack(&valueStack, NULL);
+	valueStack = outerValues;
+	if (cond == NULL)
+		return NULL;
+	cond = buildTruthValue(cond, "ifcond");
+	if (cond == NULL)
+		return NULL;
+
+	/* Small branches without side effects are evaluated unconditionally and merged with a select */
+	unsigned budget = selectThreshold;
+	valueStack = NULL;
+	if (ce->False != NULL && isSpeculatable(ce->True, &budget) && isSpeculatable(ce->False, &budget))
+		return codegenSelectExpr(cond, ce, outerValues);
+	valueStack = outerValues;
+	if (LLVMGetTypeKind(LLVMTypeOf(cond)) == LLVMVectorTypeKind)
+		return logError("Vector conditions require both branches to be small and free of side effects.", 0x2702);
 
 	/* Obtain the current function being built */
+	valueStack = NULL;
 	LLVMBasicBlockRef PreviousBlock = LLVMGetInsertBlock(phi_builder);
 	LLVMValueRef fn = LLVMGetBasicBlockParent(PreviousBlock);
 
@@ -519,53 +2533,87 @@ LLVMValueRef codegenCondExpr (CondExpr *ce)
 	LLVMBuildCondBr(phi_builder, cond, TrueBlock, FalseBlock);
 
 	/* Build the TrueBlock */
-	clearStack(&valueStack, NULL);
 	LLVMPositionBuilderAtEnd(phi_builder, TrueBlock);
+	SpawnState outerSpawns = enterSpawnScope();
+	enterBranch();
 	LLVMValueRef trueVal = codegen(ce->True, 1);
+	leaveBranch();
 	if (trueVal == NULL)
-		return NULL;
+		return abandonBranches(outerValues, valueStack, NULL);
+	leaveSpawnScope(outerSpawns);
+	LLVMBasicBlockRef TrueEnd = LLVMGetInsertBlock(phi_builder);
 	LLVMBuildBr(phi_builder, MergeBlock);
+	stack *trueValues = valueStack;
+	valueStack = NULL;
 
 	/* Build the FalseBlock */
-	clearStack(&valueStack, NULL);
 	LLVMAppendExistingBasicBlock(fn, FalseBlock);
 	LLVMPositionBuilderAtEnd(phi_builder, FalseBlock);
 	if (ce->False != NULL)
 	{
+		outerSpawns = enterSpawnScope();
+		enterBranch();
 		LLVMValueRef falseVal = codegen(ce->False, 1);
+		leaveBranch();
 		if (falseVal == NULL)
-			return NULL;
+			return abandonBranches(outerValues, trueValues, valueStack);
+		leaveSpawnScope(outerSpawns);
 	}
+	LLVMBasicBlockRef FalseEnd = LLVMGetInsertBlock(phi_builder);
 	LLVMBuildBr(phi_builder, MergeBlock);
+	stack *falseValues = valueStack;
 
 	/* Reunite the branches */
-	clearStack(&valueStack, NULL);
+	valueStack = outerValues;
 	LLVMAppendExistingBasicBlock(fn, MergeBlock);
 	LLVMPositionBuilderAtEnd(phi_builder, MergeBlock);
 
-	LLVMTypeRef voidType = LLVMVoidTypeInContext(phi_context);
-	LLVMValueRef voidVal = LLVMGetUndef(voidType);
-	return voidVal;
+	/* Values left behind by a branch without alternative are dropped */
+	if (ce->False == NULL)
+	{
+		abandonBranches(outerValues, trueValues, falseValues);
+		return LLVMGetUndef(LLVMVoidTypeInContext(phi_context));
+	}
+
+	/* Merge the values left behind by both branches with phi nodes */
+	int count = matchBranchValues(trueValues, falseValues);
+	if (count < 0)
+		return abandonBranches(outerValues, trueValues, falseValues);
+	if (count == 0)
+		return LLVMGetUndef(LLVMVoidTypeInContext(phi_context));
+	LLVMValueRef trueVals[count], falseVals[count];
+	int isUnsignedVal[count];
+	for (int i = count-1; i >= 0; i--)
+	{
+		isUnsignedVal[i] = (trueValues->misc | falseValues->misc) & UNSIGNED_VALUE;
+		trueVals[i] = popValue(&trueValues);
+		falseVals[i] = popValue(&falseValues);
+	}
+
+	LLVMValueRef val = NULL;
+	for (int i = 0; i < count; i++)
+	{
+		val = LLVMBuildPhi(phi_builder, LLVMTypeOf(trueVals[i]), "iftmp");
+		LLVMAddIncoming(val, &trueVals[i], &TrueEnd, 1);
+		LLVMAddIncoming(val, &falseVals[i], &FalseEnd, 1);
+		if (isUnsignedVal[i])
+			markUnsigned(val);
+		pushValue(val, 1);
+	}
+	return val;
 }
 
 LLVMValueRef codegenLoopExpr (LoopExpr *le)
 {
+	syncSpawns();
 	LLVMValueRef cond = codegen(le->Cond, 0);
 	if (cond == NULL)
 		return NULL;
-
-	LLVMTypeRef booltype = LLVMInt1TypeInContext(phi_context);
-	LLVMTypeRef condtype = LLVMTypeOf(cond);
-	LLVMValueRef zero = NULL;
-	if (condtype != booltype)
-	{
-		LLVMTypeKind condkind = LLVMGetTypeKind(condtype);
-		zero = LLVMConstNull(condtype);
-		if (condkind == LLVMDoubleTypeKind)
-			cond = LLVMBuildFCmp(phi_builder, LLVMRealONE, cond, zero, "loopcond");
-		else
-			return logError("Incompatible Type in conditional expression.", 0x2701);
-	}
+	if (LLVMGetTypeKind(LLVMTypeOf(cond)) == LLVMVectorTypeKind)
+		return logError("Cannot use a vector as loop condition.", 0x2704);
+	cond = buildTruthValue(cond, "loopcond");
+	if (cond == NULL)
+		return NULL;
 
 	/* Obtain the current function being built */
 	LLVMBasicBlockRef PreviousBlock = LLVMGetInsertBlock(phi_builder);
@@ -580,14 +2628,21 @@ LLVMValueRef codegenLoopExpr (LoopExpr *le)
 	/* Build the Loop Body */
 	clearStack(&valueStack, NULL);
 	LLVMPositionBuilderAtEnd(phi_builder, BodyBlock);
+	SpawnState outerSpawns = enterSpawnLoop();
+	enterBranch();
 	LLVMValueRef bodyVal = codegen(le->Body, 1);
+	leaveBranch();
 	if (bodyVal == NULL)
 		return NULL;
+	stack *spawnSites = leaveSpawnLoop(outerSpawns, le->Body, le->Cond);
 
 	/* Rebuild the condition at the end of the Loop Body */
 	cond = codegen(le->Cond, 0);
-	if (zero != NULL)
-		LLVMBuildFCmp(phi_builder, LLVMRealONE, cond, zero, "loopcond");
+	if (cond == NULL)
+		return NULL;
+	cond = buildTruthValue(cond, "loopcond");
+	if (cond == NULL)
+		return NULL;
 	LLVMBuildCondBr(phi_builder, cond, BodyBlock, MergeBlock);
 
 	/* Build the Else Block */
@@ -596,9 +2651,211 @@ LLVMValueRef codegenLoopExpr (LoopExpr *le)
 	LLVMPositionBuilderAtEnd(phi_builder, ElseBlock);
 	if (le->Else != NULL)
 	{
+		enterBranch();
 		LLVMValueRef falseVal = codegen(le->Else, 1);
+		leaveBranch();
+		if (falseVal == NULL)
+			return NULL;
+		syncSpawns();
+	}
+	LLVMBuildBr(phi_builder, MergeBlock);
+
+	/* Reunite Branches */
+	clearStack(&valueStack, NULL);
+	LLVMAppendExistingBasicBlock(fn, MergeBlock);
+	LLVMPositionBuilderAtEnd(phi_builder, MergeBlock);
+	syncSpawnLoop(&spawnSites);
+
+	LLVMTypeRef voidType = LLVMVoidTypeInContext(phi_context);
+	LLVMValueRef voidVal = LLVMGetUndef(voidType);
+	return voidVal;
+}
+
+static LLVMMetadataRef loopHintNode (const char *name, LLVMValueRef value)
+{
+	LLVMMetadataRef ops[2];
+	ops[0] = LLVMMDStringInContext2(phi_context, name, strlen(name));
+	if (value == NULL)
+		return LLVMMDNodeInContext2(phi_context, ops, 1);
+	ops[1] = LLVMValueAsMetadata(value);
+	return LLVMMDNodeInContext2(phi_context, ops, 2);
+}
+
+static void attachLoopHints (LLVMValueRef latch, ForExpr *fe)
+{
+	LLVMTypeRef i1 = LLVMInt1TypeInContext(phi_context);
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(phi_context);
+	LLVMMetadataRef ops[6];
+	unsigned count = 1;
+
+	/* Enabling the vectorizer explicitly allows it to reorder reductions over floating point numbers */
+	if (fe->vectorize >= 0 || fe->interleave >= 0 || (phi_fpFlags & fp_reassoc))
+		ops[count++] = loopHintNode("llvm.loop.vectorize.enable", LLVMConstInt(i1, 1, 0));
+	if (fe->vectorize > 0)
+		ops[count++] = loopHintNode("llvm.loop.vectorize.width", LLVMConstInt(i32, fe->vectorize, 0));
+	if (fe->interleave > 0)
+		ops[count++] = loopHintNode("llvm.loop.interleave.count", LLVMConstInt(i32, fe->interleave, 0));
+	if (fe->unroll == 0)
+		ops[count++] = loopHintNode("llvm.loop.unroll.enable", NULL);
+	else if (fe->unroll > 0)
+		ops[count++] = loopHintNode("llvm.loop.unroll.count", LLVMConstInt(i32, fe->unroll, 0));
+	if (count == 1)
+		return;
+
+	/* A loop ID must refer to itself, so it is built around a placeholder which is replaced afterwards */
+	ops[0] = LLVMTemporaryMDNode(phi_context, NULL, 0);
+	LLVMMetadataRef loopID = LLVMMDNodeInContext2(phi_context, ops, count);
+	LLVMMetadataReplaceAllUsesWith(ops[0], loopID);
+	unsigned kind = LLVMGetMDKindIDInContext(phi_context, "llvm.loop", 9);
+	LLVMSetMetadata(latch, kind, LLVMMetadataAsValue(phi_context, loopID));
+}
+
+static int codegenLoopBounds (ForExpr *fe, LLVMValueRef bounds[3], LLVMIntPredicate *pred)
+{
+	LLVMValueRef start = codegenOperand(fe->Start);
+	LLVMValueRef end = codegenOperand(fe->End);
+	if (start == NULL || end == NULL)
+		return 0;
+	start = adaptConstant(start, LLVMTypeOf(end));
+	end = adaptConstant(end, LLVMTypeOf(start));
+	LLVMTypeRef vartype = LLVMTypeOf(start);
+	if (LLVMGetTypeKind(vartype) != LLVMIntegerTypeKind || vartype == LLVMInt1TypeInContext(phi_context))
+	{
+		logError("Bounds of a counted loop must be integers.", 0x2901);
+		return 0;
+	}
+	if (LLVMTypeOf(end) != vartype)
+	{
+		logError("Both bounds of a counted loop must have the same type.", 0x2902);
+		return 0;
+	}
+	LLVMValueRef step = LLVMConstInt(vartype, 1, 1);
+	if (fe->Step != NULL)
+	{
+		step = codegenOperand(fe->Step);
+		if (step == NULL)
+			return 0;
+		step = adaptConstant(step, vartype);
+		if (LLVMTypeOf(step) != vartype)
+		{
+			logError("Step size of a counted loop must have the same type as its bounds.", 0x2903);
+			return 0;
+		}
+		/* The direction of the loop decides the comparison with the upper bound */
+		if (!LLVMIsAConstantInt(step))
+		{
+			logError("Step size of a counted loop must be a constant.", 0x2909);
+			return 0;
+		}
+	}
+	/* The upper bound is exclusive */
+	int isUnsignedLoop = isUnsigned(start) || isUnsigned(end);
+	*pred = isUnsignedLoop ? LLVMIntULT : LLVMIntSLT;
+	if (LLVMConstIntGetSExtValue(step) < 0)
+		*pred = isUnsignedLoop ? LLVMIntUGT : LLVMIntSGT;
+	else if (LLVMConstIntGetSExtValue(step) == 0)
+	{
+		logError("Step size of a counted loop cannot be zero.", 0x2904);
+		return 0;
+	}
+	bounds[0] = start;
+	bounds[1] = end;
+	bounds[2] = step;
+	return 1;
+}
+
+/* The induction variable has not reached the end yet in the body. Its next value stays within the type, if the step
+ * passes the end by no more than the type leaves room for beyond it, which is certain for steps of size one. */
+static LLVMValueRef buildLoopStep (LLVMValueRef var, LLVMValueRef end, LLVMValueRef step, LLVMIntPredicate pred)
+{
+	int isUnsignedLoop = pred == LLVMIntULT || pred == LLVMIntUGT;
+	int isDownwards = pred == LLVMIntSGT || pred == LLVMIntUGT;
+	long long size = LLVMConstIntGetSExtValue(step);
+	unsigned long long excess = (size < 0 ? 0ULL - (unsigned long long)size : (unsigned long long)size) - 1;
+	int staysInRange = excess == 0;
+	if (!staysInRange && LLVMIsAConstantInt(end))
+	{
+		/* Bit patterns of the type's width subtract without overflowing */
+		unsigned width = LLVMGetIntTypeWidth(LLVMTypeOf(end));
+		unsigned long long mask = width < 64 ? (1ULL << width) - 1 : ~0ULL;
+		unsigned long long bound = LLVMConstIntGetZExtValue(end);
+		unsigned long long room;
+		if (isDownwards)
+			room = (bound - (isUnsignedLoop ? 0 : (mask >> 1) + 1)) & mask;
+		else
+			room = ((isUnsignedLoop ? mask : mask >> 1) - bound) & mask;
+		staysInRange = excess <= room;
+	}
+	if (!staysInRange)
+		return LLVMBuildAdd(phi_builder, var, step, "nextvar");
+	if (isUnsignedLoop && isDownwards)
+		return LLVMBuildNUWSub(phi_builder, var, LLVMConstNeg(step), "nextvar");
+	if (isUnsignedLoop)
+		return LLVMBuildNUWAdd(phi_builder, var, step, "nextvar");
+	return LLVMBuildNSWAdd(phi_builder, var, step, "nextvar");
+}
+
+LLVMValueRef buildCountedLoop (ForExpr *fe, LLVMValueRef bounds[3], LLVMIntPredicate pred, Expr *Else)
+{
+	LLVMValueRef start = bounds[0], end = bounds[1], step = bounds[2];
+	LLVMTypeRef vartype = LLVMTypeOf(start);
+
+	/* Obtain the current function being built */
+	LLVMBasicBlockRef PreviousBlock = LLVMGetInsertBlock(phi_builder);
+	LLVMValueRef fn = LLVMGetBasicBlockParent(PreviousBlock);
+
+	/* Create new Blocks for Body, Else and the Merge. With bounds checks, the indexes of all iterations may be
+	 * checked in a block before the body. */
+	LLVMBasicBlockRef EntryBlock = PreviousBlock;
+	if (boundsChecking())
+		EntryBlock = LLVMAppendBasicBlockInContext(phi_context, fn, "CheckBounds");
+	LLVMBasicBlockRef BodyBlock = LLVMAppendBasicBlockInContext(phi_context, fn, "ForBody");
+	LLVMBasicBlockRef ElseBlock = LLVMCreateBasicBlockInContext(phi_context, "ElseBlock");
+	LLVMBasicBlockRef MergeBlock = LLVMCreateBasicBlockInContext(phi_context, "AfterFor");
+	LLVMValueRef guard = LLVMBuildICmp(phi_builder, pred, start, end, "forguard");
+	LLVMBuildCondBr(phi_builder, guard, EntryBlock == PreviousBlock ? BodyBlock : EntryBlock, ElseBlock);
+	if (EntryBlock != PreviousBlock)
+	{
+		LLVMPositionBuilderAtEnd(phi_builder, EntryBlock);
+		LLVMBuildBr(phi_builder, BodyBlock);
+	}
+
+	/* The induction variable is a phi node, which is visible by name in the loop body only */
+	clearStack(&valueStack, NULL);
+	LLVMPositionBuilderAtEnd(phi_builder, BodyBlock);
+	LLVMValueRef var = LLVMBuildPhi(phi_builder, vartype, fe->var);
+	if (pred == LLVMIntULT || pred == LLVMIntUGT)
+		markUnsigned(var);
+	LLVMAddIncoming(var, &start, &EntryBlock, 1);
+	namesInScope = push(var, scope+1, namesInScope);
+	enterCountedLoop(var, bounds, pred, EntryBlock == PreviousBlock ? NULL : EntryBlock);
+	SpawnState outerSpawns = enterSpawnLoop();
+	LLVMValueRef bodyVal = codegen(fe->Body, 1);
+	leaveCountedLoop(var);
+	if (bodyVal == NULL)
+		return NULL;
+	stack *spawnSites = leaveSpawnLoop(outerSpawns, fe->Body, NULL);
+
+	/* Step the induction variable at the end of the Loop Body */
+	LLVMBasicBlockRef LatchBlock = LLVMGetInsertBlock(phi_builder);
+	LLVMValueRef next = buildLoopStep(var, end, step, pred);
+	LLVMAddIncoming(var, &next, &LatchBlock, 1);
+	LLVMValueRef cond = LLVMBuildICmp(phi_builder, pred, next, end, "forcond");
+	LLVMValueRef latch = LLVMBuildCondBr(phi_builder, cond, BodyBlock, MergeBlock);
+	attachLoopHints(latch, fe);
+
+	/* Build the Else Block */
+	clearStack(&valueStack, NULL);
+	LLVMAppendExistingBasicBlock(fn, ElseBlock);
+	LLVMPositionBuilderAtEnd(phi_builder, ElseBlock);
+	if (Else != NULL)
+	{
+		enterBranch();
+		LLVMValueRef falseVal = codegen(Else, 1);
+		leaveBranch();
 		if (falseVal == NULL)
 			return NULL;
+		syncSpawns();
 	}
 	LLVMBuildBr(phi_builder, MergeBlock);
 
@@ -606,6 +2863,98 @@ LLVMValueRef codegenLoopExpr (LoopExpr *le)
 	clearStack(&valueStack, NULL);
 	LLVMAppendExistingBasicBlock(fn, MergeBlock);
 	LLVMPositionBuilderAtEnd(phi_builder, MergeBlock);
+	syncSpawnLoop(&spawnSites);
+
+	LLVMTypeRef voidType = LLVMVoidTypeInContext(phi_context);
+	LLVMValueRef voidVal = LLVMGetUndef(voidType);
+	return voidVal;
+}
+
+LLVMValueRef codegenForExpr (ForExpr *fe)
+{
+	syncSpawns();
+	LLVMValueRef bounds[3];
+	LLVMIntPredicate pred;
+	if (!codegenLoopBounds(fe, bounds, &pred))
+		return NULL;
+	if (fe->parallel)
+		return codegenParallelForExpr(fe, bounds, pred);
+	if (fe->reductions != NULL)
+		return logError("Reductions are only available in parallel loops.", 0x2905);
+	return buildCountedLoop(fe, bounds, pred, fe->Else);
+}
+
+LLVMValueRef codegenForEachExpr (ForEachExpr *fe)
+{
+	syncSpawns();
+	LLVMValueRef handle = codegenOperand(fe->Source);
+	if (handle == NULL)
+		return NULL;
+	LLVMTypeRef handleType = LLVMTypeOf(handle);
+	if (LLVMGetTypeKind(handleType) != LLVMPointerTypeKind)
+		return logError("Expected a call to a generator after \"in\".", 0x2B03);
+	LLVMTypeRef yieldType = LLVMGetElementType(handleType);
+	int yieldsUnsigned = isUnsigned(handle);
+	LLVMTypeRef i1 = LLVMInt1TypeInContext(phi_context);
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(phi_context);
+	LLVMTypeRef i8ptr = LLVMPointerType(LLVMInt8TypeInContext(phi_context), 0);
+	handle = LLVMBuildBitCast(phi_builder, handle, i8ptr, "handle");
+
+	/* Obtain the current function being built */
+	LLVMBasicBlockRef PreviousBlock = LLVMGetInsertBlock(phi_builder);
+	LLVMValueRef fn = LLVMGetBasicBlockParent(PreviousBlock);
+
+	/* Create new Blocks for Body, Else and the Merge. The generator has already run up to its first value. */
+	LLVMBasicBlockRef BodyBlock = LLVMAppendBasicBlockInContext(phi_context, fn, "ForBody");
+	LLVMBasicBlockRef ElseBlock = LLVMCreateBasicBlockInContext(phi_context, "ElseBlock");
+	LLVMBasicBlockRef MergeBlock = LLVMCreateBasicBlockInContext(phi_context, "AfterFor");
+	LLVMValueRef done = callIntrinsic("llvm.coro.done", NULL, 0, &handle, 1, "done");
+	LLVMBuildCondBr(phi_builder, done, ElseBlock, BodyBlock);
+
+	/* The loop variable is the value yielded last, which is visible by name in the loop body only */
+	clearStack(&valueStack, NULL);
+	LLVMPositionBuilderAtEnd(phi_builder, BodyBlock);
+	LLVMValueRef promiseArgs[3] = {handle, LLVMConstInt(i32, promiseAlignment(yieldType), 0), LLVMConstInt(i1, 0, 0)};
+	LLVMValueRef promise = callIntrinsic("llvm.coro.promise", NULL, 0, promiseArgs, 3, "promise");
+	promise = LLVMBuildBitCast(phi_builder, promise, handleType, "promise");
+	LLVMValueRef var = LLVMBuildLoad(phi_builder, promise, fe->var);
+	if (yieldsUnsigned)
+		markUnsigned(var);
+	namesInScope = push(var, scope+1, namesInScope);
+	SpawnState outerSpawns = enterSpawnLoop();
+	enterBranch();
+	LLVMValueRef bodyVal = codegen(fe->Body, 1);
+	leaveBranch();
+	if (bodyVal == NULL)
+		return NULL;
+	stack *spawnSites = leaveSpawnLoop(outerSpawns, fe->Body, NULL);
+
+	/* Let the generator produce the next value */
+	callIntrinsic("llvm.coro.resume", NULL, 0, &handle, 1, "");
+	done = callIntrinsic("llvm.coro.done", NULL, 0, &handle, 1, "done");
+	LLVMBuildCondBr(phi_builder, done, MergeBlock, BodyBlock);
+
+	/* Build the Else Block */
+	clearStack(&valueStack, NULL);
+	LLVMAppendExistingBasicBlock(fn, ElseBlock);
+	LLVMPositionBuilderAtEnd(phi_builder, ElseBlock);
+	if (fe->Else != NULL)
+	{
+		enterBranch();
+		LLVMValueRef falseVal = codegen(fe->Else, 1);
+		leaveBranch();
+		if (falseVal == NULL)
+			return NULL;
+		syncSpawns();
+	}
+	LLVMBuildBr(phi_builder, MergeBlock);
+
+	/* Reunite Branches and release the generator */
+	clearStack(&valueStack, NULL);
+	LLVMAppendExistingBasicBlock(fn, MergeBlock);
+	LLVMPositionBuilderAtEnd(phi_builder, MergeBlock);
+	syncSpawnLoop(&spawnSites);
+	callIntrinsic("llvm.coro.destroy", NULL, 0, &handle, 1, "");
 
 	LLVMTypeRef voidType = LLVMVoidTypeInContext(phi_context);
 	LLVMValueRef voidVal = LLVMGetUndef(voidType);
@@ -647,6 +2996,18 @@ LLVMValueRef codegen (Expr *e, int newScope)
 		case expr_loop:
 			val = codegenLoopExpr(e->expr);
 			break;
+		case expr_for:
+			val = codegenForExpr(e->expr);
+			break;
+		case expr_spawn:
+			val = codegenSpawnExpr(e->expr);
+			break;
+		case expr_foreach:
+			val = codegenForEachExpr(e->expr);
+			break;
+		case expr_table:
+			val = codegenTableExpr(e->expr);
+			break;
 		default:
 			val = logError("Cannot generate IR for unrecognized expression type!", 0x2001);
 			break;
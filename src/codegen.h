@@ -2,8 +2,58 @@
 #define CODEGEN_H_
 
 #include "ast.h"
-#include <llvm-c/Types.h>
+#include <llvm-c/Core.h>
+#include "stack.h"
 
-LLVMTypeRef getAppropriateType (int typename);
+/* Floating-point optimisations, which may change the results of a computation */
+enum FloatingPointFlags
+{
+	fp_contract = 1,
+	fp_reassoc = 2,
+	fp_nonans = 4,
+	/* Assume neither infinities nor signed zeros */
+	fp_fast = 8
+};
+
+/* Libraries of vectorised math functions, which transcendental functions on vectors are mapped to */
+enum VectorLibrary
+{
+	veclib_none = 0,
+	veclib_libmvec,
+	veclib_svml
+};
+
+LLVMTypeRef getAppropriateType (TypeDesc *desc);
+int isUnsignedType (TypeDesc *desc);
+int isUnsigned (LLVMValueRef val);
+LLVMValueRef markUnsigned (LLVMValueRef val);
+LLVMValueRef markSigned (LLVMValueRef val);
+LLVMValueRef callIntrinsic (const char *name, LLVMTypeRef *overloads, unsigned numOverloads,
+		LLVMValueRef *args, unsigned numArgs, const char *resultName);
+LLVMValueRef getRuntimeFunction (const char *name, LLVMTypeRef retType, LLVMTypeRef *params, unsigned count);
+void setFloatingPointMode (int flags);
+void setVectorLibrary (int library);
+void setMaxStackArray (unsigned long long bytes);
+int isSliceType (LLVMTypeRef type);
+LLVMValueRef CreateEntryPointAlloca (LLVMValueRef func, LLVMTypeRef varType, const char *name);
+LLVMValueRef unchangedSource (LLVMValueRef val);
+LLVMValueRef constantTable (LLVMValueRef variable);
+int sliceArgument (LLVMValueRef val, LLVMTypeRef ptrType, LLVMValueRef *ptr, LLVMValueRef *length);
+LLVMValueRef buildOperator (int op, LLVMValueRef l, LLVMValueRef r);
+void setFloatingPointAttributes (LLVMValueRef function);
+LLVMValueRef lookupVariable (const char *name);
+stack* variablesInScope ();
+void declareVariable (LLVMValueRef variable);
+int isReadOnly (LLVMValueRef variable);
+LLVMValueRef CreateVariable (LLVMTypeRef varType, unsigned align, const char *name);
+void checkAllocations (LLVMValueRef function);
+void releaseHeapArrays ();
+void enterNestedFunction ();
+void leaveNestedFunction ();
+void clearValues ();
+int hasDeferredValues ();
+void loadDeferredValues ();
+int anyName (Expr *e, int (*match) (const char*));
+LLVMValueRef buildCountedLoop (ForExpr *fe, LLVMValueRef bounds[3], LLVMIntPredicate pred, Expr *Else);
 LLVMValueRef codegen (Expr *e, int newScope);
 #endif /* CODEGEN_H_ */
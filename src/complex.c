@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <string.h>
+#include <llvm-c/Core.h>
+#include "stack.h"
+#include "ast.h"
+#include "complex.h"
+#include "binaryops.h"
+#include "codegen.h"
+#include "mathfunctions.h"
+
+extern LLVMContextRef phi_context;
+extern LLVMBuilderRef phi_builder;
+
+/* A complex number is a named struct of its real and imaginary part, which is passed and returned like a
+ * double _Complex in C. A complex vector keeps the real parts of its lanes in one vector and the imaginary parts in
+ * another, so that its lanes are computed like those of Real vectors. All complex types with their lanes as misc. */
+static stack *complexTypes = NULL;
+
+/* The type of a complex number for 0 lanes, of a complex vector otherwise */
+LLVMTypeRef complexType (unsigned lanes)
+{
+	if (lanes > 64)
+		return logError("Vector size must be between 1 and 64.", 0x2102);
+	for (stack *runner = complexTypes; runner != NULL; runner = runner->next)
+		if (runner->misc == (int)lanes)
+			return runner->item;
+
+	LLVMTypeRef part = LLVMDoubleTypeInContext(phi_context);
+	if (lanes != 0)
+		part = LLVMVectorType(part, lanes);
+	LLVMTypeRef parts[2] = {part, part};
+	char name[24];
+	if (lanes == 0)
+		sprintf(name, "complex");
+	else
+		sprintf(name, "complex.v%u", lanes);
+	LLVMTypeRef type = LLVMStructCreateNamed(phi_context, name);
+	LLVMStructSetBody(type, parts, 2, 0);
+	complexTypes = push(type, lanes, complexTypes);
+	return type;
+}
+
+int isComplexType (LLVMTypeRef type)
+{
+	for (stack *runner = complexTypes; runner != NULL; runner = runner->next)
+		if (runner->item == type)
+			return 1;
+	return 0;
+}
+
+/* Number of lanes of a complex vector, 0 for a complex number or any other type */
+unsigned complexLanes (LLVMTypeRef type)
+{
+	for (stack *runner = complexTypes; runner != NULL; runner = runner->next)
+		if (runner->item == type)
+			return runner->misc;
+	return 0;
+}
+
+void clearComplexTypes ()
+{
+	clearStack(&complexTypes, NULL);
+}
+
+static LLVMValueRef constIndex (unsigned index)
+{
+	return LLVMConstInt(LLVMInt32TypeInContext(phi_context), index, 0);
+}
+
+static LLVMValueRef realPart (LLVMValueRef z)
+{
+	return LLVMBuildExtractValue(phi_builder, z, 0, "re");
+}
+
+static LLVMValueRef imagPart (LLVMValueRef z)
+{
+	return LLVMBuildExtractValue(phi_builder, z, 1, "im");
+}
+
+/* A complex number or vector from its parts, which are Reals or Real vectors of the same size */
+LLVMValueRef buildComplex (LLVMValueRef re, LLVMValueRef im)
+{
+	LLVMTypeRef type = LLVMTypeOf(re);
+	unsigned lanes = LLVMGetTypeKind(type) == LLVMVectorTypeKind ? LLVMGetVectorSize(type) : 0;
+	LLVMTypeRef complex = complexType(lanes);
+	if (complex == NULL)
+		return NULL;
+	LLVMValueRef z = LLVMBuildInsertValue(phi_builder, LLVMGetUndef(complex), re, 0, "complex");
+	return LLVMBuildInsertValue(phi_builder, z, im, 1, "complex");
+}
+
+/* Number of lanes of a vector or complex vector, 0 for scalars */
+static unsigned lanesOf (LLVMValueRef val)
+{
+	LLVMTypeRef type = LLVMTypeOf(val);
+	if (LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+		return LLVMGetVectorSize(type);
+	return complexLanes(type);
+}
+
+/* A number or vector of numbers, which is combined with a complex operand, as a Real with the given lanes */
+static LLVMValueRef realOperand (LLVMValueRef val, unsigned lanes)
+{
+	LLVMTypeRef type = LLVMTypeOf(val);
+	LLVMTypeRef elemtype = LLVMGetTypeKind(type) == LLVMVectorTypeKind ? LLVMGetElementType(type) : type;
+	if ((LLVMGetTypeKind(elemtype) != LLVMIntegerTypeKind && !isFloatingType(elemtype))
+			|| elemtype == LLVMInt1TypeInContext(phi_context))
+		return logError("Complex numbers can only be combined with numbers.", 0x2D21);
+	LLVMTypeRef real = LLVMDoubleTypeInContext(phi_context);
+	if (LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+		real = LLVMVectorType(real, LLVMGetVectorSize(type));
+	val = buildConversion(val, real, 0);
+	if (lanes != 0 && LLVMGetTypeKind(type) != LLVMVectorTypeKind)
+		val = buildSplat(val, lanes);
+	return val;
+}
+
+/* A complex operand with the given lanes, which repeats a complex number in every lane */
+static LLVMValueRef complexOperand (LLVMValueRef z, unsigned lanes)
+{
+	if (lanes == 0 || complexLanes(LLVMTypeOf(z)) != 0)
+		return z;
+	return buildComplex(buildSplat(realPart(z), lanes), buildSplat(imagPart(z), lanes));
+}
+
+static LLVMValueRef shuffle (LLVMValueRef a, LLVMValueRef b, unsigned first, unsigned second, const char *name)
+{
+	LLVMValueRef mask[2] = {constIndex(first), constIndex(second)};
+	return LLVMBuildShuffleVector(phi_builder, a, b, LLVMConstVector(mask, 2), name);
+}
+
+/* A complex number is computed as the vector <re, im> */
+static LLVMValueRef interleave (LLVMValueRef z)
+{
+	LLVMTypeRef pair = LLVMVectorType(LLVMDoubleTypeInContext(phi_context), 2);
+	LLVMValueRef v = LLVMBuildInsertElement(phi_builder, LLVMGetUndef(pair), realPart(z), constIndex(0), "pair");
+	return LLVMBuildInsertElement(phi_builder, v, imagPart(z), constIndex(1), "pair");
+}
+
+static LLVMValueRef deinterleave (LLVMValueRef pair)
+{
+	LLVMValueRef re = LLVMBuildExtractElement(phi_builder, pair, constIndex(0), "re");
+	LLVMValueRef im = LLVMBuildExtractElement(phi_builder, pair, constIndex(1), "im");
+	return buildComplex(re, im);
+}
+
+/* <a, b> * <c, d> as <a, a> * <c, d> + <b, b> * <-d, c>, so that the sum can be fused with one of the products */
+static LLVMValueRef interleavedProduct (LLVMValueRef l, LLVMValueRef r)
+{
+	LLVMValueRef undef = LLVMGetUndef(LLVMTypeOf(l));
+	LLVMValueRef re = shuffle(l, undef, 0, 0, "redup");
+	LLVMValueRef im = shuffle(l, undef, 1, 1, "imdup");
+	LLVMValueRef swapped = shuffle(LLVMBuildFNeg(phi_builder, r, "fnegtmp"), r, 1, 2, "swapped");
+	LLVMValueRef outer = buildAppropriateMultiplication(re, r);
+	LLVMValueRef inner = buildAppropriateMultiplication(im, swapped);
+	return buildAppropriateAddition(inner, outer);
+}
+
+static LLVMValueRef interleavedConjugate (LLVMValueRef pair)
+{
+	return shuffle(pair, LLVMBuildFNeg(phi_builder, pair, "fnegtmp"), 0, 3, "conj");
+}
+
+/* |z|^2 of a complex number or of each lane of a complex vector */
+static LLVMValueRef squaredNorm (LLVMValueRef re, LLVMValueRef im)
+{
+	LLVMValueRef reSquared = buildAppropriateMultiplication(re, re);
+	return buildAppropriateAddition(buildAppropriateMultiplication(im, im), reSquared);
+}
+
+/* Operators on two complex numbers keep them as <re, im> */
+static LLVMValueRef buildInterleavedOperator (int op, LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	LLVMValueRef l = interleave(lhs);
+	LLVMValueRef r = interleave(rhs);
+	LLVMValueRef result;
+	switch (op)
+	{
+		case '+':
+			result = buildAppropriateAddition(l, r);
+			break;
+		case '-':
+			result = buildAppropriateSubtraction(l, r);
+			break;
+		case '*':
+			result = interleavedProduct(l, r);
+			break;
+		default:
+		{
+			/* The range of the parts is not scaled, like with -fcx-limited-range in GCC */
+			LLVMValueRef numerator = interleavedProduct(l, interleavedConjugate(r));
+			LLVMValueRef denominator = squaredNorm(realPart(rhs), imagPart(rhs));
+			result = buildAppropriateDivision(numerator, denominator);
+			break;
+		}
+	}
+	return deinterleave(result);
+}
+
+/* Operators on two complex vectors work on the vectors of the real and imaginary parts */
+static LLVMValueRef buildSplitOperator (int op, LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	LLVMValueRef a = realPart(lhs), b = imagPart(lhs);
+	LLVMValueRef c = realPart(rhs), d = imagPart(rhs);
+	LLVMValueRef re, im;
+	switch (op)
+	{
+		case '+':
+			re = buildAppropriateAddition(a, c);
+			im = buildAppropriateAddition(b, d);
+			break;
+		case '-':
+			re = buildAppropriateSubtraction(a, c);
+			im = buildAppropriateSubtraction(b, d);
+			break;
+		case '*':
+			re = buildAppropriateSubtraction(buildAppropriateMultiplication(a, c), buildAppropriateMultiplication(b, d));
+			im = buildAppropriateAddition(buildAppropriateMultiplication(a, d), buildAppropriateMultiplication(b, c));
+			break;
+		default:
+		{
+			LLVMValueRef denominator = squaredNorm(c, d);
+			re = buildAppropriateAddition(buildAppropriateMultiplication(a, c), buildAppropriateMultiplication(b, d));
+			im = buildAppropriateSubtraction(buildAppropriateMultiplication(b, c), buildAppropriateMultiplication(a, d));
+			re = buildAppropriateDivision(re, denominator);
+			im = buildAppropriateDivision(im, denominator);
+			break;
+		}
+	}
+	return buildComplex(re, im);
+}
+
+/* Operators on a complex operand and a Real only change the parts they need to */
+static LLVMValueRef buildScaledOperator (int op, LLVMValueRef z, LLVMValueRef x, int complexOnLeft)
+{
+	LLVMValueRef re = realPart(z);
+	LLVMValueRef im = imagPart(z);
+	switch (op)
+	{
+		case '+':
+			return buildComplex(buildAppropriateAddition(re, x), im);
+		case '-':
+			if (complexOnLeft)
+				return buildComplex(buildAppropriateSubtraction(re, x), im);
+			return buildComplex(buildAppropriateSubtraction(x, re), LLVMBuildFNeg(phi_builder, im, "fnegtmp"));
+		case '*':
+			if (complexLanes(LLVMTypeOf(z)) == 0)
+				return deinterleave(buildAppropriateMultiplication(interleave(z), x));
+			return buildComplex(buildAppropriateMultiplication(re, x), buildAppropriateMultiplication(im, x));
+		default:
+			if (complexLanes(LLVMTypeOf(z)) == 0)
+				return deinterleave(buildAppropriateDivision(interleave(z), x));
+			return buildComplex(buildAppropriateDivision(re, x), buildAppropriateDivision(im, x));
+	}
+}
+
+LLVMValueRef buildComplexOperator (int op, LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	if (op != '+' && op != '-' && op != '*' && op != '/' && op != '=')
+		return logError("Only +, -, *, / and = are available for complex numbers.", 0x2D20);
+	unsigned lhsLanes = lanesOf(lhs), rhsLanes = lanesOf(rhs);
+	if (lhsLanes != 0 && rhsLanes != 0 && lhsLanes != rhsLanes)
+		return logError("Complex vectors of different size cannot be combined.", 0x2D22);
+	unsigned lanes = lhsLanes != 0 ? lhsLanes : rhsLanes;
+	int lhsIsComplex = isComplexType(LLVMTypeOf(lhs));
+	int rhsIsComplex = isComplexType(LLVMTypeOf(rhs));
+	lhs = lhsIsComplex ? complexOperand(lhs, lanes) : realOperand(lhs, lanes);
+	rhs = rhsIsComplex ? complexOperand(rhs, lanes) : realOperand(rhs, lanes);
+	if (lhs == NULL || rhs == NULL)
+		return NULL;
+
+	/* A Real divided by a complex number is the only case, where the Real is needed as a complex number */
+	if ((op == '/' || op == '=') && !lhsIsComplex)
+		lhs = buildComplex(lhs, LLVMConstNull(LLVMTypeOf(lhs)));
+	else if (op == '=' && !rhsIsComplex)
+		rhs = buildComplex(rhs, LLVMConstNull(LLVMTypeOf(rhs)));
+	else if (!lhsIsComplex)
+		return buildScaledOperator(op, rhs, lhs, 0);
+	else if (!rhsIsComplex)
+		return buildScaledOperator(op, lhs, rhs, 1);
+
+	if (op == '=')
+	{
+		LLVMValueRef re = buildAppropriateEquality(realPart(lhs), realPart(rhs));
+		LLVMValueRef im = buildAppropriateEquality(imagPart(lhs), imagPart(rhs));
+		return LLVMBuildAnd(phi_builder, re, im, "eqtmp");
+	}
+	if (lanes == 0)
+		return buildInterleavedOperator(op, lhs, rhs);
+	return buildSplitOperator(op, lhs, rhs);
+}
+
+/* The built-in functions re, im, conj, abs and exp. Any number is taken as a complex number without imaginary part. */
+LLVMValueRef buildComplexFunction (const char *name, LLVMValueRef z)
+{
+	if (!isComplexType(LLVMTypeOf(z)))
+	{
+		z = realOperand(z, 0);
+		if (z == NULL)
+			return NULL;
+		z = buildComplex(z, LLVMConstNull(LLVMTypeOf(z)));
+	}
+	LLVMValueRef re = realPart(z);
+	LLVMValueRef im = imagPart(z);
+	if (strcmp(name, "re") == 0)
+		return re;
+	else if (strcmp(name, "im") == 0)
+		return im;
+	else if (strcmp(name, "conj") == 0)
+		return buildComplex(re, LLVMBuildFNeg(phi_builder, im, "fnegtmp"));
+	else if (strcmp(name, "abs") == 0)
+	{
+		/* Like the division, the sum of the squares is not scaled */
+		LLVMValueRef norm = squaredNorm(re, im);
+		return buildMathCall("sqrt", &norm, 1);
+	}
+	else if (strcmp(name, "exp") == 0)
+	{
+		LLVMValueRef magnitude = buildMathCall("exp", &re, 1);
+		LLVMValueRef cosine = buildMathCall("cos", &im, 1);
+		LLVMValueRef sine = buildMathCall("sin", &im, 1);
+		return buildComplex(buildAppropriateMultiplication(magnitude, cosine),
+			buildAppropriateMultiplication(magnitude, sine));
+	}
+	return logError("Only re, im, conj, abs and exp are available for complex numbers.", 0x2D23);
+}
@@ -0,0 +1,14 @@
+#ifndef COMPLEX_H_
+#define COMPLEX_H_
+
+#include <llvm-c/Core.h>
+
+LLVMTypeRef complexType (unsigned lanes);
+int isComplexType (LLVMTypeRef type);
+unsigned complexLanes (LLVMTypeRef type);
+void clearComplexTypes ();
+LLVMValueRef buildComplex (LLVMValueRef re, LLVMValueRef im);
+LLVMValueRef buildComplexOperator (int op, LLVMValueRef lhs, LLVMValueRef rhs);
+LLVMValueRef buildComplexFunction (const char *name, LLVMValueRef z);
+
+#endif /* COMPLEX_H_ */
@@ -1,33 +1,80 @@
+#include <stdlib.h>
 #include <llvm-c/Types.h>
 #include <llvm-c/Core.h>
+#include <llvm-c/Support.h>
 #include <llvm-c/TargetMachine.h>
+#include <llvm-c/Transforms/PassBuilder.h>
 #include <llvm-c/Transforms/Scalar.h>
 #include <llvm-c/Transforms/Utils.h>
+#include <llvm-c/Transforms/Vectorize.h>
 #include <llvm-c/Analysis.h>
 
 #include "llvmcontrol.h"
 #include "ast.h"
+#include "codegen.h"
 #include "templating.h"
+#include "records.h"
+#include "matrices.h"
+#include "complex.h"
 
 extern LLVMContextRef phi_context;
 extern LLVMModuleRef phi_module;
 extern LLVMBuilderRef phi_builder, alloca_builder;
+extern int phi_vectorLibrary;
 
 LLVMPassManagerRef phi_passManager;
+static LLVMTargetMachineRef phi_targetMachine;
+
+/* The vectoriser learns about the vector math library through the library info of the target. The matrix
+ * intrinsics are only lowered by the optimisation pipeline, if it is told so. */
+static void setCommandLineOptions ()
+{
+	const char *args[3] = {"phi", "-enable-matrix", NULL};
+	int numArgs = 2;
+	if (phi_vectorLibrary == veclib_libmvec)
+		args[numArgs++] = "-vector-library=LIBMVEC-X86";
+	else if (phi_vectorLibrary == veclib_svml)
+		args[numArgs++] = "-vector-library=SVML";
+	LLVMParseCommandLineOptions(numArgs, args, NULL);
+}
 
 LLVMPassManagerRef setupPassManager (LLVMModuleRef m)
 {
 	LLVMPassManagerRef pmr = LLVMCreateFunctionPassManagerForModule(m);
+	/* Give the loop passes access to the cost model of the target */
+	if (phi_targetMachine != NULL)
+		LLVMAddAnalysisPasses(phi_targetMachine, pmr);
 	LLVMAddInstructionCombiningPass(pmr);
 	LLVMAddReassociatePass(pmr);
 	LLVMAddGVNPass(pmr);
 	LLVMAddCFGSimplificationPass(pmr);
-	LLVMAddConstantPropagationPass(pmr);
+	LLVMAddSCCPPass(pmr);
 	LLVMAddPromoteMemoryToRegisterPass(pmr);
+	/* Loops are only recognisable once their variables live in registers */
+	LLVMAddLICMPass(pmr);
+	LLVMAddLoopVectorizePass(pmr);
+	LLVMAddLoopUnrollPass(pmr);
+	LLVMAddInstructionCombiningPass(pmr);
+	LLVMAddCFGSimplificationPass(pmr);
+	LLVMInitializeFunctionPassManager(pmr);
 	return pmr;
 }
 
-LLVMBool emitObjectFile (const char *filename)
+/* Inlining and the splitting of generators into coroutines need the whole module, so they run once at the end */
+void optimiseModule (LLVMModuleRef m)
+{
+	LLVMPassBuilderOptionsRef options = LLVMCreatePassBuilderOptions();
+	LLVMErrorRef err = LLVMRunPasses(m, "default<O2>", phi_targetMachine, options);
+	if (err != NULL)
+	{
+		char *msg = LLVMGetErrorMessage(err);
+		logError(msg, 0x2F02);
+		LLVMDisposeErrorMessage(msg);
+	}
+	LLVMDisposePassBuilderOptions(options);
+}
+
+LLVMTargetMachineRef setupTargetMachine (LLVMModuleRef m)
 {
 	LLVMInitializeAllTargetInfos();
 	LLVMInitializeAllTargets();
@@ -42,25 +89,32 @@ LLVMBool emitObjectFile (const char *filename)
 	{
 		logError(errorMsg, 0x2001);
 		LLVMDisposeMessage(errorMsg);
-		return 0;
+		LLVMDisposeMessage(triple);
+		return NULL;
 	}
 
-	LLVMTargetMachineRef phi_targetMachine = LLVMCreateTargetMachine(Target, triple, "generic", "",
+	LLVMTargetMachineRef tm = LLVMCreateTargetMachine(Target, triple, "generic", "",
 			LLVMCodeGenLevelDefault, LLVMRelocDefault, LLVMCodeModelDefault);
-	LLVMTargetDataRef targetData = LLVMCreateTargetDataLayout(phi_targetMachine);
-	LLVMSetModuleDataLayout(phi_module, targetData);
-	LLVMSetTarget(phi_module, triple);
+	LLVMTargetDataRef targetData = LLVMCreateTargetDataLayout(tm);
+	LLVMSetModuleDataLayout(m, targetData);
+	LLVMSetTarget(m, triple);
 
-	LLVMBool emitFailed = LLVMTargetMachineEmitToFile(phi_targetMachine, phi_module, filename, LLVMObjectFile, &errorMsg);
+	LLVMDisposeMessage(triple);
+	LLVMDisposeTargetData(targetData);
+	return tm;
+}
+
+LLVMBool emitObjectFile (const char *filename)
+{
+	if (phi_targetMachine == NULL)
+		return 0;
+	char *errorMsg;
+	LLVMBool emitFailed = LLVMTargetMachineEmitToFile(phi_targetMachine, phi_module, (char*)filename, LLVMObjectFile, &errorMsg);
 	if (emitFailed)
 	{
 		logError(errorMsg, 0x2F01);
 		LLVMDisposeMessage(errorMsg);
 	}
-
-	LLVMDisposeMessage(triple);
-	LLVMDisposeTargetData(targetData);
-	LLVMDisposeTargetMachine(phi_targetMachine);
 	return !emitFailed;
 }
 
@@ -74,19 +128,25 @@ void initialiseLLVM ()
 	alloca_builder = LLVMCreateBuilderInContext(phi_context);
 
 	phi_module = LLVMModuleCreateWithNameInContext("phi_compiler_module", phi_context);
+	phi_targetMachine = setupTargetMachine(phi_module);
+	setCommandLineOptions();
 	phi_passManager = setupPassManager(phi_module);
 }
 
 void shutdownLLVM ()
 {
 	clearTemplates();
+	clearRecords();
+	clearMatrices();
+	clearComplexTypes();
 	char *msg;
 	int verified = LLVMVerifyModule(phi_module, LLVMPrintMessageAction, &msg);
 	LLVMDisposeMessage(msg);
 	if (verified == 0)
 	{
+		optimiseModule(phi_module);
 #ifdef NDEBUG
-		emitObjectCode("output.o");
+		emitObjectFile("output.o");
 #else
 		LLVMDumpModule(phi_module);
 #endif
@@ -97,5 +157,7 @@ void shutdownLLVM ()
 	LLVMFinalizeFunctionPassManager(phi_passManager);
 	LLVMDisposePassManager(phi_passManager);
 	LLVMDisposeModule(phi_module);
+	if (phi_targetMachine != NULL)
+		LLVMDisposeTargetMachine(phi_targetMachine);
 	LLVMShutdown();
 }
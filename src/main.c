@@ -4,6 +4,8 @@
 
 #include "stack.h"
 #include "llvmcontrol.h"
+#include "codegen.h"
+#include "bounds.h"
 
 extern int yylex_destroy();
 extern int yyparse();
@@ -15,13 +17,47 @@ const char *version = "0.1";
 void printUsageInfo()
 {
 	printf( "This is Phi v%s\n", version);
-	printf( "Usage: phi [Filename]\n"
-		"If Filename is -, read from stdin.\n");
+	printf( "Usage: phi [Options] [Filename]\n"
+		"If Filename is -, read from stdin.\n"
+		"Options:\n"
+		"  --fast-math\tAllow all of the following, and assume there are no infinities or signed zeros\n"
+		"  --fp-contract\tFuse multiplications and additions\n"
+		"  --reassoc\tReassociate floating-point operations and vectorize loops over them\n"
+		"  --no-nans\tAssume there are no NaNs\n"
+		"  --veclib=lib\tMap exp, log, sin, cos and pow on vectors to the vector math library lib,\n"
+		"\t\twhich is one of libmvec (glibc, link with -lmvec), svml (Intel) and none\n"
+		"  --max-stack-array=n\tAllocate arrays larger than n bytes (default 65536) on the heap\n"
+		"  --bounds-check\tAbort with an error on indexes out of the bounds of arrays, vectors and slices\n");
+}
+
+static int parseFloatingPointOption (const char *option)
+{
+	if (strcmp(option, "fast-math") == 0)
+		return fp_contract | fp_reassoc | fp_nonans | fp_fast;
+	else if (strcmp(option, "fp-contract") == 0)
+		return fp_contract;
+	else if (strcmp(option, "reassoc") == 0)
+		return fp_reassoc;
+	else if (strcmp(option, "no-nans") == 0)
+		return fp_nonans;
+	return 0;
+}
+
+static int parseVectorLibrary (const char *option)
+{
+	if (strcmp(option, "libmvec") == 0)
+		return veclib_libmvec;
+	else if (strcmp(option, "svml") == 0)
+		return veclib_svml;
+	else if (strcmp(option, "none") == 0)
+		return veclib_none;
+	return -1;
 }
 
 int main (int argc, char **argv)
 {
 	stack *filesToParse = NULL;
+	int fpMode = 0;
 	for (int i = 1; i < argc; i++)
 	{
 		if (argv[i][0] != '-')
@@ -37,6 +73,39 @@ int main (int argc, char **argv)
 				case 'h':
 					printUsageInfo();
 					break;
+				case '-':
+				{
+					if (strncmp(argv[i]+2, "veclib=", 7) == 0)
+					{
+						int library = parseVectorLibrary(argv[i]+9);
+						if (library < 0)
+							fprintf(stderr, "Unknown vector library %s will be ignored.\n", argv[i]+9);
+						else
+							setVectorLibrary(library);
+						break;
+					}
+					if (strncmp(argv[i]+2, "max-stack-array=", 16) == 0)
+					{
+						char *end;
+						unsigned long long bytes = strtoull(argv[i]+18, &end, 10);
+						if (*end != '\0' || end == argv[i]+18)
+							fprintf(stderr, "Invalid array size %s will be ignored.\n", argv[i]+18);
+						else
+							setMaxStackArray(bytes);
+						break;
+					}
+					if (strcmp(argv[i]+2, "bounds-check") == 0)
+					{
+						setBoundsCheck(1);
+						break;
+					}
+					int flag = parseFloatingPointOption(argv[i]+2);
+					if (flag == 0)
+						fprintf(stderr, "Unknown option %s will be ignored.\n", argv[i]);
+					fpMode |= flag;
+					setFloatingPointMode(fpMode);
+					break;
+				}
 			}
 		}
 	}
@@ -0,0 +1,398 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <llvm-c/Core.h>
+#include "stack.h"
+#include "ast.h"
+#include "codegen.h"
+#include "binaryops.h"
+#include "complex.h"
+#include "algorithms.h"
+#include "mathfunctions.h"
+
+extern LLVMContextRef phi_context;
+extern LLVMModuleRef phi_module;
+extern LLVMBuilderRef phi_builder;
+extern int phi_fpFlags;
+extern int phi_vectorLibrary;
+
+/* Built-in reductions over the lanes of a vector. Bool vectors can only be reduced by all and any. */
+static const struct reduction {
+	const char *name;
+	const char *intIntrinsic;
+	const char *realIntrinsic;
+	/* Only needed where UInt differs from Int */
+	const char *unsignedIntrinsic;
+} reductions[] = {
+	{"sum", "llvm.vector.reduce.add", "llvm.vector.reduce.fadd", NULL},
+	{"product", "llvm.vector.reduce.mul", "llvm.vector.reduce.fmul", NULL},
+	{"hmin", "llvm.vector.reduce.smin", "llvm.vector.reduce.fmin", "llvm.vector.reduce.umin"},
+	{"hmax", "llvm.vector.reduce.smax", "llvm.vector.reduce.fmax", "llvm.vector.reduce.umax"},
+	{"all", "llvm.vector.reduce.and", NULL, NULL},
+	{"any", "llvm.vector.reduce.or", NULL, NULL},
+	{"dot", "llvm.vector.reduce.add", "llvm.vector.reduce.fadd", NULL},
+	{NULL, NULL, NULL, NULL}
+};
+
+static const struct reduction* lookupReduction (const char *name)
+{
+	for (const struct reduction *r = reductions; r->name != NULL; r++)
+		if (strcmp(r->name, name) == 0)
+			return r;
+	return NULL;
+}
+
+/* Combine the two halves of the vector until a single lane is left. This reassociates, but needs only log2(N) steps. */
+static LLVMValueRef buildTreeReduction (LLVMValueRef vec, int isProduct)
+{
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(phi_context);
+	unsigned size = LLVMGetVectorSize(LLVMTypeOf(vec));
+	while (size > 1)
+	{
+		size /= 2;
+		LLVMValueRef low[size], high[size];
+		for (unsigned i = 0; i < size; i++)
+		{
+			low[i] = LLVMConstInt(i32, i, 0);
+			high[i] = LLVMConstInt(i32, size + i, 0);
+		}
+		LLVMValueRef undef = LLVMGetUndef(LLVMTypeOf(vec));
+		LLVMValueRef lhs = LLVMBuildShuffleVector(phi_builder, vec, undef, LLVMConstVector(low, size), "lowhalf");
+		LLVMValueRef rhs = LLVMBuildShuffleVector(phi_builder, vec, undef, LLVMConstVector(high, size), "highhalf");
+		if (isProduct)
+			vec = LLVMBuildFMul(phi_builder, lhs, rhs, "multmp");
+		else
+			vec = LLVMBuildFAdd(phi_builder, lhs, rhs, "addtmp");
+	}
+	return LLVMBuildExtractElement(phi_builder, vec, LLVMConstInt(i32, 0, 0), "reduced");
+}
+
+static LLVMValueRef buildFloatingReduction (LLVMValueRef vec, int isProduct)
+{
+	LLVMTypeRef type = LLVMTypeOf(vec);
+	unsigned size = LLVMGetVectorSize(type);
+	if ((phi_fpFlags & fp_reassoc) && (size & (size - 1)) == 0)
+		return buildTreeReduction(vec, isProduct);
+	/* Without fast-math flags, LLVM adds or multiplies the lanes in order, starting with the identity */
+	LLVMValueRef reduceArgs[2] = {LLVMConstReal(LLVMGetElementType(type), isProduct ? 1.0 : -0.0), vec};
+	return callIntrinsic(isProduct ? "llvm.vector.reduce.fmul" : "llvm.vector.reduce.fadd", &type, 1, reduceArgs, 2,
+		isProduct ? "product" : "sum");
+}
+
+unsigned reductionArguments (const char *name)
+{
+	if (lookupReduction(name) == NULL)
+		return 0;
+	return strcmp(name, "dot") == 0 ? 2 : 1;
+}
+
+/* Reduce the lanes of a vector, or of the product of two vectors for dot */
+LLVMValueRef buildLaneReduction (const char *name, LLVMValueRef *args)
+{
+	const struct reduction *r = lookupReduction(name);
+	int isDot = (strcmp(r->name, "dot") == 0);
+	int isComplex = isComplexType(LLVMTypeOf(args[0])) || (isDot && isComplexType(LLVMTypeOf(args[1])));
+	LLVMValueRef vec = args[0];
+	if (isDot && isComplex)
+		vec = buildComplexOperator('*', args[0], args[1]);
+	else if (isDot)
+		vec = buildAppropriateMultiplication(args[0], args[1]);
+	if (vec == NULL)
+		return NULL;
+	LLVMTypeRef type = LLVMTypeOf(vec);
+	/* The lanes of a complex vector are summed up separately for both parts */
+	if (isComplex && complexLanes(type) != 0 && (isDot || strcmp(r->name, "sum") == 0))
+	{
+		LLVMValueRef re = buildFloatingReduction(LLVMBuildExtractValue(phi_builder, vec, 0, "re"), 0);
+		LLVMValueRef im = buildFloatingReduction(LLVMBuildExtractValue(phi_builder, vec, 1, "im"), 0);
+		return buildComplex(re, im);
+	}
+	else if (isComplex)
+		return logError("Complex vectors can only be reduced by sum and dot.", 0x2C0C);
+	if (!isDot && strcmp(r->name, "sum") == 0 && (isSliceType(type) || LLVMGetTypeKind(type) == LLVMArrayTypeKind))
+		return buildArraySum(vec);
+	if (LLVMGetTypeKind(type) != LLVMVectorTypeKind)
+		return logError("Reductions are only available for vectors.", 0x2C02);
+	LLVMTypeRef elemtype = LLVMGetElementType(type);
+	int isReal = isFloatingType(elemtype);
+	int isBool = (elemtype == LLVMInt1TypeInContext(phi_context));
+
+	LLVMValueRef result;
+	if (r->realIntrinsic == NULL)
+	{
+		if (isReal)
+			vec = LLVMBuildFCmp(phi_builder, LLVMRealONE, vec, LLVMConstNull(type), "truth");
+		else if (!isBool)
+			vec = LLVMBuildICmp(phi_builder, LLVMIntNE, vec, LLVMConstNull(type), "truth");
+		type = LLVMTypeOf(vec);
+		result = callIntrinsic(r->intIntrinsic, &type, 1, &vec, 1, r->name);
+	}
+	else if (isBool)
+		return logError("Boolean vectors can only be reduced by all and any.", 0x2C03);
+	else if (isReal && (strcmp(r->name, "hmin") == 0 || strcmp(r->name, "hmax") == 0))
+		result = callIntrinsic(r->realIntrinsic, &type, 1, &vec, 1, r->name);
+	else if (isReal)
+		result = buildFloatingReduction(vec, strcmp(r->name, "product") == 0);
+	else if (isUnsigned(vec))
+	{
+		const char *intrinsic = r->unsignedIntrinsic != NULL ? r->unsignedIntrinsic : r->intIntrinsic;
+		result = markUnsigned(callIntrinsic(intrinsic, &type, 1, &vec, 1, r->name));
+	}
+	else
+		result = callIntrinsic(r->intIntrinsic, &type, 1, &vec, 1, r->name);
+	return result;
+}
+
+/* Built-in math and bit functions, which map to LLVM intrinsics and are applied lane-wise to vectors.
+ * A NULL intrinsic means the function is not available for that kind of number, "" that it does nothing. */
+static const struct mathFunction {
+	const char *name;
+	unsigned numArgs;
+	const char *intIntrinsic;
+	const char *realIntrinsic;
+	/* Only needed where UInt differs from Int */
+	const char *unsignedIntrinsic;
+	/* Whether the intrinsic takes an additional flag, which makes some inputs poison */
+	int poisonFlag;
+	/* Name of the function in the C library, for the transcendental functions */
+	const char *libmName;
+} mathFunctions[] = {
+	{"sqrt", 1, NULL, "llvm.sqrt", NULL, 0, NULL},
+	{"abs", 1, "llvm.abs", "llvm.fabs", "", 1, NULL},
+	{"fma", 3, NULL, "llvm.fma", NULL, 0, NULL},
+	{"floor", 1, "", "llvm.floor", NULL, 0, NULL},
+	{"ceil", 1, "", "llvm.ceil", NULL, 0, NULL},
+	{"round", 1, "", "llvm.round", NULL, 0, NULL},
+	{"min", 2, "llvm.smin", "llvm.minnum", "llvm.umin", 0, NULL},
+	{"max", 2, "llvm.smax", "llvm.maxnum", "llvm.umax", 0, NULL},
+	{"copysign", 2, NULL, "llvm.copysign", NULL, 0, NULL},
+	{"popcount", 1, "llvm.ctpop", NULL, NULL, 0, NULL},
+	{"ctz", 1, "llvm.cttz", NULL, NULL, 1, NULL},
+	{"clz", 1, "llvm.ctlz", NULL, NULL, 1, NULL},
+	{"bswap", 1, "llvm.bswap", NULL, NULL, 0, NULL},
+	{"exp", 1, NULL, "llvm.exp", NULL, 0, "exp"},
+	{"log", 1, NULL, "llvm.log", NULL, 0, "log"},
+	{"sin", 1, NULL, "llvm.sin", NULL, 0, "sin"},
+	{"cos", 1, NULL, "llvm.cos", NULL, 0, "cos"},
+	{"pow", 2, NULL, "llvm.pow", NULL, 0, "pow"},
+	{NULL, 0, NULL, NULL, NULL, 0, NULL}
+};
+
+static const struct mathFunction* lookupMathFunction (const char *name)
+{
+	for (const struct mathFunction *m = mathFunctions; m->name != NULL; m++)
+		if (strcmp(m->name, name) == 0)
+			return m;
+	return NULL;
+}
+
+/* Call the vector math library on pieces of 128 bits, which every x86-64 target can pass in registers. The library
+ * function is named after the number of lanes, e.g. _ZGVbN2v_exp in libmvec and __svml_exp2 in SVML. Returns NULL
+ * if the vector cannot be split into such pieces. */
+static LLVMValueRef buildVectorLibraryCall (const char *libmName, LLVMValueRef *args, unsigned numArgs)
+{
+	LLVMTypeRef type = LLVMTypeOf(args[0]);
+	LLVMTypeRef elemtype = LLVMGetElementType(type);
+	int isFloat = (LLVMGetTypeKind(elemtype) == LLVMFloatTypeKind);
+	unsigned lanes = isFloat ? 4 : 2;
+	unsigned size = LLVMGetVectorSize(type);
+	if (phi_vectorLibrary == veclib_none || size % lanes != 0)
+		return NULL;
+
+	char name[64];
+	if (phi_vectorLibrary == veclib_libmvec)
+		snprintf(name, sizeof(name), "_ZGVbN%u%s_%s%s", lanes, numArgs == 2 ? "vv" : "v", libmName, isFloat ? "f" : "");
+	else
+		snprintf(name, sizeof(name), "__svml_%s%s%u", libmName, isFloat ? "f" : "", lanes);
+	LLVMTypeRef piecetype = LLVMVectorType(elemtype, lanes);
+	LLVMValueRef function = LLVMGetNamedFunction(phi_module, name);
+	if (function == NULL)
+	{
+		LLVMTypeRef params[2] = {piecetype, piecetype};
+		function = LLVMAddFunction(phi_module, name, LLVMFunctionType(piecetype, params, numArgs, 0));
+		const char *attributes[] = {"nounwind", "readnone", "willreturn"};
+		for (unsigned i = 0; i < 3; i++)
+		{
+			unsigned kind = LLVMGetEnumAttributeKindForName(attributes[i], strlen(attributes[i]));
+			LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex, LLVMCreateEnumAttribute(phi_context, kind, 0));
+		}
+	}
+
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(phi_context);
+	LLVMValueRef result = LLVMGetUndef(type);
+	for (unsigned first = 0; first < size; first += lanes)
+	{
+		LLVMValueRef indices[lanes];
+		for (unsigned i = 0; i < lanes; i++)
+			indices[i] = LLVMConstInt(i32, first + i, 0);
+		LLVMValueRef pieces[2];
+		for (unsigned j = 0; j < numArgs; j++)
+			pieces[j] = LLVMBuildShuffleVector(phi_builder, args[j], LLVMGetUndef(type),
+				LLVMConstVector(indices, lanes), "piece");
+		LLVMValueRef value = LLVMBuildCall(phi_builder, function, pieces, numArgs, libmName);
+		for (unsigned i = 0; i < lanes; i++)
+		{
+			LLVMValueRef lane = LLVMBuildExtractElement(phi_builder, value, LLVMConstInt(i32, i, 0), "lane");
+			result = LLVMBuildInsertElement(phi_builder, result, lane, indices[i], libmName);
+		}
+	}
+	return result;
+}
+
+unsigned mathArguments (const char *name)
+{
+	const struct mathFunction *m = lookupMathFunction(name);
+	return m != NULL ? m->numArgs : 0;
+}
+
+LLVMValueRef buildMathFunction (const char *name, LLVMValueRef *operands)
+{
+	const struct mathFunction *m = lookupMathFunction(name);
+	if (isComplexType(LLVMTypeOf(operands[0])))
+		return m->numArgs == 1 ? buildComplexFunction(m->name, operands[0])
+			: logError("Only re, im, conj, abs and exp are available for complex numbers.", 0x2D23);
+	/* The intrinsics of ctz and clz take one more argument */
+	LLVMValueRef args[4];
+	for (unsigned i = 0; i < m->numArgs; i++)
+		args[i] = operands[i];
+	int isUnsignedResult = 0;
+	if (!promoteArguments(args, m->numArgs, &isUnsignedResult))
+		return logError("Math functions are only available for numbers and vectors of the same size.", 0x2C08);
+	LLVMTypeRef type = LLVMTypeOf(args[0]);
+	/* Integers are converted to Real for the functions, which only exist for floating point */
+	if (m->intIntrinsic == NULL && m->realIntrinsic != NULL && !isFloatingType(type))
+	{
+		LLVMTypeRef real = LLVMDoubleTypeInContext(phi_context);
+		if (LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+			real = LLVMVectorType(real, LLVMGetVectorSize(type));
+		for (unsigned i = 0; i < m->numArgs; i++)
+			args[i] = buildConversion(args[i], real, 0);
+		type = real;
+		isUnsignedResult = 0;
+	}
+	const char *intrinsic = m->intIntrinsic;
+	if (isFloatingType(type))
+		intrinsic = m->realIntrinsic;
+	else if (isUnsignedResult && m->unsignedIntrinsic != NULL)
+		intrinsic = m->unsignedIntrinsic;
+	if (intrinsic == NULL && isFloatingType(type))
+		return logError("This math function is only available for integers.", 0x2C09);
+	else if (intrinsic == NULL)
+		return logError("This math function is only available for Real and Float32.", 0x2C0A);
+
+	LLVMValueRef result = args[0];
+	LLVMTypeRef elemtype = LLVMGetTypeKind(type) == LLVMVectorTypeKind ? LLVMGetElementType(type) : type;
+	/* bswap of a single byte does nothing, and LLVM does not accept it */
+	int isByte = !isFloatingType(elemtype) && LLVMGetIntTypeWidth(elemtype) == 8;
+	if (intrinsic[0] != '\0' && !(isByte && strcmp(m->name, "bswap") == 0))
+	{
+		unsigned numArgs = m->numArgs;
+		if (m->poisonFlag && !isFloatingType(type))
+			args[numArgs++] = LLVMConstNull(LLVMInt1TypeInContext(phi_context));
+		result = NULL;
+		if (m->libmName != NULL && LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+			result = buildVectorLibraryCall(m->libmName, args, numArgs);
+		/* Scalar calls are left to the loop vectoriser, which knows the vector library as well */
+		if (result == NULL)
+			result = callIntrinsic(intrinsic, &type, 1, args, numArgs, m->name);
+	}
+	if (isUnsignedResult)
+		result = markUnsigned(result);
+	return result;
+}
+
+/* Apply a math function to Reals or Real vectors, which are passed to the vector math library if one was chosen */
+LLVMValueRef buildMathCall (const char *name, LLVMValueRef *args, unsigned numArgs)
+{
+	const struct mathFunction *m = lookupMathFunction(name);
+	LLVMTypeRef type = LLVMTypeOf(args[0]);
+	LLVMValueRef result = NULL;
+	if (m->libmName != NULL && LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+		result = buildVectorLibraryCall(m->libmName, args, numArgs);
+	if (result == NULL)
+		result = callIntrinsic(m->realIntrinsic, &type, 1, args, numArgs, m->name);
+	return result;
+}
+
+LLVMValueRef reductionIdentity (int op, LLVMTypeRef type, int isUnsignedType)
+{
+	LLVMTypeRef elemtype = type;
+	if (LLVMGetTypeKind(type) == LLVMVectorTypeKind)
+		elemtype = LLVMGetElementType(type);
+	if (isComplexType(type) && (op == '+' || op == '*'))
+	{
+		LLVMTypeRef part = LLVMStructGetTypeAtIndex(type, 0);
+		LLVMValueRef parts[2] = {reductionIdentity(op, part, 0), LLVMConstNull(part)};
+		return LLVMConstNamedStruct(type, parts, 2);
+	}
+	LLVMTypeKind kind = LLVMGetTypeKind(elemtype);
+	LLVMValueRef identity = NULL;
+	if (isFloatingType(elemtype))
+	{
+		switch (op)
+		{
+			case '+':
+				identity = LLVMConstReal(elemtype, 0.0);
+				break;
+			case '*':
+				identity = LLVMConstReal(elemtype, 1.0);
+				break;
+			case '<':
+				identity = LLVMConstReal(elemtype, HUGE_VAL);
+				break;
+			case '>':
+				identity = LLVMConstReal(elemtype, -HUGE_VAL);
+				break;
+		}
+	}
+	else if (kind == LLVMIntegerTypeKind && elemtype != LLVMInt1TypeInContext(phi_context))
+	{
+		unsigned long long signBit = 1ULL << (LLVMGetIntTypeWidth(elemtype) - 1);
+		switch (op)
+		{
+			case '+':
+				identity = LLVMConstInt(elemtype, 0, 0);
+				break;
+			case '*':
+				identity = LLVMConstInt(elemtype, 1, 0);
+				break;
+			case '<':
+				identity = isUnsignedType ? LLVMConstAllOnes(elemtype) : LLVMConstInt(elemtype, signBit - 1, 0);
+				break;
+			case '>':
+				identity = LLVMConstInt(elemtype, isUnsignedType ? 0 : signBit, 0);
+				break;
+		}
+	}
+	if (identity == NULL)
+		return logError("Reductions are only available for Int and Real variables.", 0x2907);
+	if (elemtype == type)
+		return identity;
+	unsigned size = LLVMGetVectorSize(type);
+	LLVMValueRef lanes[size];
+	for (unsigned i = 0; i < size; i++)
+		lanes[i] = identity;
+	return LLVMConstVector(lanes, size);
+}
+
+LLVMValueRef buildReduction (int op, LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	LLVMValueRef cmp;
+	switch (op)
+	{
+		case '+':
+		case '*':
+			return buildOperator(op, lhs, rhs);
+		case '<':
+			cmp = buildAppropriateComparison(lhs, rhs);
+			break;
+		case '>':
+			cmp = buildAppropriateComparison(rhs, lhs);
+			break;
+		default:
+			return logError("Unknown reduction operator.", 0x2908);
+	}
+	if (cmp == NULL)
+		return NULL;
+	return LLVMBuildSelect(phi_builder, cmp, lhs, rhs, "reducetmp");
+}
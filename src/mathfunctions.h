@@ -0,0 +1,14 @@
+#ifndef MATHFUNCTIONS_H_
+#define MATHFUNCTIONS_H_
+
+#include <llvm-c/Core.h>
+
+unsigned reductionArguments (const char *name);
+LLVMValueRef buildLaneReduction (const char *name, LLVMValueRef *args);
+unsigned mathArguments (const char *name);
+LLVMValueRef buildMathFunction (const char *name, LLVMValueRef *operands);
+LLVMValueRef buildMathCall (const char *name, LLVMValueRef *args, unsigned numArgs);
+LLVMValueRef reductionIdentity (int op, LLVMTypeRef type, int isUnsignedType);
+LLVMValueRef buildReduction (int op, LLVMValueRef lhs, LLVMValueRef rhs);
+
+#endif /* MATHFUNCTIONS_H_ */
@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <string.h>
+#include <llvm-c/Core.h>
+#include "stack.h"
+#include "ast.h"
+#include "matrices.h"
+#include "binaryops.h"
+#include "codegen.h"
+
+extern LLVMContextRef phi_context;
+extern LLVMBuilderRef phi_builder;
+
+/* A matrix is a named struct around a vector of its elements in column-major order, as expected by the matrix
+ * intrinsics of LLVM, so that its shape is part of its type. All types of matrices with their number of rows as misc. */
+static stack *matrices = NULL;
+
+/* The matrix intrinsics unroll every operation completely */
+static const unsigned maxMatrixSize = 256;
+
+LLVMTypeRef matrixType (LLVMTypeRef element, unsigned rows, unsigned columns)
+{
+	if (rows == 0 || columns == 0 || rows > maxMatrixSize || columns > maxMatrixSize / rows)
+		return logError("A matrix must have between 1 and 256 elements.", 0x2D10);
+	LLVMTypeKind kind = LLVMGetTypeKind(element);
+	if ((kind != LLVMIntegerTypeKind && !isFloatingType(element)) || element == LLVMInt1TypeInContext(phi_context))
+		return logError("Matrices can only be built from numbers.", 0x2D11);
+	LLVMTypeRef vector = LLVMVectorType(element, rows * columns);
+	for (stack *runner = matrices; runner != NULL; runner = runner->next)
+		if (runner->misc == (int)rows && LLVMStructGetTypeAtIndex(runner->item, 0) == vector)
+			return runner->item;
+
+	char *elementName = LLVMPrintTypeToString(element);
+	char name[strlen(elementName) + 32];
+	sprintf(name, "matrix.%ux%u.%s", rows, columns, elementName);
+	LLVMDisposeMessage(elementName);
+	LLVMTypeRef type = LLVMStructCreateNamed(phi_context, name);
+	LLVMStructSetBody(type, &vector, 1, 0);
+	matrices = push(type, rows, matrices);
+	return type;
+}
+
+int isMatrixType (LLVMTypeRef type)
+{
+	for (stack *runner = matrices; runner != NULL; runner = runner->next)
+		if (runner->item == type)
+			return 1;
+	return 0;
+}
+
+unsigned matrixRows (LLVMTypeRef type)
+{
+	for (stack *runner = matrices; runner != NULL; runner = runner->next)
+		if (runner->item == type)
+			return runner->misc;
+	return 0;
+}
+
+unsigned matrixColumns (LLVMTypeRef type)
+{
+	unsigned rows = matrixRows(type);
+	return rows == 0 ? 0 : LLVMGetVectorSize(LLVMStructGetTypeAtIndex(type, 0)) / rows;
+}
+
+void clearMatrices ()
+{
+	clearStack(&matrices, NULL);
+}
+
+static LLVMValueRef matrixElements (LLVMValueRef matrix)
+{
+	LLVMValueRef elements = LLVMBuildExtractValue(phi_builder, matrix, 0, "elements");
+	return isUnsigned(matrix) ? markUnsigned(elements) : elements;
+}
+
+static LLVMValueRef buildMatrix (LLVMValueRef elements, unsigned rows, unsigned columns)
+{
+	LLVMTypeRef type = matrixType(LLVMGetElementType(LLVMTypeOf(elements)), rows, columns);
+	if (type == NULL)
+		return NULL;
+	LLVMValueRef matrix = LLVMBuildInsertValue(phi_builder, LLVMGetUndef(type), elements, 0, "matrix");
+	return isUnsigned(elements) ? markUnsigned(matrix) : matrix;
+}
+
+static LLVMValueRef constInt32 (unsigned value)
+{
+	return LLVMConstInt(LLVMInt32TypeInContext(phi_context), value, 0);
+}
+
+static int isVector (LLVMValueRef val)
+{
+	return LLVMGetTypeKind(LLVMTypeOf(val)) == LLVMVectorTypeKind;
+}
+
+/* Product of an R x K and a K x C matrix. A vector is taken as a column on the right and as a row on the left,
+ * and makes the result a vector. */
+static LLVMValueRef buildMatrixProduct (LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	int lhsIsMatrix = isMatrixType(LLVMTypeOf(lhs));
+	int rhsIsMatrix = isMatrixType(LLVMTypeOf(rhs));
+	LLVMValueRef l = lhsIsMatrix ? matrixElements(lhs) : lhs;
+	LLVMValueRef r = rhsIsMatrix ? matrixElements(rhs) : rhs;
+	unsigned rows = lhsIsMatrix ? matrixRows(LLVMTypeOf(lhs)) : 1;
+	unsigned inner = lhsIsMatrix ? matrixColumns(LLVMTypeOf(lhs)) : LLVMGetVectorSize(LLVMTypeOf(l));
+	unsigned rhsRows = rhsIsMatrix ? matrixRows(LLVMTypeOf(rhs)) : LLVMGetVectorSize(LLVMTypeOf(r));
+	unsigned columns = rhsIsMatrix ? matrixColumns(LLVMTypeOf(rhs)) : 1;
+	if (inner != rhsRows)
+		return logError("The left factor of a matrix product must have as many columns as the right one has rows.", 0x2D12);
+	LLVMTypeRef element = LLVMGetElementType(LLVMTypeOf(l));
+	if (element != LLVMGetElementType(LLVMTypeOf(r)))
+		return logError("Matrices can only be multiplied with matrices and vectors of the same element type.", 0x2D13);
+
+	LLVMTypeRef overloads[3] = {LLVMVectorType(element, rows * columns), LLVMTypeOf(l), LLVMTypeOf(r)};
+	LLVMValueRef args[5] = {l, r, constInt32(rows), constInt32(inner), constInt32(columns)};
+	LLVMValueRef product = callIntrinsic("llvm.matrix.multiply", overloads, 3, args, 5, "matmul");
+	if (isUnsigned(l) || isUnsigned(r))
+		markUnsigned(product);
+	if (!lhsIsMatrix || !rhsIsMatrix)
+		return product;
+	return buildMatrix(product, rows, columns);
+}
+
+/* Apart from products, operators work on the elements of matrices of the same shape, or of a matrix and a scalar */
+LLVMValueRef buildMatrixOperator (int op, LLVMValueRef lhs, LLVMValueRef rhs)
+{
+	LLVMTypeRef lhstype = LLVMTypeOf(lhs);
+	LLVMTypeRef rhstype = LLVMTypeOf(rhs);
+	int lhsIsMatrix = isMatrixType(lhstype);
+	int rhsIsMatrix = isMatrixType(rhstype);
+	if (op == '*' && (lhsIsMatrix || isVector(lhs)) && (rhsIsMatrix || isVector(rhs)))
+		return buildMatrixProduct(lhs, rhs);
+	if (op != '+' && op != '-' && op != '*' && op != '/')
+		return logError("Only +, -, * and / are available for matrices.", 0x2D14);
+	if ((!lhsIsMatrix && isVector(lhs)) || (!rhsIsMatrix && isVector(rhs)))
+		return logError("Matrices can only be added to, subtracted from or divided by matrices and scalars.", 0x2D15);
+
+	LLVMTypeRef shape = lhsIsMatrix ? lhstype : rhstype;
+	unsigned rows = matrixRows(shape);
+	unsigned columns = matrixColumns(shape);
+	if (lhsIsMatrix && rhsIsMatrix && (matrixRows(rhstype) != rows || matrixColumns(rhstype) != columns))
+		return logError("Matrices of different shapes cannot be combined.", 0x2D16);
+	LLVMValueRef l = lhsIsMatrix ? matrixElements(lhs) : lhs;
+	LLVMValueRef r = rhsIsMatrix ? matrixElements(rhs) : rhs;
+	LLVMValueRef result;
+	switch (op)
+	{
+		case '+':
+			result = buildAppropriateAddition(l, r);
+			break;
+		case '-':
+			result = buildAppropriateSubtraction(l, r);
+			break;
+		case '*':
+			result = buildAppropriateMultiplication(l, r);
+			break;
+		default:
+			result = buildAppropriateDivision(l, r);
+			break;
+	}
+	if (result == NULL)
+		return NULL;
+	return buildMatrix(result, rows, columns);
+}
+
+LLVMValueRef buildTranspose (LLVMValueRef matrix)
+{
+	LLVMTypeRef type = LLVMTypeOf(matrix);
+	if (!isMatrixType(type))
+		return logError("Only matrices can be transposed.", 0x2D17);
+	unsigned rows = matrixRows(type);
+	unsigned columns = matrixColumns(type);
+	LLVMValueRef elements = matrixElements(matrix);
+	LLVMTypeRef overload = LLVMTypeOf(elements);
+	LLVMValueRef args[3] = {elements, constInt32(rows), constInt32(columns)};
+	LLVMValueRef transposed = callIntrinsic("llvm.matrix.transpose", &overload, 1, args, 3, "transpose");
+	if (isUnsigned(elements))
+		markUnsigned(transposed);
+	return buildMatrix(transposed, columns, rows);
+}
+
+/* The columns of a matrix in memory start stride elements apart */
+LLVMValueRef buildMatrixLoad (LLVMTypeRef type, LLVMValueRef ptr, LLVMValueRef stride)
+{
+	LLVMTypeRef vector = LLVMStructGetTypeAtIndex(type, 0);
+	LLVMTypeRef overloads[2] = {vector, LLVMTypeOf(stride)};
+	LLVMValueRef args[5] = {ptr, stride, LLVMConstNull(LLVMInt1TypeInContext(phi_context)),
+		constInt32(matrixRows(type)), constInt32(matrixColumns(type))};
+	LLVMValueRef elements = callIntrinsic("llvm.matrix.column.major.load", overloads, 2, args, 5, "matload");
+	return buildMatrix(elements, matrixRows(type), matrixColumns(type));
+}
+
+void buildMatrixStore (LLVMValueRef matrix, LLVMValueRef ptr, LLVMValueRef stride)
+{
+	LLVMTypeRef type = LLVMTypeOf(matrix);
+	LLVMValueRef elements = matrixElements(matrix);
+	LLVMTypeRef overloads[2] = {LLVMTypeOf(elements), LLVMTypeOf(stride)};
+	LLVMValueRef args[6] = {elements, ptr, stride, LLVMConstNull(LLVMInt1TypeInContext(phi_context)),
+		constInt32(matrixRows(type)), constInt32(matrixColumns(type))};
+	callIntrinsic("llvm.matrix.column.major.store", overloads, 2, args, 6, "");
+}
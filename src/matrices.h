@@ -0,0 +1,16 @@
+#ifndef MATRICES_H_
+#define MATRICES_H_
+
+#include <llvm-c/Core.h>
+
+LLVMTypeRef matrixType (LLVMTypeRef element, unsigned rows, unsigned columns);
+int isMatrixType (LLVMTypeRef type);
+unsigned matrixRows (LLVMTypeRef type);
+unsigned matrixColumns (LLVMTypeRef type);
+void clearMatrices ();
+LLVMValueRef buildMatrixOperator (int op, LLVMValueRef lhs, LLVMValueRef rhs);
+LLVMValueRef buildTranspose (LLVMValueRef matrix);
+LLVMValueRef buildMatrixLoad (LLVMTypeRef type, LLVMValueRef ptr, LLVMValueRef stride);
+void buildMatrixStore (LLVMValueRef matrix, LLVMValueRef ptr, LLVMValueRef stride);
+
+#endif /* MATRICES_H_ */
@@ -0,0 +1,795 @@
+#include <stdlib.h>
+#include <string.h>
+#include <llvm-c/Core.h>
+#include <llvm-c/Analysis.h>
+#include <llvm-c/Target.h>
+#include "stack.h"
+#include "ast.h"
+#include "codegen.h"
+#include "records.h"
+#include "matrices.h"
+#include "complex.h"
+#include "bounds.h"
+#include "mathfunctions.h"
+#include "parallel.h"
+
+extern LLVMContextRef phi_context;
+extern LLVMModuleRef phi_module;
+extern LLVMBuilderRef phi_builder, alloca_builder;
+
+/* Number of frames of a call site in a loop body, i.e. of iterations whose spawned calls can run before a sync */
+static const unsigned spawnFrames = 64;
+
+/* The result of a spawned call is stored into its target at the next sync */
+typedef struct DeferredStore {
+	LLVMValueRef result;
+	LLVMValueRef target;
+} DeferredStore;
+
+/* A call spawned in a loop body takes the next frame of its call site. The targets of its results are kept
+ * next to the frame, so that the calls of many iterations can be synced together. */
+typedef struct SpawnSite {
+	LLVMValueRef frames;
+	LLVMValueRef targets;
+	LLVMValueRef used;
+	LLVMValueRef frame;
+	LLVMValueRef target;
+	unsigned numArgs;
+	unsigned numResults;
+} SpawnSite;
+
+/* Spawned calls and coroutine of the function being built */
+static SpawnState spawns = {NULL, NULL, 0, 0, NULL};
+static GeneratorState generator = {NULL, NULL, NULL, NULL, NULL};
+
+void* deferStore (LLVMValueRef result, LLVMValueRef target)
+{
+	DeferredStore *ds = malloc(sizeof(DeferredStore));
+	if (ds == NULL)
+		return logError("Could not allocate Memory.", 0x10C);
+	ds->result = result;
+	ds->target = target;
+	spawns.deferred = push(ds, 0, spawns.deferred);
+	return ds;
+}
+
+/* A direct store supersedes all results which are still on their way into the same variable */
+void forgetDeferredStores (LLVMValueRef target)
+{
+	stack **link = &spawns.deferred;
+	while (*link != NULL)
+	{
+		DeferredStore *ds = (*link)->item;
+		if (ds->target == target)
+			free(pop(link));
+		else
+			link = &((*link)->next);
+	}
+}
+
+static void buildSync ()
+{
+	LLVMTypeRef counterType = LLVMTypeOf(spawns.counter);
+	LLVMValueRef sync = getRuntimeFunction("phirt_sync", LLVMVoidTypeInContext(phi_context), &counterType, 1);
+	LLVMBuildCall(phi_builder, sync, &spawns.counter, 1, "");
+}
+
+/* Move the results of all frames in use into their targets, one iteration after the other, and free the frames */
+static void flushSpawnSites (stack *sites)
+{
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	for (stack *s = sites; s != NULL; s = s->next)
+	{
+		SpawnSite *site = s->item;
+		if (site->numResults != 0)
+		{
+			LLVMBasicBlockRef PreviousBlock = LLVMGetInsertBlock(phi_builder);
+			LLVMValueRef fn = LLVMGetBasicBlockParent(PreviousBlock);
+			LLVMBasicBlockRef CopyBlock = LLVMAppendBasicBlockInContext(phi_context, fn, "SpawnResults");
+			LLVMBasicBlockRef DoneBlock = LLVMAppendBasicBlockInContext(phi_context, fn, "SpawnResultsDone");
+			LLVMValueRef used = LLVMBuildLoad(phi_builder, site->used, "spawnsused");
+			LLVMValueRef any = LLVMBuildICmp(phi_builder, LLVMIntNE, used, LLVMConstNull(i64), "anyspawns");
+			LLVMBuildCondBr(phi_builder, any, CopyBlock, DoneBlock);
+
+			LLVMPositionBuilderAtEnd(phi_builder, CopyBlock);
+			LLVMValueRef i = LLVMBuildPhi(phi_builder, i64, "frame");
+			LLVMValueRef zero = LLVMConstNull(i64);
+			LLVMAddIncoming(i, &zero, &PreviousBlock, 1);
+			LLVMValueRef indices[2] = {zero, i};
+			LLVMValueRef frame = LLVMBuildInBoundsGEP(phi_builder, site->frames, indices, 2, "spawnframe");
+			LLVMValueRef targets = LLVMBuildInBoundsGEP(phi_builder, site->targets, indices, 2, "spawntargets");
+			for (unsigned k = 0; k < site->numResults; k++)
+			{
+				LLVMValueRef field = LLVMBuildStructGEP(phi_builder, frame, site->numArgs+k, "spawnresult");
+				LLVMValueRef result = LLVMBuildLoad(phi_builder, field, "spawnresult");
+				field = LLVMBuildStructGEP(phi_builder, targets, k, "spawntarget");
+				LLVMBuildStore(phi_builder, result, LLVMBuildLoad(phi_builder, field, "spawntarget"));
+			}
+			LLVMValueRef next = LLVMBuildAdd(phi_builder, i, LLVMConstInt(i64, 1, 0), "nextframe");
+			LLVMAddIncoming(i, &next, &CopyBlock, 1);
+			LLVMValueRef more = LLVMBuildICmp(phi_builder, LLVMIntULT, next, used, "moreframes");
+			LLVMBuildCondBr(phi_builder, more, CopyBlock, DoneBlock);
+			LLVMPositionBuilderAtEnd(phi_builder, DoneBlock);
+		}
+		LLVMBuildStore(phi_builder, LLVMConstNull(i64), site->used);
+	}
+}
+
+void syncSpawns ()
+{
+	if (spawns.pending == 0)
+		return;
+	buildSync();
+	spawns.pending = 0;
+
+	/* Move the results into their targets in the order they were stored, beginning with earlier iterations */
+	flushSpawnSites(spawns.sites);
+	stack *oldestFirst = NULL;
+	while (spawns.deferred != NULL)
+		oldestFirst = push(pop(&spawns.deferred), 0, oldestFirst);
+	while (oldestFirst != NULL)
+	{
+		DeferredStore *ds = pop(&oldestFirst);
+		LLVMValueRef result = LLVMBuildLoad(phi_builder, ds->result, "spawnresult");
+		LLVMBuildStore(phi_builder, result, ds->target);
+		free(ds);
+	}
+	loadDeferredValues();
+}
+
+ParallelState saveParallelState ()
+{
+	ParallelState outer = {spawns, generator};
+	spawns = (SpawnState){NULL, NULL, 0, 0, NULL};
+	generator = (GeneratorState){NULL, NULL, NULL, NULL, NULL};
+	return outer;
+}
+
+void restoreParallelState (ParallelState outer)
+{
+	clearStack(&spawns.deferred, free);
+	spawns = outer.spawns;
+	generator = outer.generator;
+}
+
+/* Generator and consumer must agree on the alignment of the yielded value */
+unsigned promiseAlignment (LLVMTypeRef yieldType)
+{
+	return LLVMABIAlignmentOfType(LLVMGetModuleDataLayout(phi_module), yieldType);
+}
+
+void beginGenerator (LLVMValueRef function, LLVMTypeRef yieldType)
+{
+	LLVMTypeRef i8ptr = LLVMPointerType(LLVMInt8TypeInContext(phi_context), 0);
+	LLVMTypeRef i32 = LLVMInt32TypeInContext(phi_context);
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMValueRef nullPtr = LLVMConstNull(i8ptr);
+	unsigned align = promiseAlignment(yieldType);
+	generator.promise = CreateEntryPointAlloca(function, yieldType, "promise");
+	LLVMSetAlignment(generator.promise, align);
+
+	/* The frame of the generator is allocated on the heap, unless LLVM can elide it */
+	LLVMValueRef idArgs[4] = {LLVMConstInt(i32, align, 0),
+		LLVMBuildBitCast(phi_builder, generator.promise, i8ptr, "promise"), nullPtr, nullPtr};
+	generator.id = callIntrinsic("llvm.coro.id", NULL, 0, idArgs, 4, "id");
+	/* Without this attribute the coroutine passes leave the function unsplit */
+	LLVMAddAttributeAtIndex(function, LLVMAttributeFunctionIndex,
+		LLVMCreateStringAttribute(phi_context, "coroutine.presplit", 18, "0", 1));
+	LLVMValueRef needAlloc = callIntrinsic("llvm.coro.alloc", NULL, 0, &generator.id, 1, "needalloc");
+	LLVMBasicBlockRef EntryBlock = LLVMGetInsertBlock(phi_builder);
+	LLVMBasicBlockRef AllocBlock = LLVMAppendBasicBlockInContext(phi_context, function, "CoroAlloc");
+	LLVMBasicBlockRef BeginBlock = LLVMAppendBasicBlockInContext(phi_context, function, "CoroBegin");
+	LLVMBuildCondBr(phi_builder, needAlloc, AllocBlock, BeginBlock);
+
+	LLVMPositionBuilderAtEnd(phi_builder, AllocBlock);
+	LLVMValueRef size = callIntrinsic("llvm.coro.size", &i64, 1, NULL, 0, "size");
+	LLVMValueRef allocate = getRuntimeFunction("malloc", i8ptr, &i64, 1);
+	LLVMValueRef memory = LLVMBuildCall(phi_builder, allocate, &size, 1, "memory");
+	LLVMBuildBr(phi_builder, BeginBlock);
+
+	LLVMPositionBuilderAtEnd(phi_builder, BeginBlock);
+	LLVMValueRef frame = LLVMBuildPhi(phi_builder, i8ptr, "frame");
+	LLVMAddIncoming(frame, &nullPtr, &EntryBlock, 1);
+	LLVMAddIncoming(frame, &memory, &AllocBlock, 1);
+	LLVMValueRef beginArgs[2] = {generator.id, frame};
+	generator.handle = callIntrinsic("llvm.coro.begin", NULL, 0, beginArgs, 2, "handle");
+	generator.Cleanup = LLVMCreateBasicBlockInContext(phi_context, "CoroCleanup");
+	generator.Suspend = LLVMCreateBasicBlockInContext(phi_context, "CoroSuspend");
+}
+
+/* Execution continues after a suspension point when the generator is resumed */
+void buildSuspend (int final)
+{
+	LLVMTypeRef i1 = LLVMInt1TypeInContext(phi_context);
+	LLVMTypeRef i8 = LLVMInt8TypeInContext(phi_context);
+	LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(phi_builder));
+	LLVMValueRef args[2] = {LLVMConstNull(LLVMTokenTypeInContext(phi_context)), LLVMConstInt(i1, final, 0)};
+	LLVMValueRef state = callIntrinsic("llvm.coro.suspend", NULL, 0, args, 2, "state");
+	LLVMBasicBlockRef ResumeBlock = LLVMAppendBasicBlockInContext(phi_context, fn, "Resume");
+	LLVMValueRef dispatch = LLVMBuildSwitch(phi_builder, state, generator.Suspend, 2);
+	LLVMAddCase(dispatch, LLVMConstInt(i8, 0, 0), ResumeBlock);
+	LLVMAddCase(dispatch, LLVMConstInt(i8, 1, 0), generator.Cleanup);
+	LLVMPositionBuilderAtEnd(phi_builder, ResumeBlock);
+	/* A finished generator must not be resumed */
+	if (final)
+		LLVMBuildUnreachable(phi_builder);
+}
+
+void endGenerator (LLVMValueRef function)
+{
+	LLVMTypeRef i1 = LLVMInt1TypeInContext(phi_context);
+	LLVMTypeRef i8ptr = LLVMPointerType(LLVMInt8TypeInContext(phi_context), 0);
+	LLVMTypeRef voidType = LLVMVoidTypeInContext(phi_context);
+	buildSuspend(1);
+
+	LLVMAppendExistingBasicBlock(function, generator.Cleanup);
+	LLVMPositionBuilderAtEnd(phi_builder, generator.Cleanup);
+	releaseHeapArrays();
+	LLVMValueRef freeArgs[2] = {generator.id, generator.handle};
+	LLVMValueRef memory = callIntrinsic("llvm.coro.free", NULL, 0, freeArgs, 2, "memory");
+	LLVMValueRef needFree = LLVMBuildICmp(phi_builder, LLVMIntNE, memory, LLVMConstNull(i8ptr), "needfree");
+	LLVMBasicBlockRef FreeBlock = LLVMAppendBasicBlockInContext(phi_context, function, "CoroFree");
+	LLVMBuildCondBr(phi_builder, needFree, FreeBlock, generator.Suspend);
+	LLVMPositionBuilderAtEnd(phi_builder, FreeBlock);
+	LLVMBuildCall(phi_builder, getRuntimeFunction("free", voidType, &i8ptr, 1), &memory, 1, "");
+	LLVMBuildBr(phi_builder, generator.Suspend);
+
+	LLVMAppendExistingBasicBlock(function, generator.Suspend);
+	LLVMPositionBuilderAtEnd(phi_builder, generator.Suspend);
+	LLVMValueRef endArgs[2] = {generator.handle, LLVMConstInt(i1, 0, 0)};
+	callIntrinsic("llvm.coro.end", NULL, 0, endArgs, 2, "");
+	LLVMTypeRef returnType = LLVMGetReturnType(LLVMGetElementType(LLVMTypeOf(function)));
+	LLVMBuildRet(phi_builder, LLVMBuildBitCast(phi_builder, generator.handle, returnType, "handle"));
+}
+
+/* The variable a yielded value is stored into, or NULL outside of a generator */
+LLVMValueRef generatorPromise ()
+{
+	return generator.handle == NULL ? NULL : generator.promise;
+}
+
+int isYield (const char *name)
+{
+	return strcmp(name, "yield") == 0;
+}
+
+/* The frame of a spawned call holds its arguments followed by its results.
+ * The wrapper unpacks the arguments, calls the function and packs the results. */
+static LLVMValueRef buildSpawnWrapper (LLVMValueRef function, LLVMTypeRef frameType)
+{
+	const char *calleeName = LLVMGetValueName(function);
+	char wrapperName[strlen(calleeName) + 7];
+	strcpy(wrapperName, calleeName);
+	strcat(wrapperName, ".spawn");
+	LLVMValueRef wrapper = LLVMGetNamedFunction(phi_module, wrapperName);
+	if (wrapper != NULL)
+		return wrapper;
+
+	LLVMTypeRef i8ptr = LLVMPointerType(LLVMInt8TypeInContext(phi_context), 0);
+	LLVMTypeRef wrapperType = LLVMFunctionType(LLVMVoidTypeInContext(phi_context), &i8ptr, 1, 0);
+	wrapper = LLVMAddFunction(phi_module, wrapperName, wrapperType);
+	LLVMSetLinkage(wrapper, LLVMInternalLinkage);
+	LLVMBasicBlockRef PreviousBlock = LLVMGetInsertBlock(phi_builder);
+	LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(phi_context, wrapper, "spawnEntry");
+	LLVMPositionBuilderAtEnd(phi_builder, entry);
+
+	LLVMValueRef frame = LLVMBuildBitCast(phi_builder, LLVMGetParam(wrapper, 0), LLVMPointerType(frameType, 0), "frame");
+	unsigned numArgs = LLVMCountParams(function);
+	LLVMValueRef args[numArgs];
+	for (unsigned i = 0; i < numArgs; i++)
+		args[i] = LLVMBuildLoad(phi_builder, LLVMBuildStructGEP(phi_builder, frame, i, "framefield"), "arg");
+	LLVMValueRef result = LLVMBuildCall(phi_builder, function, args, numArgs, "");
+	unsigned numResults = LLVMCountStructElementTypes(frameType) - numArgs;
+	if (numResults == 1)
+		LLVMBuildStore(phi_builder, result, LLVMBuildStructGEP(phi_builder, frame, numArgs, "framefield"));
+	else
+	{
+		for (unsigned i = 0; i < numResults; i++)
+		{
+			LLVMValueRef structElement = LLVMBuildExtractValue(phi_builder, result, i, "structelem");
+			LLVMBuildStore(phi_builder, structElement, LLVMBuildStructGEP(phi_builder, frame, numArgs+i, "framefield"));
+		}
+	}
+	LLVMBuildRetVoid(phi_builder);
+	LLVMPositionBuilderAtEnd(phi_builder, PreviousBlock);
+	return wrapper;
+}
+
+/* Until the end of the loop body stores the targets next to the frame, the results are stored into themselves */
+static LLVMValueRef nextSpawnFrame (LLVMTypeRef frameType, unsigned numArgs, unsigned numResults)
+{
+	SpawnSite *site = malloc(sizeof(SpawnSite));
+	if (site == NULL)
+		return logError("Could not allocate Memory.", 0x10C);
+	site->numArgs = numArgs;
+	site->numResults = numResults;
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	site->frames = CreateVariable(LLVMArrayType(frameType, spawnFrames), 0, "spawnframes");
+	site->used = CreateEntryPointAlloca(NULL, i64, "spawnsused");
+	LLVMBuildStore(alloca_builder, LLVMConstNull(i64), site->used);
+	LLVMValueRef used = LLVMBuildLoad(phi_builder, site->used, "spawnsused");
+	LLVMValueRef indices[2] = {LLVMConstNull(i64), used};
+	site->frame = LLVMBuildInBoundsGEP(phi_builder, site->frames, indices, 2, "spawnframe");
+	if (numResults != 0)
+	{
+		LLVMTypeRef targetTypes[numResults];
+		for (unsigned i = 0; i < numResults; i++)
+			targetTypes[i] = LLVMPointerType(LLVMStructGetTypeAtIndex(frameType, numArgs+i), 0);
+		LLVMTypeRef targetType = LLVMStructTypeInContext(phi_context, targetTypes, numResults, 0);
+		site->targets = CreateVariable(LLVMArrayType(targetType, spawnFrames), 0, "spawntargets");
+		site->target = LLVMBuildInBoundsGEP(phi_builder, site->targets, indices, 2, "spawntargets");
+		for (unsigned i = 0; i < numResults; i++)
+		{
+			LLVMValueRef result = LLVMBuildStructGEP(phi_builder, site->frame, numArgs+i, "spawnresult");
+			LLVMBuildStore(phi_builder, result, LLVMBuildStructGEP(phi_builder, site->target, i, "spawntarget"));
+		}
+	}
+	LLVMBuildStore(phi_builder, LLVMBuildAdd(phi_builder, used, LLVMConstInt(i64, 1, 0), "spawnsused"), site->used);
+	spawns.sites = push(site, 0, spawns.sites);
+	return site->frame;
+}
+
+/* Hands a call over to the runtime. Returns its frame, which holds the results after the next sync. */
+LLVMValueRef buildSpawn (LLVMValueRef function, LLVMValueRef *args, unsigned numResults)
+{
+	unsigned numArgs = LLVMCountParams(function);
+	LLVMTypeRef returnType = LLVMGetReturnType(LLVMGetElementType(LLVMTypeOf(function)));
+	LLVMTypeRef frameTypes[numArgs + numResults];
+	for (unsigned i = 0; i < numArgs; i++)
+		frameTypes[i] = LLVMTypeOf(args[i]);
+	if (numResults == 1)
+		frameTypes[numArgs] = returnType;
+	else
+		for (unsigned i = 0; i < numResults; i++)
+			frameTypes[numArgs+i] = LLVMStructGetTypeAtIndex(returnType, i);
+	LLVMTypeRef frameType = LLVMStructTypeInContext(phi_context, frameTypes, numArgs + numResults, 0);
+	LLVMValueRef wrapper = buildSpawnWrapper(function, frameType);
+
+	/* Every function counts its unfinished spawned calls */
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	if (spawns.counter == NULL)
+	{
+		spawns.counter = CreateEntryPointAlloca(NULL, i64, "spawns");
+		LLVMBuildStore(alloca_builder, LLVMConstNull(i64), spawns.counter);
+	}
+	LLVMValueRef frame;
+	if (spawns.inLoop)
+		frame = nextSpawnFrame(frameType, numArgs, numResults);
+	else
+		frame = CreateEntryPointAlloca(NULL, frameType, "spawnframe");
+	if (frame == NULL)
+		return NULL;
+	for (unsigned i = 0; i < numArgs; i++)
+		LLVMBuildStore(phi_builder, args[i], LLVMBuildStructGEP(phi_builder, frame, i, "framefield"));
+
+	LLVMTypeRef i8ptr = LLVMPointerType(LLVMInt8TypeInContext(phi_context), 0);
+	LLVMTypeRef params[3] = {LLVMTypeOf(spawns.counter), LLVMTypeOf(wrapper), i8ptr};
+	LLVMValueRef spawn = getRuntimeFunction("phirt_spawn", LLVMVoidTypeInContext(phi_context), params, 3);
+	LLVMValueRef spawnArgs[3] = {spawns.counter, wrapper, LLVMBuildBitCast(phi_builder, frame, i8ptr, "frame")};
+	LLVMBuildCall(phi_builder, spawn, spawnArgs, 3, "");
+	spawns.pending++;
+	return frame;
+}
+
+/* The variable which a pointer into it was derived from */
+static LLVMValueRef baseVariable (LLVMValueRef ptr)
+{
+	while (LLVMIsAGetElementPtrInst(ptr) || LLVMIsABitCastInst(ptr) || LLVMIsAExtractValueInst(ptr)
+			|| LLVMIsALoadInst(ptr) || (LLVMIsAInstruction(ptr) && LLVMGetInstructionOpcode(ptr) == LLVMFreeze))
+		ptr = LLVMGetOperand(ptr, 0);
+	return ptr;
+}
+
+static int isSyncPoint (const char *name)
+{
+	return strcmp(name, "sync") == 0 || isYield(name);
+}
+
+/* Whether the name refers to a variable which a spawned call has still to store its result into */
+static int awaitsResult (const char *name)
+{
+	LLVMValueRef variable = lookupVariable(name);
+	if (variable == NULL)
+		return 0;
+	variable = baseVariable(variable);
+	for (stack *d = spawns.deferred; d != NULL; d = d->next)
+	{
+		DeferredStore *ds = d->item;
+		if (baseVariable(ds->target) == variable)
+			return 1;
+	}
+	return 0;
+}
+
+/* Calls spawned before an if stay pending across it, unless a branch syncs or writes one of their targets,
+ * or one of their results is still on the stack */
+int branchesNeedSync (CondExpr *ce)
+{
+	if (spawns.pending == 0)
+		return 0;
+	if (hasDeferredValues())
+		return 1;
+	return anyName(ce->True, isSyncPoint) || anyName(ce->False, isSyncPoint)
+		|| anyName(ce->True, awaitsResult) || anyName(ce->False, awaitsResult);
+}
+
+/* Calls spawned in a branch are synced at its end, which must not deliver the results of earlier calls on one path only */
+SpawnState enterSpawnScope ()
+{
+	SpawnState outer = spawns;
+	spawns.deferred = NULL;
+	spawns.pending = 0;
+	spawns.inLoop = 0;
+	spawns.sites = NULL;
+	return outer;
+}
+
+void leaveSpawnScope (SpawnState outer)
+{
+	syncSpawns();
+	outer.counter = spawns.counter;
+	spawns = outer;
+}
+
+/* Calls spawned in a loop body get a frame per iteration, which their sites reserve for the whole loop */
+SpawnState enterSpawnLoop ()
+{
+	SpawnState outer = spawns;
+	spawns.inLoop = 1;
+	spawns.sites = NULL;
+	return outer;
+}
+
+/* The name of a variable which a result is stored into, or NULL if it is stored into an array another variable
+ * refers to */
+static const char* ownTarget (LLVMValueRef target)
+{
+	while (LLVMIsAGetElementPtrInst(target))
+		target = LLVMGetOperand(target, 0);
+	if (LLVMIsAAllocaInst(target) && !isSliceType(LLVMGetAllocatedType(target)))
+		return LLVMGetValueName(target);
+	if (LLVMIsABitCastInst(target) && LLVMIsACallInst(LLVMGetOperand(target, 0)))
+		return LLVMGetValueName(target);
+	return NULL;
+}
+
+static const char *countedName;
+static unsigned nameCount;
+
+/* Counts the names which may refer to the counted variable, including slices, which may be views of it */
+static int countName (const char *name)
+{
+	size_t len = strlen(name) < strlen(countedName) ? strlen(name) : strlen(countedName);
+	LLVMValueRef variable = lookupVariable(name);
+	if (strncmp(name, countedName, len) == 0 || (variable != NULL && !isReadOnly(variable)
+			&& isSliceType(LLVMGetElementType(LLVMTypeOf(variable)))))
+		nameCount++;
+	return 0;
+}
+
+/* The frame a result points into, if its call was spawned in the loop body being built */
+static SpawnSite* frameSite (LLVMValueRef result)
+{
+	for (stack *s = spawns.sites; s != NULL; s = s->next)
+	{
+		SpawnSite *site = s->item;
+		if (LLVMGetOperand(result, 0) == site->frame)
+			return site;
+	}
+	return NULL;
+}
+
+/* The calls of an iteration need not be synced at its end, if their results are stored into variables the loop
+ * does not use otherwise, and into nothing else */
+static int deferIteration (Expr *body, Expr *cond)
+{
+	if (spawns.pending == 0 || anyName(body, isSyncPoint) || anyName(cond, isSyncPoint))
+		return 0;
+	if (hasDeferredValues())
+		return 0;
+	for (stack *d = spawns.deferred; d != NULL; d = d->next)
+	{
+		DeferredStore *ds = d->item;
+		if (frameSite(ds->result) == NULL || (countedName = ownTarget(ds->target)) == NULL)
+			return 0;
+		for (stack *e = d->next; e != NULL; e = e->next)
+			if (((DeferredStore*) e->item)->result == ds->result)
+				return 0;
+		nameCount = 0;
+		anyName(body, countName);
+		anyName(cond, countName);
+		if (nameCount != 1)
+			return 0;
+	}
+	return 1;
+}
+
+/* At the end of a loop body, the calls spawned in it keep running and their targets are stored next to their
+ * frames, unless the loop uses these otherwise. Only when a site has no free frame left, all calls are synced.
+ * Returns the sites whose calls are still running after the loop. */
+stack* leaveSpawnLoop (SpawnState outer, Expr *body, Expr *cond)
+{
+	stack *sites = spawns.sites;
+	if (!deferIteration(body, cond))
+	{
+		/* Every iteration syncs its own calls, whose frames then only need to be freed */
+		spawns.sites = NULL;
+		syncSpawns();
+		for (stack *s = sites; s != NULL; s = s->next)
+			LLVMBuildStore(phi_builder, LLVMConstNull(LLVMInt64TypeInContext(phi_context)), ((SpawnSite*) s->item)->used);
+		clearStack(&sites, free);
+	}
+	else
+	{
+		while (spawns.deferred != NULL)
+		{
+			DeferredStore *ds = pop(&spawns.deferred);
+			SpawnSite *site = frameSite(ds->result);
+			unsigned field = LLVMConstIntGetZExtValue(LLVMGetOperand(ds->result, 2)) - site->numArgs;
+			LLVMBuildStore(phi_builder, ds->target, LLVMBuildStructGEP(phi_builder, site->target, field, "spawntarget"));
+			free(ds);
+		}
+		LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+		LLVMValueRef full = LLVMConstNull(LLVMInt1TypeInContext(phi_context));
+		for (stack *s = sites; s != NULL; s = s->next)
+		{
+			LLVMValueRef used = LLVMBuildLoad(phi_builder, ((SpawnSite*) s->item)->used, "spawnsused");
+			LLVMValueRef isFull = LLVMBuildICmp(phi_builder, LLVMIntEQ, used, LLVMConstInt(i64, spawnFrames, 0), "full");
+			full = LLVMBuildOr(phi_builder, full, isFull, "full");
+		}
+		LLVMValueRef fn = LLVMGetBasicBlockParent(LLVMGetInsertBlock(phi_builder));
+		LLVMBasicBlockRef SyncBlock = LLVMAppendBasicBlockInContext(phi_context, fn, "SyncSpawns");
+		LLVMBasicBlockRef NextBlock = LLVMAppendBasicBlockInContext(phi_context, fn, "NextIteration");
+		LLVMBuildCondBr(phi_builder, full, SyncBlock, NextBlock);
+		LLVMPositionBuilderAtEnd(phi_builder, SyncBlock);
+		buildSync();
+		flushSpawnSites(sites);
+		LLVMBuildBr(phi_builder, NextBlock);
+		LLVMPositionBuilderAtEnd(phi_builder, NextBlock);
+	}
+	outer.counter = spawns.counter;
+	spawns = outer;
+	return sites;
+}
+
+/* Calls still running after a loop are synced right after it */
+void syncSpawnLoop (stack **sites)
+{
+	if (*sites == NULL)
+		return;
+	buildSync();
+	flushSpawnSites(*sites);
+	clearStack(sites, free);
+}
+
+/* Arrays, vectors, slices, matrices, complex vectors and arrays of records in SoA layout */
+static int hasElements (LLVMTypeRef type)
+{
+	LLVMTypeKind kind = LLVMGetTypeKind(type);
+	if (kind == LLVMArrayTypeKind || kind == LLVMVectorTypeKind)
+		return 1;
+	return isSliceType(type) || isMatrixType(type) || complexLanes(type) != 0 || soaElementType(type) != NULL;
+}
+
+static LLVMValueRef buildParallelWorker (ForExpr *fe, LLVMTypeRef envType, LLVMValueRef *captured, unsigned numVars,
+		LLVMValueRef *reduced, LLVMIntPredicate pred, LLVMValueRef step)
+{
+	LLVMTypeRef vartype = LLVMTypeOf(step);
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMTypeRef i8ptr = LLVMPointerType(LLVMInt8TypeInContext(phi_context), 0);
+	LLVMTypeRef voidType = LLVMVoidTypeInContext(phi_context);
+
+	LLVMValueRef caller = LLVMGetBasicBlockParent(LLVMGetInsertBlock(phi_builder));
+	const char *callerName = LLVMGetValueName(caller);
+	char workerName[strlen(callerName) + 8];
+	strcpy(workerName, callerName);
+	strcat(workerName, ".parfor");
+	LLVMTypeRef params[3] = {i64, i64, i8ptr};
+	LLVMValueRef worker = LLVMAddFunction(phi_module, workerName, LLVMFunctionType(voidType, params, 3, 0));
+	LLVMSetLinkage(worker, LLVMInternalLinkage);
+	setFloatingPointAttributes(worker);
+	LLVMBasicBlockRef entry = LLVMAppendBasicBlockInContext(phi_context, worker, "parEntry");
+	LLVMPositionBuilderAtEnd(phi_builder, entry);
+
+	/* Recreate the variables of the caller in the same order, so that shadowing is preserved */
+	LLVMValueRef env = LLVMBuildBitCast(phi_builder, LLVMGetParam(worker, 2), LLVMPointerType(envType, 0), "env");
+	LLVMValueRef loopParams[4];
+	for (unsigned i = 0; i < 4; i++)
+		loopParams[i] = LLVMBuildLoad(phi_builder, LLVMBuildStructGEP(phi_builder, env, i, "envfield"), "loopparam");
+	LLVMValueRef workerVars[numVars];
+	for (int i = numVars-1; i >= 0; i--)
+	{
+		LLVMValueRef field = LLVMBuildStructGEP(phi_builder, env, i+4, "envfield");
+		workerVars[i] = LLVMBuildLoad(phi_builder, field, LLVMGetValueName(captured[i]));
+		if (isUnsigned(captured[i]))
+			markUnsigned(workerVars[i]);
+		declareVariable(workerVars[i]);
+	}
+
+	/* Every call accumulates the reductions in private variables first */
+	unsigned numReduced = depth(fe->reductions);
+	LLVMValueRef shared[numReduced], private[numReduced];
+	stack *red = fe->reductions;
+	for (unsigned k = 0; k < numReduced; k++, red = red->next)
+	{
+		for (unsigned i = 0; i < numVars; i++)
+			if (captured[i] == reduced[k])
+				shared[k] = workerVars[i];
+		LLVMTypeRef type = LLVMGetElementType(LLVMTypeOf(shared[k]));
+		LLVMValueRef identity = reductionIdentity(red->misc, type, isUnsigned(shared[k]));
+		if (identity == NULL)
+		{
+			LLVMDeleteFunction(worker);
+			return NULL;
+		}
+		private[k] = CreateEntryPointAlloca(worker, type, LLVMGetValueName(shared[k]));
+		if (isUnsigned(shared[k]))
+			markUnsigned(private[k]);
+		LLVMBuildStore(phi_builder, identity, private[k]);
+		declareVariable(private[k]);
+	}
+
+	/* Translate the iterations [first, last) into values of the loop variable */
+	LLVMValueRef first = LLVMGetParam(worker, 0);
+	LLVMValueRef last = LLVMGetParam(worker, 1);
+	LLVMValueRef offset = LLVMBuildMul(phi_builder, first, loopParams[2], "offset");
+	LLVMValueRef start = LLVMBuildAdd(phi_builder, loopParams[0], offset, "start");
+	offset = LLVMBuildMul(phi_builder, last, loopParams[2], "offset");
+	LLVMValueRef end = LLVMBuildAdd(phi_builder, loopParams[0], offset, "end");
+	LLVMValueRef isLast = LLVMBuildICmp(phi_builder, LLVMIntEQ, last, loopParams[3], "islast");
+	end = LLVMBuildSelect(phi_builder, isLast, loopParams[1], end, "end");
+	LLVMValueRef bounds[3];
+	bounds[0] = LLVMBuildTrunc(phi_builder, start, vartype, "start");
+	bounds[1] = LLVMBuildTrunc(phi_builder, end, vartype, "end");
+	bounds[2] = step;
+	if (buildCountedLoop(fe, bounds, pred, NULL) == NULL)
+	{
+		LLVMDeleteFunction(worker);
+		return NULL;
+	}
+
+	/* Combine the private results with the shared variables */
+	if (numReduced != 0)
+	{
+		LLVMBuildCall(phi_builder, getRuntimeFunction("phirt_critical_enter", voidType, NULL, 0), NULL, 0, "");
+		red = fe->reductions;
+		for (unsigned k = 0; k < numReduced; k++, red = red->next)
+		{
+			LLVMValueRef lhs = LLVMBuildLoad(phi_builder, shared[k], "shared");
+			LLVMValueRef rhs = LLVMBuildLoad(phi_builder, private[k], "private");
+			if (isUnsigned(shared[k]))
+			{
+				markUnsigned(lhs);
+				markUnsigned(rhs);
+			}
+			LLVMValueRef combined = buildReduction(red->misc, lhs, rhs);
+			if (combined == NULL)
+			{
+				LLVMDeleteFunction(worker);
+				return NULL;
+			}
+			LLVMBuildStore(phi_builder, combined, shared[k]);
+		}
+		LLVMBuildCall(phi_builder, getRuntimeFunction("phirt_critical_exit", voidType, NULL, 0), NULL, 0, "");
+	}
+	releaseHeapArrays();
+	LLVMBuildRetVoid(phi_builder);
+	checkAllocations(worker);
+	return worker;
+}
+
+LLVMValueRef codegenParallelForExpr (ForExpr *fe, LLVMValueRef bounds[3], LLVMIntPredicate pred)
+{
+	LLVMTypeRef i64 = LLVMInt64TypeInContext(phi_context);
+	LLVMTypeRef i8ptr = LLVMPointerType(LLVMInt8TypeInContext(phi_context), 0);
+	LLVMTypeRef voidType = LLVMVoidTypeInContext(phi_context);
+
+	/* Compute the number of iterations in 64 bits */
+	LLVMValueRef loopParams[4];
+	int isUnsignedLoop = (pred == LLVMIntULT || pred == LLVMIntUGT);
+	for (unsigned i = 0; i < 3; i++)
+		loopParams[i] = LLVMBuildIntCast2(phi_builder, bounds[i], i64, i == 2 || !isUnsignedLoop, "bound");
+	LLVMValueRef distance = LLVMBuildSub(phi_builder, loopParams[1], loopParams[0], "distance");
+	LLVMValueRef rounding = LLVMConstInt(i64, (pred == LLVMIntSLT || pred == LLVMIntULT) ? -1 : 1, 1);
+	rounding = LLVMBuildAdd(phi_builder, loopParams[2], rounding, "rounding");
+	distance = LLVMBuildAdd(phi_builder, distance, rounding, "distance");
+	LLVMValueRef count = LLVMBuildSDiv(phi_builder, distance, loopParams[2], "tripcount");
+	LLVMValueRef nonEmpty = LLVMBuildICmp(phi_builder, pred, bounds[0], bounds[1], "parguard");
+	count = LLVMBuildSelect(phi_builder, nonEmpty, count, LLVMConstNull(i64), "tripcount");
+	loopParams[3] = count;
+
+	/* The reduced variables must be ordinary variables outside of the loop */
+	unsigned numReduced = depth(fe->reductions);
+	LLVMValueRef reduced[numReduced];
+	stack *red = fe->reductions;
+	for (unsigned k = 0; k < numReduced; k++, red = red->next)
+	{
+		reduced[k] = lookupVariable(red->item);
+		if (reduced[k] == NULL || isReadOnly(reduced[k]))
+			return logError("Reduction over an unknown or read-only variable.", 0x2906);
+	}
+
+	/* Capture all variables in scope. Variables with elements and reduced variables are shared with the loop
+	 * body, all other variables are passed by value and cannot be changed inside the loop. */
+	unsigned numVars = depth(variablesInScope());
+	LLVMValueRef captured[numVars];
+	LLVMTypeRef envTypes[numVars + 4];
+	for (unsigned i = 0; i < 4; i++)
+		envTypes[i] = i64;
+	stack *r = variablesInScope();
+	for (unsigned i = 0; i < numVars; i++, r = r->next)
+	{
+		LLVMValueRef var = r->item;
+		int isShared = isReadOnly(var);
+		for (unsigned k = 0; k < numReduced; k++)
+			isShared |= (var == reduced[k]);
+		if (!isShared && !hasElements(LLVMGetElementType(LLVMTypeOf(var))))
+			var = LLVMBuildLoad(phi_builder, var, LLVMGetValueName(var));
+		captured[i] = var;
+		envTypes[i+4] = LLVMTypeOf(var);
+	}
+	LLVMTypeRef envType = LLVMStructTypeInContext(phi_context, envTypes, numVars+4, 0);
+	LLVMValueRef env = CreateEntryPointAlloca(NULL, envType, "parenv");
+	for (unsigned i = 0; i < 4; i++)
+		LLVMBuildStore(phi_builder, loopParams[i], LLVMBuildStructGEP(phi_builder, env, i, "envfield"));
+	for (unsigned i = 0; i < numVars; i++)
+		LLVMBuildStore(phi_builder, captured[i], LLVMBuildStructGEP(phi_builder, env, i+4, "envfield"));
+
+	/* Outline the loop body into a worker function */
+	LLVMBasicBlockRef PreviousBlock = LLVMGetInsertBlock(phi_builder);
+	LLVMValueRef fn = LLVMGetBasicBlockParent(PreviousBlock);
+	enterNestedFunction();
+	ParallelState caller = saveParallelState();
+	LLVMValueRef worker = buildParallelWorker(fe, envType, captured, numVars, reduced, pred, bounds[2]);
+	restoreParallelState(caller);
+	leaveNestedFunction();
+	LLVMPositionBuilderAtEnd(phi_builder, PreviousBlock);
+	if (worker == NULL)
+		return NULL;
+	if (LLVMVerifyFunction(worker, LLVMPrintMessageAction) == 1)
+	{
+		LLVMDeleteFunction(worker);
+		return NULL;
+	}
+	extern LLVMPassManagerRef phi_passManager;
+	LLVMRunFunctionPassManager(phi_passManager, worker);
+
+	/* Create new Blocks for the parallel Loop, Else and the Merge */
+	LLVMBasicBlockRef LoopBlock = LLVMAppendBasicBlockInContext(phi_context, fn, "ParallelFor");
+	LLVMBasicBlockRef ElseBlock = LLVMCreateBasicBlockInContext(phi_context, "ElseBlock");
+	LLVMBasicBlockRef MergeBlock = LLVMCreateBasicBlockInContext(phi_context, "AfterFor");
+	LLVMBuildCondBr(phi_builder, nonEmpty, LoopBlock, ElseBlock);
+
+	/* Hand the worker over to the runtime */
+	clearValues();
+	LLVMPositionBuilderAtEnd(phi_builder, LoopBlock);
+	LLVMTypeRef bodyParams[3] = {i64, i64, i8ptr};
+	LLVMTypeRef bodyType = LLVMPointerType(LLVMFunctionType(voidType, bodyParams, 3, 0), 0);
+	LLVMTypeRef params[3] = {i64, bodyType, i8ptr};
+	LLVMValueRef parallelFor = getRuntimeFunction("phirt_parallel_for", voidType, params, 3);
+	LLVMValueRef args[3] = {count, worker, LLVMBuildBitCast(phi_builder, env, i8ptr, "env")};
+	LLVMBuildCall(phi_builder, parallelFor, args, 3, "");
+	LLVMBuildBr(phi_builder, MergeBlock);
+
+	/* Build the Else Block */
+	LLVMAppendExistingBasicBlock(fn, ElseBlock);
+	LLVMPositionBuilderAtEnd(phi_builder, ElseBlock);
+	if (fe->Else != NULL)
+	{
+		enterBranch();
+		LLVMValueRef falseVal = codegen(fe->Else, 1);
+		leaveBranch();
+		if (falseVal == NULL)
+			return NULL;
+		syncSpawns();
+	}
+	LLVMBuildBr(phi_builder, MergeBlock);
+
+	/* Reunite Branches */
+	clearValues();
+	LLVMAppendExistingBasicBlock(fn, MergeBlock);
+	LLVMPositionBuilderAtEnd(phi_builder, MergeBlock);
+
+	LLVMValueRef voidVal = LLVMGetUndef(voidType);
+	return voidVal;
+}
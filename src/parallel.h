@@ -0,0 +1,52 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <llvm-c/Core.h>
+#include "stack.h"
+#include "ast.h"
+
+/* Calls spawned by the function being built, which have not been synced yet */
+typedef struct SpawnState {
+	LLVMValueRef counter;
+	stack *deferred;
+	unsigned pending;
+	int inLoop;
+	stack *sites;
+} SpawnState;
+
+/* The coroutine of the generator being built */
+typedef struct GeneratorState {
+	LLVMValueRef id;
+	LLVMValueRef handle;
+	LLVMValueRef promise;
+	LLVMBasicBlockRef Cleanup;
+	LLVMBasicBlockRef Suspend;
+} GeneratorState;
+
+/* A function may be built in the middle of another one, which keeps its own spawned calls and coroutine */
+typedef struct ParallelState {
+	SpawnState spawns;
+	GeneratorState generator;
+} ParallelState;
+
+ParallelState saveParallelState ();
+void restoreParallelState (ParallelState outer);
+void* deferStore (LLVMValueRef result, LLVMValueRef target);
+void forgetDeferredStores (LLVMValueRef target);
+void syncSpawns ();
+LLVMValueRef buildSpawn (LLVMValueRef function, LLVMValueRef *args, unsigned numResults);
+int branchesNeedSync (CondExpr *ce);
+SpawnState enterSpawnScope ();
+void leaveSpawnScope (SpawnState outer);
+SpawnState enterSpawnLoop ();
+stack* leaveSpawnLoop (SpawnState outer, Expr *body, Expr *cond);
+void syncSpawnLoop (stack **sites);
+int isYield (const char *name);
+unsigned promiseAlignment (LLVMTypeRef yieldType);
+void beginGenerator (LLVMValueRef function, LLVMTypeRef yieldType);
+LLVMValueRef generatorPromise ();
+void buildSuspend (int final);
+void endGenerator (LLVMValueRef function);
+LLVMValueRef codegenParallelForExpr (ForExpr *fe, LLVMValueRef bounds[3], LLVMIntPredicate pred);
+
+#endif /* PARALLEL_H_ */
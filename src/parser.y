@@ -1,29 +1,39 @@
 %{
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "ast.h"
 #include "stack.h"
 #include "codegen.h"
 #include "templating.h"
+#include "records.h"
 %}
 %union
 {
 	int integral;
+	long long wide;
 	void *pointer;
 	double numerical;
 }
 %token keyword_new keyword_extern keyword_from keyword_compile
 %token keyword_if keyword_else keyword_while keyword_end
-%token type_real type_bool type_int type_template
-%token tok_new tok_var tok_func tok_arrow
+%token keyword_for keyword_to keyword_step keyword_parallel keyword_reduce
+%token keyword_spawn keyword_in keyword_strict keyword_record
+%token type_real type_bool type_int
+%token type_float32 type_int64 type_int16 type_int8 type_uint type_complex
+%token tok_new tok_var tok_func tok_arrow tok_vecopen tok_vecclose
 %token <integral>	tok_int tok_bool tok_vec tok_array
-%token <pointer>	tok_ident
-%token <numerical>	tok_real
-
-%type <integral>	TYPEARG PRIMTYPE VECTOR ARRAY TEMPCALL
-%type <pointer>		TOPLEVEL QUEUE MINIMAL COMMAND IFBLOCK LOOPEXP
-%type <pointer>		DECLARATION DEFINITION TYPESIG
+%token <integral>	type_template tok_vecparam tok_arrayparam tok_funcparam type_record keyword_layout
+%token <integral>	keyword_vectorize keyword_unroll keyword_interleave keyword_align
+%token <wide>		tok_uint tok_long
+%token <pointer>	tok_ident tok_field
+%token <numerical>	tok_real tok_float32 tok_imaginary
+
+%type <integral>	PRIMTYPE FIXEDTYPE VECTOR ARRAY DIMENSION REDUCTION LAYOUT
+%type <pointer>		TYPEARG FIXEDARG TEMPCALL TEMPARGS TOPLEVEL QUEUE MINIMAL COMMAND IFBLOCK LOOPEXP FORHEAD FORLOOP FOREACH
+%type <pointer>		DECLARATION DEFINITION TYPESIG INSIG RETSIG
 %type <pointer>		EXPRESSION BINARYOP PRIMARY IDENTIFY MALFORMED
-%type <pointer>		PARENEX SUBSCRIPT TEMPLATE
+%type <pointer>		PARENEX SUBSCRIPT TEMPLATE TEMPVARS ELEMENTS
 
 %right '='
 
@@ -33,21 +43,110 @@
 %left '%'
 %left '*' '/'
 %{
-	extern char *templateVar;
+	extern stack *templateVars;
 	extern int yylex();
 	static int yyerror();
 	static int needsName;
 	const char *filename = "";
 #define ERROR(a,b,c) { fprintf(stderr, "%s:%i:%i: ", filename, c.first_line, c.first_column); \
 	logError(a, b); YYERROR; }
+
+/* Records are passed as recordTypes+index in place of a type token */
+static const int recordTypes = 0x10000;
+
+/* Template parameters are passed as -1-index in place of a type token or size */
+static TypeDesc* typeArg (int base, int vecsize, int arraysize)
+{
+	int isRecord = (base >= recordTypes);
+	TypeDesc *td = newTypeDesc(base < 0 ? type_template : isRecord ? type_record : base, vecsize < 0 ? 0 : vecsize,
+			arraysize < 0 ? 0 : arraysize);
+	if (td == NULL)
+		return NULL;
+	td->param = base < 0 ? -1 - base : isRecord ? base - recordTypes : 0;
+	td->vecParam = vecsize < 0 ? -vecsize : 0;
+	td->arrayParam = arraysize < 0 ? -arraysize : 0;
+	return td;
+}
+
+static int isAlignment (int align)
+{
+	return align > 0 && (align & (align - 1)) == 0;
+}
+
+/* A function parameter is bound at every call site, just like a template parameter */
+static Param* functionParam (char *name)
+{
+	templateVars = push(strdup(name), 0, templateVars);
+	return newParam(name, NULL);
+}
+
+/* Parameters are stacked with the last one first */
+static stack* appendParams (stack *params, stack *more)
+{
+	stack *last = more;
+	while (last->next != NULL)
+		last = last->next;
+	last->next = params;
+	return more;
+}
+
+static TypeDesc* sliceArg (int base, int vecsize)
+{
+	TypeDesc *td = typeArg(base, vecsize, 0);
+	if (td != NULL)
+		td->slice = 1;
+	return td;
+}
+
+static TypeDesc* matrixArg (int base, int rows, int columns, int arraysize)
+{
+	TypeDesc *td = typeArg(base, columns, arraysize);
+	if (td == NULL)
+		return NULL;
+	td->rows = rows < 0 ? 0 : rows;
+	td->rowParam = rows < 0 ? -rows : 0;
+	return td;
+}
+
+/* Two integers, or integer template parameters, after a name that is no template declare a matrix, e.g. m:<4,4> */
+static int isMatrixShape (stack *args)
+{
+	if (depth(args) != 2)
+		return 0;
+	for (stack *runner = args; runner != NULL; runner = runner->next)
+	{
+		TypeDesc *td = runner->item;
+		if (td != NULL && (td->base != type_template || td->vecsize != 0 || td->arraysize != 0
+				|| td->vecParam != 0 || td->arrayParam != 0 || td->rows != 0 || td->slice))
+			return 0;
+	}
+	return 1;
+}
+
+static Expr* matrixIdent (char *name, stack *args)
+{
+	Expr *e = newIdentExpr(name, id_vec, 0);
+	if (e != NULL)
+	{
+		IdentExpr *ie = e->expr;
+		TypeDesc *columns = args->item;
+		TypeDesc *rows = args->next->item;
+		ie->size = args->misc;
+		ie->sizeParam = columns == NULL ? 0 : columns->param + 1;
+		ie->rows = args->next->misc;
+		ie->rowParam = rows == NULL ? 0 : rows->param + 1;
+	}
+	clearStack(&args, free);
+	return e;
+}
 %}
 %%
 INPUT :
-      | INPUT				{ templateVar = NULL; }
+      | INPUT				{ templateVars = NULL; }
 	TOPLEVEL			{ codegen($3, 1);
-					  if (templateVar != NULL)
+					  if (templateVars != NULL)
 					  {
-						free(templateVar);
+						clearStack(&templateVars, free);
 						free($3);
 					  }
 					  else
@@ -58,20 +157,36 @@ TOPLEVEL : error			{ $$ = NULL; }
 	 | keyword_extern		{ needsName = 0; }
 		DECLARATION		{ $$ = $3; }
 	 | keyword_extern		{ needsName = 0; }
-		TEMPLATE		{ templateVar = $3; }
+		TEMPLATE		{ templateVars = $3; }
 		DECLARATION		{ $$ = $5; }
 	 | keyword_new			{ needsName = 1; }
 		DEFINITION		{ $$ = $3; }
 	 | keyword_new			{ needsName = 1; }
-		TEMPLATE		{ templateVar = $3; }
+		TEMPLATE		{ templateVars = $3; }
 		DEFINITION		{ $$ = $5; }
 	 | keyword_new			{ needsName = 1; }
-		'!' TEMPCALL DEFINITION	{ compileTemplatePredefined($5, $4); $$ = NULL; clearExpr($5); }
+		'!' TEMPCALL DEFINITION	{ compileTemplatePredefined($5, $4); $$ = NULL; clearExpr($5); clearStack((stack**)&($4), free); }
+	 | keyword_new keyword_strict	{ needsName = 1; }
+		DEFINITION		{ $$ = setStrict($4); }
+	 | keyword_new keyword_strict	{ needsName = 1; }
+		TEMPLATE		{ templateVars = $4; }
+		DEFINITION		{ $$ = setStrict($6); }
 	 | keyword_compile COMPILE	{ $$ = NULL; }
+	 | keyword_record tok_ident LAYOUT { needsName = 1; }
+		TYPESIG keyword_end	{ defineRecord($2, $5, $3); $$ = NULL; }
+	 | keyword_record tok_ident LAYOUT error { free($2); ERROR("Expected the named fields of the record, followed by \"end\".", 0x1A02, @4); }
+	 | keyword_record type_record	{ ERROR("A record of this name has already been defined.", 0x1A03, @2); }
+	 | keyword_record error		{ ERROR("Expected a Name after \"record\".", 0x1A01, @2); }
 	 ;
 
+LAYOUT	:				{ $$ = layout_aos; }
+	| keyword_layout
+	;
+
 COMPILE :
-	| COMPILE tok_ident ':' TEMPCALL { tryGetTemplate($2, $4); }
+	| COMPILE tok_ident ':' TEMPCALL { tryGetTemplate($2, $4, NULL, 0); free($2); clearStack((stack**)&($4), free); }
+	| COMPILE tok_ident tok_vec	{ stack *args = push(NULL, $3, NULL);
+					  tryGetTemplate($2, args, NULL, 0); free($2); clearStack(&args, free); }
 
 /*===========================================*\
 |* Anything related to Statements comes here *|
@@ -85,6 +200,8 @@ QUEUE	: MINIMAL
 MINIMAL : COMMAND
 	| IFBLOCK
 	| LOOPEXP
+	| FORLOOP
+	| FOREACH
 	;
 
 COMMAND : EXPRESSION
@@ -105,6 +222,49 @@ LOOPEXP : keyword_while EXPRESSION MINIMAL keyword_else MINIMAL	{ $$ = newLoopEx
 	| keyword_while error					{ ERROR("Expected Conditional Expression in Loop Head.", 0x1401, @2); }
 	;
 
+FORHEAD : keyword_for tok_ident keyword_from EXPRESSION keyword_to EXPRESSION	{ $$ = newForExpr($2, $4, $6, NULL); }
+	| keyword_for tok_ident keyword_from EXPRESSION keyword_to EXPRESSION keyword_step EXPRESSION { $$ = newForExpr($2, $4, $6, $8); }
+	| keyword_for tok_ident keyword_from EXPRESSION keyword_to EXPRESSION keyword_step error { free($2); clearExpr($4); clearExpr($6); ERROR("Expected Step Size after \"step\".", 0x1804, @8); }
+	| keyword_for tok_ident keyword_from EXPRESSION error	{ free($2); clearExpr($4); ERROR("Expected \"to\" and Upper Bound in Loop Head.", 0x1803, @5); }
+	| keyword_for tok_ident error				{ free($2); ERROR("Expected \"from\" and Lower Bound or \"in\" and Generator in Loop Head.", 0x1802, @3); }
+	| keyword_for error					{ ERROR("Expected Variable Name after \"for\".", 0x1801, @2); }
+	| FORHEAD keyword_vectorize				{ $$ = addLoopHint($1, hint_vectorize, $2); }
+	| FORHEAD keyword_unroll				{ $$ = addLoopHint($1, hint_unroll, $2); }
+	| FORHEAD keyword_interleave				{ $$ = addLoopHint($1, hint_interleave, $2); }
+	| FORHEAD keyword_reduce '(' REDUCTION tok_ident ')'	{ $$ = addReduction($1, $4, $5); }
+	| FORHEAD keyword_reduce '(' REDUCTION tok_ident error	{ clearExpr($1); free($5); ERROR("Expected closing ')' in reduction.", 0x1809, @6); }
+	| FORHEAD keyword_reduce error				{ clearExpr($1); ERROR("Expected '(', Operator and Variable Name after \"reduce\".", 0x1808, @3); }
+	;
+
+REDUCTION : '+'				{ $$ = '+'; }
+	  | '*'				{ $$ = '*'; }
+	  | tok_ident			{ if (strcmp($1, "min") == 0)
+						$$ = '<';
+					  else if (strcmp($1, "max") == 0)
+						$$ = '>';
+					  else
+					  {
+						free($1);
+						ERROR("Reduction Operator must be one of +, *, min or max.", 0x1807, @1);
+					  }
+					  free($1); }
+	  ;
+
+FORLOOP : FORHEAD MINIMAL keyword_else MINIMAL		{ $$ = setForBody($1, $2, $4); }
+	| FORHEAD MINIMAL keyword_end			{ $$ = setForBody($1, $2, NULL); }
+	| FORHEAD MINIMAL error				{ clearExpr($1); clearExpr($2); ERROR("Expected \"end\" or \"else\" after Loop Expression.", 0x1806, @3); }
+	| FORHEAD error					{ clearExpr($1); ERROR("Expected Command in Loop Body.", 0x1805, @2); }
+	| keyword_parallel FORLOOP			{ $$ = setParallel($2); }
+	| keyword_parallel error			{ ERROR("Expected counted Loop after \"parallel\".", 0x180A, @2); }
+	;
+
+FOREACH : keyword_for tok_ident keyword_in EXPRESSION MINIMAL keyword_else MINIMAL	{ $$ = newForEachExpr($2, $4, $5, $7); }
+	| keyword_for tok_ident keyword_in EXPRESSION MINIMAL keyword_end		{ $$ = newForEachExpr($2, $4, $5, NULL); }
+	| keyword_for tok_ident keyword_in EXPRESSION MINIMAL error		{ free($2); clearExpr($4); clearExpr($5); ERROR("Expected \"end\" or \"else\" after Loop Expression.", 0x1806, @6); }
+	| keyword_for tok_ident keyword_in EXPRESSION error			{ free($2); clearExpr($4); ERROR("Expected Command in Loop Body.", 0x1805, @5); }
+	| keyword_for tok_ident keyword_in error				{ free($2); ERROR("Expected Generator after \"in\".", 0x180B, @4); }
+	;
+
 EXPRESSION : BINARYOP
 	   | PRIMARY
 	   | MALFORMED
@@ -120,21 +280,68 @@ BINARYOP : EXPRESSION '+' EXPRESSION	{ $$ = newBinaryExpr('+', $1, $3); }
 	 | EXPRESSION '%' EXPRESSION	{ $$ = newBinaryExpr('%', $1, $3); }
 	 ;
 
-PRIMARY : tok_bool			{ $$ = newLiteralExpr($1, lit_bool); }
+PRIMARY : tok_bool			{ $$ = newIntLiteralExpr($1, lit_bool); }
 	| tok_real			{ $$ = newLiteralExpr($1, lit_real); }
-	| tok_int			{ $$ = newLiteralExpr($1, lit_int); }
-	| IDENTIFY SUBSCRIPT		{ $$ = newAccessExpr($1, $2); }
+	| tok_float32			{ $$ = newLiteralExpr($1, lit_float32); }
+	| tok_imaginary			{ $$ = newLiteralExpr($1, lit_imaginary); }
+	| tok_int			{ $$ = newIntLiteralExpr($1, lit_int); }
+	| tok_long			{ $$ = newIntLiteralExpr($1, lit_int64); }
+	| tok_uint			{ $$ = newIntLiteralExpr($1, lit_uint); }
+	| IDENTIFY SUBSCRIPT		{ $$ = newAccessExpr($1, $2, NULL); }
+	| IDENTIFY '[' EXPRESSION ',' EXPRESSION ']' { $$ = newAccessExpr($1, $3, $5); }
+	| IDENTIFY '[' EXPRESSION ',' error { clearExpr($1); clearExpr($3); ERROR("Expected a mask and closing ']' in subscript.", 0x1123, @5); }
+	| type_template			{ $$ = newIntLiteralExpr($1, lit_template); }
+	| tok_funcparam			{ $$ = newIntLiteralExpr($1, lit_function); }
+	| type_record			{ $$ = newIntLiteralExpr($1, lit_record); }
 	| IDENTIFY
 	| PARENEX
+	| '{' ELEMENTS '}'		{ $$ = newTableExpr($2, 0); }
+	| '{' ELEMENTS error		{ clearStack((stack**)&($2), clearElement); ERROR("Expected closing '}' in array literal.", 0x1172, @3); }
+	| '{' error			{ ERROR("Expected an element after opening '{'.", 0x1171, @2); }
+	| tok_vecopen ELEMENTS tok_vecclose { $$ = newTableExpr($2, 1); }
+	| tok_vecopen ELEMENTS error	{ clearStack((stack**)&($2), clearElement); ERROR("Expected closing '}>' in vector literal.", 0x1174, @3); }
+	| tok_vecopen error		{ ERROR("Expected an element after opening '<{'.", 0x1173, @2); }
+	| keyword_spawn IDENTIFY	{ Expr *call = $2;
+					  if (call->expr_type == expr_ident && ((IdentExpr*)call->expr)->flag != id_any)
+					  {
+						clearExpr(call);
+						ERROR("Only function calls can be spawned.", 0x1902, @2);
+					  }
+					  $$ = newSpawnExpr(call); }
+	| keyword_spawn error		{ ERROR("Expected Function Name after \"spawn\".", 0x1901, @2); }
 	;
 
 IDENTIFY : tok_ident			{ $$ = newIdentExpr($1, id_any, 1); }
 	 | tok_ident tok_new		{ $$ = newIdentExpr($1, id_new, 1); }
-	 | tok_ident tok_vec		{ $$ = newIdentExpr($1, id_vec, $2); }
+	 | tok_ident tok_vec		{ if (isTemplateName($1))
+						$$ = newTemplateExpr($1, push(NULL, $2, NULL));
+					  else
+						$$ = newIdentExpr($1, id_vec, $2); }
 	 | tok_ident tok_array		{ $$ = newIdentExpr($1, id_array, $2); }
+	 | tok_ident tok_vecparam	{ if (isTemplateName($1))
+						$$ = newTemplateExpr($1, push(typeArg(-1 - $2, 0, 0), 0, NULL));
+					  else
+						$$ = setSizeParam(newIdentExpr($1, id_vec, 0), $2); }
+	 | tok_ident tok_arrayparam	{ $$ = setSizeParam(newIdentExpr($1, id_array, 0), $2); }
+	 | tok_ident tok_array keyword_align { if (!isAlignment($3))
+					  {
+						free($1);
+						ERROR("Alignment must be a power of two.", 0x1135, @3);
+					  }
+					  $$ = setAlignment(newIdentExpr($1, id_array, $2), $3); }
+	 | tok_ident tok_arrayparam keyword_align { if (!isAlignment($3))
+					  {
+						free($1);
+						ERROR("Alignment must be a power of two.", 0x1135, @3);
+					  }
+					  $$ = setAlignment(setSizeParam(newIdentExpr($1, id_array, 0), $2), $3); }
 	 | tok_ident tok_func		{ $$ = newIdentExpr($1, id_func, 1); }
+	 | tok_ident tok_field		{ $$ = setField(newIdentExpr($1, id_any, 1), $2); }
 	 | tok_ident tok_var		{ $$ = newIdentExpr($1, id_var, 1); }
-	 | tok_ident ':' TEMPCALL	{ $$ = newTemplateExpr($1, $3); }
+	 | tok_ident ':' TEMPCALL	{ if (!isTemplateName($1) && isMatrixShape($3))
+						$$ = matrixIdent($1, $3);
+					  else
+						$$ = newTemplateExpr($1, $3); }
 	 ;
 
 OP : '+' | '-' | '*' | '/' | '>' | '<' | '=' | '%' ;
@@ -152,37 +359,76 @@ DEFINITION : DECLARATION QUEUE		{ $$ = newFunctionExpr($1, $2, NULL); }
 	   | DECLARATION error		{ ERROR("Expected Function Body after new Declaration.", 0x1701, @2); }
 	   ;
 
-DECLARATION : TYPESIG tok_arrow tok_ident { needsName = 0; }
-		tok_arrow TYPESIG	{ $$ = newProtoExpr($3, $1, $6, (templateVar!=NULL)); }
+DECLARATION : INSIG tok_arrow tok_ident { needsName = 0; }
+		tok_arrow RETSIG	{ $$ = newProtoExpr($3, $1, $6, depth(templateVars)); }
 	    | tok_ident			{ needsName = 0; }
-		tok_arrow TYPESIG	{ $$ = newProtoExpr($1, NULL, $4, (templateVar!=NULL)); }
-	    | TYPESIG tok_arrow error	{ clearStack((stack**)&($1), free); ERROR("Expected a Function Name in Prototype.", 0x1602, @3); }
-	    | TYPESIG tok_arrow tok_ident error { clearStack((stack**)&($1), free); ERROR("A function must have at least one return type! Are you missing a \"->\"?", 0x1612, @2); }
+		tok_arrow RETSIG	{ $$ = newProtoExpr($1, NULL, $4, depth(templateVars)); }
+	    | INSIG tok_arrow error	{ clearStack((stack**)&($1), clearParam); ERROR("Expected a Function Name in Prototype.", 0x1602, @3); }
+	    | INSIG tok_arrow tok_ident error { clearStack((stack**)&($1), clearParam); ERROR("A function must have at least one return type! Are you missing a \"->\"?", 0x1612, @2); }
 	    | tok_ident error		{ free($1); ERROR("A function must have at least one return type! Are you missing a \"->\"?", 0x1611, @2); }
 	    | tok_arrow			{ ERROR("Found stray \"->\" in Function Prototype. Are you missing Input Arguments?", 0x1601, @1); }
 	    ;
 
+/* Functions passed as op:f can only be input parameters */
+INSIG	: TYPESIG
+	| tok_ident tok_func		{ $$ = push(functionParam($1), 0, NULL); }
+	| INSIG tok_ident tok_func	{ $$ = push(functionParam($2), 0, $1); }
+	| INSIG tok_ident tok_func TYPESIG { $$ = appendParams(push(functionParam($2), 0, $1), $4); }
+	;
+
 TYPESIG : TYPEARG			{ if (needsName)
 						ERROR("All function parameters must be named in the form \"Type:Name\"!", 0x1501, @1);
-					  $$ = push(NULL, $1, NULL); }
+					  $$ = push(newParam(NULL, $1), 0, NULL); }
 	| TYPESIG TYPEARG		{ if (needsName)
 						ERROR("All function parameters must be named in the form \"Type:Name\"!", 0x1501, @2);
-					  $$ = push(NULL, $2, $1); }
-	| TYPEARG ':' tok_ident		{ $$ = push($3, $1, NULL); }
-	| TYPESIG TYPEARG ':' tok_ident	{ $$ = push($4, $2, $1); }
+					  $$ = push(newParam(NULL, $2), 0, $1); }
+	| TYPEARG ':' tok_ident		{ $$ = push(newParam($3, $1), 0, NULL); }
+	| TYPESIG TYPEARG ':' tok_ident	{ $$ = push(newParam($4, $2), 0, $1); }
+	;
+
+/* The body may start with a template parameter or a record, so only the first return type can be one */
+RETSIG	: TYPEARG			{ $$ = push(newParam(NULL, $1), 0, NULL); }
+	| TYPEARG ':' tok_ident		{ $$ = push(newParam($3, $1), 0, NULL); }
+	| RETSIG FIXEDARG		{ $$ = push(newParam(NULL, $2), 0, $1); }
+	| RETSIG FIXEDARG ':' tok_ident	{ $$ = push(newParam($4, $2), 0, $1); }
 	;
 
-TYPEARG : PRIMTYPE
-	| PRIMTYPE VECTOR		{ $$ = $1 | $2; }
-	| PRIMTYPE ARRAY		{ $$ = $1 | $2; }
+TYPEARG : PRIMTYPE			{ $$ = typeArg($1, 0, 0); }
+	| PRIMTYPE VECTOR		{ $$ = typeArg($1, $2, 0); }
+	| PRIMTYPE ARRAY		{ $$ = typeArg($1, 0, $2); }
+	| PRIMTYPE VECTOR ARRAY		{ $$ = typeArg($1, $2, $3); }
+	| PRIMTYPE '[' ']'		{ $$ = sliceArg($1, 0); }
+	| PRIMTYPE VECTOR '[' ']'	{ $$ = sliceArg($1, $2); }
+	| PRIMTYPE '<' DIMENSION ',' DIMENSION '>'	{ $$ = matrixArg($1, $3, $5, 0); }
+	| PRIMTYPE '<' DIMENSION ',' DIMENSION '>' ARRAY { $$ = matrixArg($1, $3, $5, $7); }
 	;
 
-PRIMTYPE : type_real			{ $$ = type_real; }
-	 | type_int			{ $$ = type_int; }
-	 | type_bool			{ $$ = type_bool; }
-	 | type_template		{ $$ = type_template; }
+FIXEDARG : FIXEDTYPE			{ $$ = typeArg($1, 0, 0); }
+	 | FIXEDTYPE VECTOR		{ $$ = typeArg($1, $2, 0); }
+	 | FIXEDTYPE ARRAY		{ $$ = typeArg($1, 0, $2); }
+	 | FIXEDTYPE VECTOR ARRAY	{ $$ = typeArg($1, $2, $3); }
+	 | FIXEDTYPE '[' ']'		{ $$ = sliceArg($1, 0); }
+	 | FIXEDTYPE VECTOR '[' ']'	{ $$ = sliceArg($1, $2); }
+	 | FIXEDTYPE '<' DIMENSION ',' DIMENSION '>'	{ $$ = matrixArg($1, $3, $5, 0); }
+	 | FIXEDTYPE '<' DIMENSION ',' DIMENSION '>' ARRAY { $$ = matrixArg($1, $3, $5, $7); }
 	 ;
 
+PRIMTYPE : FIXEDTYPE
+	 | type_template		{ $$ = -1 - $1; }
+	 | type_record			{ $$ = recordTypes + $1; }
+	 ;
+
+FIXEDTYPE : type_real			{ $$ = type_real; }
+	  | type_int			{ $$ = type_int; }
+	  | type_bool			{ $$ = type_bool; }
+	  | type_float32		{ $$ = type_float32; }
+	  | type_int64			{ $$ = type_int64; }
+	  | type_int16			{ $$ = type_int16; }
+	  | type_int8			{ $$ = type_int8; }
+	  | type_uint			{ $$ = type_uint; }
+	  | type_complex		{ $$ = type_complex; }
+	  ;
+
 /*===================================================*\
 |* Anything related to parentheses comes below here: *|
 \*===================================================*/
@@ -192,30 +438,59 @@ PARENEX : '(' QUEUE ')'			{ $$ = $2; }
 	| '(' error			{ ERROR("Expected Command after opening '('.", 0x1111, @2); }
 	;
 
+ELEMENTS : EXPRESSION			{ $$ = push($1, 0, NULL); }
+	 | ELEMENTS ',' EXPRESSION	{ $$ = push($3, 0, $1); }
+	 | ELEMENTS ',' error		{ clearStack((stack**)&($1), clearElement); ERROR("Expected an element after ','.", 0x1175, @3); }
+	 ;
+
 SUBSCRIPT : '[' EXPRESSION ']'		{ $$ = $2; }
 	  | '[' EXPRESSION error	{ clearExpr($2); ERROR("Expected closing ']' in subscript.", 0x1122, @3); }
 	  | '[' error			{ ERROR("Expected Expression in subscript.", 0x1121, @2); }
 	  ;
 
-ARRAY : '[' tok_int ']'			{ $$ = $2 << 16; }
+ARRAY : '[' tok_int ']'			{ if ($2 < 1)
+						ERROR("Array size must be positive.", 0x1133, @2);
+					  $$ = $2; }
+      | '[' type_template ']'		{ $$ = -1 - $2; }
       | '[' tok_int error		{ ERROR("Expected closing ']' in Array declaration.", 0x1132, @3); }
       | '[' error			{ ERROR("Expected Integer in Array declaration.", 0x1131, @2); }
       ;
 
-VECTOR : '<' tok_int '>'		{ $$ = $2 << 12; }
+VECTOR : '<' tok_int '>'		{ if ($2 < 1)
+						ERROR("Vector size must be positive.", 0x1143, @2);
+					  $$ = $2; }
+       | '<' type_template '>'		{ $$ = -1 - $2; }
        | '<' tok_int error		{ ERROR("Expected closing '>' in vector declaration.", 0x1142, @3); }
        | '<' error			{ ERROR("Expected Integer in Vector declaration.", 0x1141, @2); }
        ;
 
-TEMPLATE : '<' tok_ident '>'		{ $$ = $2; }
-	 | '<' tok_ident error		{ free($2); ERROR("Expected closing '>' in template.", 0x1152, @3); }
+DIMENSION : tok_int			{ if ($1 < 1)
+						ERROR("The number of rows and columns of a matrix must be positive.", 0x1144, @1);
+					  $$ = $1; }
+	  | type_template		{ $$ = -1 - $1; }
+	  ;
+
+TEMPLATE : '<' TEMPVARS '>'		{ $$ = $2; }
+	 | '<' TEMPVARS error		{ clearStack((stack**)&($2), free); ERROR("Expected closing '>' in template.", 0x1152, @3); }
 	 | '<' error			{ ERROR("Expected template variable name after opening '<'.", 0x1151, @2); }
 	 ;
 
-TEMPCALL : '<' TYPEARG '>'		{ $$ = $2; }
-	 | '<' TYPEARG error		{ ERROR("Expected closing '>' in Template Call.", 0x1162, @3); }
+TEMPVARS : tok_ident			{ $$ = push($1, 0, NULL); }
+	 | TEMPVARS ',' tok_ident	{ $$ = push($3, 0, $1); }
+	 | TEMPVARS ',' error		{ clearStack((stack**)&($1), free); ERROR("Expected template variable name after ','.", 0x1153, @3); }
+	 ;
+
+TEMPCALL : '<' TEMPARGS '>'		{ $$ = $2; }
+	 | '<' TEMPARGS error		{ clearStack((stack**)&($2), free); ERROR("Expected closing '>' in Template Call.", 0x1162, @3); }
 	 | '<' error			{ ERROR("Expected template variable after opening '<'.", 0x1161, @2); }
 	 ;
+
+TEMPARGS : TYPEARG			{ $$ = push($1, 0, NULL); }
+	 | tok_int			{ $$ = push(NULL, $1, NULL); }
+	 | TEMPARGS ',' TYPEARG		{ $$ = push($3, 0, $1); }
+	 | TEMPARGS ',' tok_int		{ $$ = push(NULL, $3, $1); }
+	 | TEMPARGS ',' error		{ clearStack((stack**)&($1), free); ERROR("Expected a type or an integer after ',' in Template Call.", 0x1163, @3); }
+	 ;
 %%
 int yyerror()
 {
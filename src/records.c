@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <llvm-c/Core.h>
+#include "stack.h"
+#include "ast.h"
+#include "records.h"
+#include "codegen.h"
+
+extern LLVMContextRef phi_context;
+
+typedef struct Record {
+	char *name;
+	/* The fields as Params, the last one first */
+	stack *fields;
+	int layout;
+	LLVMTypeRef type;
+	/* The types of arrays of this record in SoA layout, with their number of elements as misc */
+	stack *arrays;
+} Record;
+/* All records in the order of their definition, the last one first */
+static stack *records = NULL;
+
+static Record* recordAt (unsigned index)
+{
+	unsigned position = depth(records);
+	for (stack *runner = records; runner != NULL; runner = runner->next)
+		if (--position == index)
+			return runner->item;
+	return logError("Unknown record type.", 0x2E01);
+}
+
+/* The record, which a struct is either an instance of or an array in SoA layout of */
+static Record* findRecord (LLVMTypeRef type)
+{
+	for (stack *runner = records; runner != NULL; runner = runner->next)
+	{
+		Record *r = runner->item;
+		if (r->type == type)
+			return r;
+		for (stack *array = r->arrays; array != NULL; array = array->next)
+			if (array->item == type)
+				return r;
+	}
+	return NULL;
+}
+
+static void clearRecord (void *p)
+{
+	Record *r = p;
+	free(r->name);
+	clearStack(&r->fields, clearParam);
+	clearStack(&r->arrays, NULL);
+	free(r);
+}
+
+/* Index of the record with the given name, or -1 */
+int recordIndex (const char *name, int length)
+{
+	int index = depth(records);
+	for (stack *runner = records; runner != NULL; runner = runner->next)
+	{
+		index--;
+		Record *r = runner->item;
+		if ((int)strlen(r->name) == length && strncmp(name, r->name, length) == 0)
+			return index;
+	}
+	return -1;
+}
+
+const char* recordName (unsigned index)
+{
+	Record *r = recordAt(index);
+	return r == NULL ? NULL : r->name;
+}
+
+void defineRecord (char *name, stack *fields, int layout)
+{
+	/* LLVM would rename the struct of a second record, and the name would refer to it from then on */
+	if (recordIndex(name, strlen(name)) >= 0)
+	{
+		logError("A record of this name has already been defined.", 0x2E0C);
+		free(name);
+		clearStack(&fields, clearParam);
+		return;
+	}
+	Record *r = malloc(sizeof(Record));
+	if (r == NULL)
+	{
+		logError("Could not allocate Memory.", 0x304);
+		free(name);
+		clearStack(&fields, clearParam);
+		return;
+	}
+	r->name = name;
+	r->fields = fields;
+	r->layout = layout;
+	r->arrays = NULL;
+	r->type = NULL;
+
+	unsigned numFields = depth(fields);
+	LLVMTypeRef types[numFields];
+	stack *runner = fields;
+	for (int i = numFields-1; i >= 0; i--, runner = runner->next)
+	{
+		Param *field = runner->item;
+		for (stack *other = runner->next; other != NULL; other = other->next)
+		{
+			if (strcmp(field->name, ((Param*)other->item)->name) == 0)
+			{
+				logError("Two fields of a record have the same name.", 0x2E02);
+				clearRecord(r);
+				return;
+			}
+		}
+		if (field->type->slice)
+		{
+			logError("A record cannot hold a slice, as it refers to the memory of a caller.", 0x2E03);
+			clearRecord(r);
+			return;
+		}
+		types[i] = getAppropriateType(field->type);
+		if (types[i] == NULL)
+		{
+			clearRecord(r);
+			return;
+		}
+	}
+	/* Records are named structs, unlike the anonymous structs holding multiple return values */
+	r->type = LLVMStructCreateNamed(phi_context, name);
+	LLVMStructSetBody(r->type, types, numFields, 0);
+	records = push(r, 0, records);
+}
+
+void clearRecords ()
+{
+	clearStack(&records, clearRecord);
+}
+
+LLVMTypeRef recordType (unsigned index)
+{
+	Record *r = recordAt(index);
+	return r == NULL ? NULL : r->type;
+}
+
+/* An array in SoA layout is a struct holding an array for every field */
+LLVMTypeRef recordArrayType (LLVMTypeRef element, unsigned size)
+{
+	Record *r = findRecord(element);
+	if (r == NULL || r->type != element || r->layout != layout_soa)
+		return LLVMArrayType(element, size);
+	for (stack *array = r->arrays; array != NULL; array = array->next)
+		if (array->misc == (int)size)
+			return array->item;
+
+	unsigned numFields = LLVMCountStructElementTypes(r->type);
+	LLVMTypeRef types[numFields];
+	for (unsigned i = 0; i < numFields; i++)
+		types[i] = LLVMArrayType(LLVMStructGetTypeAtIndex(r->type, i), size);
+	char name[strlen(r->name) + 16];
+	sprintf(name, "%s.soa%u", r->name, size);
+	LLVMTypeRef type = LLVMStructCreateNamed(phi_context, name);
+	LLVMStructSetBody(type, types, numFields, 0);
+	r->arrays = push(type, size, r->arrays);
+	return type;
+}
+
+int isRecordType (LLVMTypeRef type)
+{
+	Record *r = findRecord(type);
+	return r != NULL && r->type == type;
+}
+
+int recordLayout (LLVMTypeRef type)
+{
+	Record *r = findRecord(type);
+	return r == NULL ? layout_aos : r->layout;
+}
+
+/* The record an array in SoA layout is made of, or NULL for any other type */
+LLVMTypeRef soaElementType (LLVMTypeRef type)
+{
+	Record *r = findRecord(type);
+	return r == NULL || r->type == type ? NULL : r->type;
+}
+
+/* Index of a field within a record or an array in SoA layout, or -1 */
+int recordField (LLVMTypeRef type, const char *field, int *isUnsignedField)
+{
+	Record *r = findRecord(type);
+	if (r == NULL)
+		return -1;
+	int index = depth(r->fields);
+	for (stack *runner = r->fields; runner != NULL; runner = runner->next)
+	{
+		index--;
+		Param *p = runner->item;
+		if (strcmp(p->name, field) == 0)
+		{
+			*isUnsignedField = isUnsignedType(p->type);
+			return index;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,25 @@
+#ifndef RECORDS_H_
+#define RECORDS_H_
+
+#include <llvm-c/Core.h>
+#include "stack.h"
+
+/* Storage of arrays of records */
+enum RecordLayout
+{
+	layout_aos = 0,
+	layout_soa
+};
+
+void defineRecord (char *name, stack *fields, int layout);
+int recordIndex (const char *name, int length);
+const char* recordName (unsigned index);
+void clearRecords ();
+LLVMTypeRef recordType (unsigned index);
+LLVMTypeRef recordArrayType (LLVMTypeRef element, unsigned size);
+int isRecordType (LLVMTypeRef type);
+int recordLayout (LLVMTypeRef type);
+LLVMTypeRef soaElementType (LLVMTypeRef type);
+int recordField (LLVMTypeRef type, const char *field, int *isUnsignedField);
+
+#endif /* RECORDS_H_ */
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <llvm-c/Core.h>
@@ -6,15 +7,24 @@
 #include "ast.h"
 #include "templating.h"
 #include "codegen.h"
+#include "records.h"
 
 extern LLVMModuleRef phi_module;
-LLVMTypeRef templateType;
-static const char *templateTypeName = "";
 static stack *templates = NULL;
 
-const char* getTypeName (int type_name)
+/* The arguments of the template instance being compiled. Integer and function arguments have no type. */
+typedef struct TemplateBinding {
+	TypeDesc type;
+	int isInteger;
+	unsigned value;
+	LLVMValueRef function;
+} TemplateBinding;
+static TemplateBinding *bindings = NULL;
+static unsigned numBindings = 0;
+
+static const char* baseTypeName (int base)
 {
-	switch (type_name)
+	switch (base)
 	{
 		case type_int:
 			return "Int";
@@ -22,22 +32,230 @@ const char* getTypeName (int type_name)
 			return "Real";
 		case type_bool:
 			return "Bool";
-		case type_template:
-			return templateTypeName;
+		case type_float32:
+			return "Float32";
+		case type_int64:
+			return "Int64";
+		case type_int16:
+			return "Int16";
+		case type_int8:
+			return "Int8";
+		case type_uint:
+			return "UInt";
+		case type_complex:
+			return "Complex";
 		default:
 			return logError("Unknown type name.", 0x3003);
 	}
 	return NULL;
 }
 
-char *fullTemplateName (const char *bareName, int type_name)
+static TemplateBinding* lookupBinding (unsigned param)
+{
+	if (param >= numBindings)
+		return logError("Template parameter used outside of its template.", 0x3005);
+	return &bindings[param];
+}
+
+/* The function bound to a function parameter, or NULL for any other parameter */
+LLVMValueRef templateFunction (unsigned param)
+{
+	if (param >= numBindings)
+		return NULL;
+	return bindings[param].function;
+}
+
+int templateValue (unsigned param, unsigned *value)
+{
+	TemplateBinding *b = lookupBinding(param);
+	if (b == NULL)
+		return 0;
+	if (b->function != NULL)
+	{
+		logError("A function parameter cannot be used as a number.", 0x300A);
+		return 0;
+	}
+	if (!b->isInteger)
+	{
+		logError("A template parameter, which stands for a type, cannot be used as a number.", 0x3006);
+		return 0;
+	}
+	*value = b->value;
+	return 1;
+}
+
+int resolveTemplateType (TypeDesc *desc, TypeDesc *resolved)
+{
+	*resolved = *desc;
+	resolved->vecParam = resolved->arrayParam = resolved->rowParam = 0;
+	if (desc->base == type_template)
+	{
+		TemplateBinding *b = lookupBinding(desc->param);
+		if (b == NULL)
+			return 0;
+		if (b->function != NULL)
+		{
+			logError("A function parameter cannot be used as a type.", 0x300A);
+			return 0;
+		}
+		if (b->isInteger)
+		{
+			logError("A template parameter, which stands for a number, cannot be used as a type.", 0x3007);
+			return 0;
+		}
+		resolved->base = b->type.base;
+		resolved->param = b->type.param;
+		if (b->type.vecsize != 0 && (desc->vecsize != 0 || desc->vecParam != 0))
+		{
+			logError("A template parameter, which stands for a vector, cannot be made a vector again.", 0x3008);
+			return 0;
+		}
+		if (b->type.arraysize != 0 && (desc->arraysize != 0 || desc->arrayParam != 0 || desc->slice))
+		{
+			logError("A template parameter, which stands for an array, cannot be made an array again.", 0x3008);
+			return 0;
+		}
+		resolved->vecsize += b->type.vecsize;
+		resolved->arraysize += b->type.arraysize;
+		resolved->rows += b->type.rows;
+	}
+	if (desc->vecParam != 0 && !templateValue(desc->vecParam - 1, &resolved->vecsize))
+		return 0;
+	if (desc->rowParam != 0 && !templateValue(desc->rowParam - 1, &resolved->rows))
+		return 0;
+	if (desc->arrayParam != 0 && !templateValue(desc->arrayParam - 1, &resolved->arraysize))
+		return 0;
+	return 1;
+}
+
+/* The argument of a template call may refer to the parameters of the surrounding template */
+static int resolveTemplateArg (stack *arg, TemplateBinding *binding)
 {
-	const char *typename = getTypeName(type_name);
-	char *fullName = malloc(strlen(bareName) + strlen(typename) + 1);
+	TypeDesc *desc = arg->item;
+	binding->isInteger = (desc == NULL);
+	binding->value = arg->misc;
+	binding->function = NULL;
+	if (desc == NULL)
+		return 1;
+	if (desc->slice)
+	{
+		logError("A slice cannot be the argument of a template.", 0x3009);
+		return 0;
+	}
+	if (desc->base == type_template && desc->vecsize == 0 && desc->arraysize == 0 && desc->vecParam == 0
+			&& desc->arrayParam == 0 && desc->rows == 0 && desc->rowParam == 0)
+	{
+		TemplateBinding *outer = lookupBinding(desc->param);
+		if (outer == NULL)
+			return 0;
+		if (outer->function != NULL)
+		{
+			logError("A function parameter cannot be used as a type.", 0x300A);
+			return 0;
+		}
+		*binding = *outer;
+		return 1;
+	}
+	return resolveTemplateType(desc, &binding->type);
+}
+
+/* Name of a type as it appears in the names of template instances, e.g. Real_v4_a10 for Real<4>[10]
+ * and Real_m3x4 for Real<3,4> */
+static char* getTypeName (TemplateBinding *b)
+{
+	if (b->function != NULL)
+		return strdup(LLVMGetValueName(b->function));
+	const char *base = "";
+	if (!b->isInteger)
+		base = b->type.base == type_record ? recordName(b->type.param) : baseTypeName(b->type.base);
+	if (base == NULL)
+		return NULL;
+	/* Room for three unsigned numbers and their prefixes */
+	char *name = malloc(strlen(base) + 37);
+	if (name == NULL)
+		return logError("Could not allocate Memory.", 0x302);
+	if (b->isInteger)
+	{
+		sprintf(name, "%u", b->value);
+		return name;
+	}
+	strcpy(name, base);
+	if (b->type.rows != 0)
+		sprintf(name + strlen(name), "_m%ux%u", b->type.rows, b->type.vecsize);
+	else if (b->type.vecsize != 0)
+		sprintf(name + strlen(name), "_v%u", b->type.vecsize);
+	if (b->type.arraysize != 0)
+		sprintf(name + strlen(name), "_a%u", b->type.arraysize);
+	return name;
+}
+
+/* Resolve the arguments of a template call in the order they were written, followed by the functions passed to it.
+ * Returns their number or -1. */
+static int resolveTemplateArgs (stack *args, LLVMValueRef *functions, unsigned numFunctions, TemplateBinding **resolved)
+{
+	unsigned numArgs = depth(args);
+	*resolved = malloc((numArgs + numFunctions) * sizeof(TemplateBinding));
+	if (*resolved == NULL)
+	{
+		logError("Could not allocate Memory.", 0x303);
+		return -1;
+	}
+	for (int i = numArgs-1; i >= 0; i--, args = args->next)
+	{
+		if (!resolveTemplateArg(args, &(*resolved)[i]))
+		{
+			free(*resolved);
+			*resolved = NULL;
+			return -1;
+		}
+	}
+	for (unsigned i = 0; i < numFunctions; i++)
+	{
+		TemplateBinding *b = &(*resolved)[numArgs+i];
+		memset(b, 0, sizeof(TemplateBinding));
+		b->function = functions[i];
+	}
+	return numArgs + numFunctions;
+}
+
+/* The name of an instance is the name of the template followed by the names of the arguments, separated by '_'.
+ * Type names start with a capital letter and integers with a digit, so different arguments give different names.
+ * Functions follow a '.', e.g. map.square, which no function of the source can be named. */
+static char* instanceName (const char *bareName, TemplateBinding *args, unsigned numArgs)
+{
+	char *fullName = malloc(strlen(bareName) + 1);
 	if (fullName == NULL)
 		return logError("Could not allocate Memory.", 0x301);
 	strcpy(fullName, bareName);
-	strcat(fullName, typename);
+	for (unsigned i = 0; i < numArgs; i++)
+	{
+		char *typename = getTypeName(&args[i]);
+		char *longer = typename == NULL ? NULL : realloc(fullName, strlen(fullName) + strlen(typename) + 2);
+		if (longer == NULL)
+		{
+			free(typename);
+			free(fullName);
+			return NULL;
+		}
+		fullName = longer;
+		if (args[i].function != NULL)
+			strcat(fullName, ".");
+		else if (i > 0)
+			strcat(fullName, "_");
+		strcat(fullName, typename);
+		free(typename);
+	}
+	return fullName;
+}
+
+static char* fullTemplateName (const char *bareName, stack *args, LLVMValueRef *functions, unsigned numFunctions)
+{
+	TemplateBinding *resolved;
+	int numArgs = resolveTemplateArgs(args, functions, numFunctions, &resolved);
+	if (numArgs < 0)
+		return NULL;
+	char *fullName = instanceName(bareName, resolved, numArgs);
+	free(resolved);
 	return fullName;
 }
 
@@ -112,13 +330,9 @@ void declareNewTemplate (ProtoExpr *pe)
 	templates = push(pe, expr_proto, templates);
 }
 
-LLVMValueRef compileTemplateForType (void *e, ExprType expr_type, int type_name)
+static LLVMValueRef compileTemplateForArgs (void *e, ExprType expr_type, stack *args, LLVMValueRef *functions,
+		unsigned numFunctions)
 {
-	LLVMTypeRef previousTemplateType = templateType;
-	templateType = getAppropriateType(type_name);
-	const char *typename = getTypeName(type_name);
-	templateTypeName = typename;
-
 	ProtoExpr *pe;
 	if (expr_type == expr_func)
 	{
@@ -127,26 +341,51 @@ LLVMValueRef compileTemplateForType (void *e, ExprType expr_type, int type_name)
 	}
 	else
 		pe = e;
+	if ((int)(depth(args) + numFunctions) != pe->isTemplate)
+		return logError("The number of template arguments does not match the template.", 0x3004);
+	/* The arguments may refer to the parameters of the surrounding template, so they are resolved first */
+	TemplateBinding *resolved;
+	int numArgs = resolveTemplateArgs(args, functions, numFunctions, &resolved);
+	if (numArgs < 0)
+		return NULL;
+	char *fullName = instanceName(pe->name, resolved, numArgs);
+	if (fullName == NULL)
+	{
+		free(resolved);
+		return NULL;
+	}
+	TemplateBinding *previousBindings = bindings;
+	unsigned previousNumBindings = numBindings;
+	bindings = resolved;
+	numBindings = numArgs;
+
+	int isTemplate = pe->isTemplate;
 	pe->isTemplate = 0;
 	char *bareName = pe->name;
-	pe->name = fullTemplateName(bareName, type_name);
+	pe->name = fullName;
 
 	Expr E;
 	E.expr = e;
 	E.expr_type = expr_type;
 	LLVMValueRef val = codegen(&E, 1);
+	/* Every caller may pass other functions, so the instance is only of use within this module */
+	if (val != NULL && numFunctions > 0 && expr_type == expr_func)
+		LLVMSetLinkage(val, LLVMInternalLinkage);
 
 	free(pe->name);
 	pe->name = bareName;
-	pe->isTemplate = 1;
-	templateType = previousTemplateType;
-	templateTypeName = "";
+	pe->isTemplate = isTemplate;
+	free(bindings);
+	bindings = previousBindings;
+	numBindings = previousNumBindings;
 	return val;
 }
 
-LLVMValueRef tryGetTemplate (const char *bareName, int type_name)
+LLVMValueRef tryGetTemplate (const char *bareName, stack *args, LLVMValueRef *functions, unsigned numFunctions)
 {
-	char *fullName = fullTemplateName(bareName, type_name);
+	char *fullName = fullTemplateName(bareName, args, functions, numFunctions);
+	if (fullName == NULL)
+		return NULL;
 	LLVMValueRef function = LLVMGetNamedFunction(phi_module, fullName);
 	free(fullName);
 	if (function != NULL)
@@ -155,32 +394,55 @@ LLVMValueRef tryGetTemplate (const char *bareName, int type_name)
 	stack *runner = templates;
 	while (runner != NULL)
 	{
-		int type = runner->misc;
-		if (type == expr_proto)
+		int exprType = runner->misc;
+		if (exprType == expr_proto)
 		{
 			ProtoExpr *pe = runner->item;
 			if (strcmp(pe->name, bareName) == 0)
-				return compileTemplateForType(pe, expr_proto, type_name);
+				return compileTemplateForArgs(pe, expr_proto, args, functions, numFunctions);
 		}
 		else
 		{
 			FunctionExpr *fe = runner->item;
 			ProtoExpr *pe = fe->proto->expr;
 			if (strcmp(pe->name, bareName) == 0)
-				return compileTemplateForType(fe, expr_func, type_name);
+				return compileTemplateForArgs(fe, expr_func, args, functions, numFunctions);
 		}
 		runner = runner->next;
 	}
 	return NULL;
 }
 
-LLVMValueRef compileTemplatePredefined (Expr *e, int type_name)
+/* The prototype of the template of this name, or NULL */
+ProtoExpr* templatePrototype (const char *name)
+{
+	for (stack *runner = templates; runner != NULL; runner = runner->next)
+	{
+		ProtoExpr *pe = runner->item;
+		if (runner->misc == expr_func)
+			pe = ((FunctionExpr*)runner->item)->proto->expr;
+		if (strcmp(pe->name, name) == 0)
+			return pe;
+	}
+	return NULL;
+}
+
+/* Whether a template of this name was declared or defined. A call with a single integer argument, e.g. zeros:<4>,
+ * looks like the declaration of a vector, and only calls to known templates are parsed as such. */
+int isTemplateName (const char *name)
+{
+	return templatePrototype(name) != NULL;
+}
+
+LLVMValueRef compileTemplatePredefined (Expr *e, stack *args)
 {
 	if (e == NULL || e->expr_type != expr_func)
 		return NULL;
 	FunctionExpr *fe = e->expr;
 	ProtoExpr *pe = fe->proto->expr;
-	char *bareName = fullTemplateName(pe->name, type_name);
+	char *bareName = fullTemplateName(pe->name, args, NULL, 0);
+	if (bareName == NULL)
+		return NULL;
 	free(pe->name);
 	pe->name = bareName;
 	return codegen(e, 1);
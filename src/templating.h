@@ -7,7 +7,12 @@
 void clearTemplates();
 void defineNewTemplate (FunctionExpr *ie);
 void declareNewTemplate (ProtoExpr *pe);
-LLVMValueRef tryGetTemplate (const char *name, int type_name);
-LLVMValueRef compileTemplatePredefined (Expr *e, int type_name);
+LLVMValueRef tryGetTemplate (const char *name, stack *args, LLVMValueRef *functions, unsigned numFunctions);
+LLVMValueRef compileTemplatePredefined (Expr *e, stack *args);
+int resolveTemplateType (TypeDesc *desc, TypeDesc *resolved);
+int templateValue (unsigned param, unsigned *value);
+LLVMValueRef templateFunction (unsigned param);
+ProtoExpr* templatePrototype (const char *name);
+int isTemplateName (const char *name);
 
 #endif /* TEMPLATING_H_ */
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+double sortr (double *a, int64_t length);
+int sorti (int *a, int64_t length);
+int64_t scanl (int64_t *a, int64_t length);
+double total (double *a, int64_t length);
+int64_t lowest (double *a, int64_t length);
+int64_t highest (int16_t *a, int64_t length);
+int64_t find (double *a, int64_t length, double x);
+int64_t hist (double *a, int64_t length, int64_t *counts, int64_t countslength);
+int64_t local (int k);
+double table (int k);
+
+int main ()
+{
+	double r[200], t[1000];
+	int i32[10], sorted = 1;
+	int64_t i64[10];
+	for (int i = 0; i < 200; i++)
+		r[i] = (i * 37) % 200 - 100;
+	for (int i = 0; i < 10; i++)
+	{
+		i32[i] = (i * 7) % 10 - 3;
+		i64[i] = i + 1;
+	}
+	for (int i = 0; i < 1000; i++)
+		t[i] = i;
+	printf("%g %d\n", sortr(r, 200), sorti(i32, 10));
+	for (int i = 1; i < 200; i++)
+		sorted &= r[i-1] <= r[i];
+	for (int i = 1; i < 10; i++)
+		sorted &= i32[i-1] <= i32[i];
+	int64_t scanned = scanl(i64, 10);
+	printf("%d %lld %lld %g\n", sorted, (long long)scanned, (long long)i64[9], total(t, 1000));
+
+	double l[5] = {3, NAN, 1, 1, 5}, s[4] = {1, 2, 4, 8};
+	int16_t h[4] = {-1, 7, 7, 2};
+	printf("%lld %lld %lld %lld %lld\n", (long long)lowest(l, 5), (long long)lowest(l, 0), (long long)highest(h, 4),
+		(long long)find(s, 4, 3.0), (long long)find(s, 4, 9.0));
+
+	double v[6] = {0.05, 0.15, 0.15, 0.95, 1.0, -0.1};
+	int64_t counts[10] = {0};
+	int64_t counted = hist(v, 6, counts, 10);
+	printf("%lld %lld %lld\n", (long long)counted, (long long)counts[1], (long long)counts[9]);
+	printf("%lld %g\n", (long long)local(0), table(0));
+	return 0;
+}
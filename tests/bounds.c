@@ -0,0 +1,15 @@
+#include <stdio.h>
+#include <stdint.h>
+
+double at (double *a, int64_t length, int i);
+double shifted (double *a, int64_t length, int k);
+int local (int i);
+
+int main ()
+{
+	double a[5] = {1, 2, 3, 4, 5};
+	printf("%g %g %g %d\n", at(a, 5, 4), shifted(a, 5, 2), shifted(a, 5, 0), local(7));
+	fflush(stdout);
+	printf("%g\n", at(a, 5, 5));
+	return 0;
+}
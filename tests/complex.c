@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <complex.h>
+
+double _Complex cmul (double _Complex a, double _Complex b);
+double _Complex cdiv (double _Complex a, double _Complex b);
+double magnitude (double _Complex z);
+double _Complex conjugate (double _Complex z);
+double caxpy (double _Complex *x, int64_t xlength, double _Complex *y, int64_t ylength, double _Complex a);
+double _Complex total (double _Complex z);
+double _Complex lanes (int k);
+double _Complex dotted (int k);
+
+static void show (double _Complex z)
+{
+	printf("%g%+gi\n", creal(z), cimag(z));
+}
+
+int main ()
+{
+	double _Complex x[2] = {1.0 + 1.0*I, 2.0}, y[2] = {1.0, 1.0};
+	show(cmul(1.0 + 2.0*I, 3.0 + 4.0*I));
+	show(cdiv(-5.0 + 10.0*I, 3.0 + 4.0*I));
+	printf("%g\n", magnitude(3.0 + 4.0*I));
+	show(conjugate(1.0 + 2.0*I));
+	printf("%g\n", caxpy(x, 2, y, 2, 2.0*I));
+	show(y[1]);
+	show(total(1.0 + 1.0*I));
+	show(lanes(0));
+	show(dotted(0));
+	return 0;
+}
@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+int magnitude (int n);
+int spread (int a, int b);
+double clamp (double x);
+int collatz (int n);
+int dropped (int n);
+double lanes (double x);
+
+int main ()
+{
+	printf("%d %d %d\n", magnitude(-7), magnitude(0), magnitude(5));
+	printf("%d %d\n", spread(3, 10), spread(10, 3));
+	printf("%g %g %g\n", clamp(-2.0), clamp(0.25), clamp(3.0));
+	printf("%d %d\n", collatz(1), collatz(27));
+	printf("%d %d\n", dropped(-1), dropped(4));
+	printf("%g %g\n", lanes(0.0), lanes(1.5));
+	return 0;
+}
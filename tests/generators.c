@@ -0,0 +1,13 @@
+#include <stdio.h>
+
+int sumsq (int n);
+int total (int n);
+
+int main ()
+{
+	for (int n = 0; n < 6; n++)
+		printf("%d ", sumsq(n));
+	printf("%d\n", sumsq(1000));
+	printf("%d\n", total(5));
+	return 0;
+}
@@ -0,0 +1,20 @@
+#include <stdio.h>
+
+int countup (int n);
+int countdown (int n);
+int empty (int n);
+unsigned unsignedcount ();
+int hinted (int n);
+int words (int to, int step);
+int nested (int n);
+
+int main ()
+{
+	printf("%d %d %d\n", countup(10), countdown(10), countdown(9));
+	printf("%d %d\n", empty(0), empty(3));
+	printf("%u\n", unsignedcount());
+	printf("%d %d\n", hinted(100), hinted(7));
+	printf("%d\n", words(1, 2));
+	printf("%d\n", nested(5));
+	return 0;
+}
@@ -0,0 +1,19 @@
+#include <stdio.h>
+#include <stdint.h>
+
+double trace (double s);
+double mv (double *src, int64_t length, int n);
+double blockmul (double *src, int64_t srclength, double *dst, int64_t dstlength, int n);
+double squared (int k);
+
+int main ()
+{
+	double src[64], dst[64] = {0};
+	for (int i = 0; i < 64; i++)
+		src[i] = i;
+	printf("%g %g\n", trace(2.0), mv(src, 16, 4));
+	double m = blockmul(src, 64, dst, 64, 8);
+	printf("%g %g %g %g\n", m, dst[24], dst[3], dst[4]);
+	printf("%g %g\n", squared(4), squared(0));
+	return 0;
+}
@@ -0,0 +1,29 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "phirt.h"
+
+int64_t total (int n);
+double range (double *a, int64_t length);
+double scale (double *s, int64_t slength, double *d, int64_t dlength);
+double drift (double dt);
+double matrix (double a);
+int empty (int n);
+
+int main ()
+{
+	/* Several threads, even on a single core */
+	phirt_set_num_threads(4);
+	phirt_set_chunk_size(7);
+	printf("%lld\n", (long long)total(1000000));
+	double a[500], s[100], d[100];
+	for (int i = 0; i < 500; i++)
+		a[i] = (i * 37) % 101 - 50;
+	printf("%g\n", range(a, 500));
+	for (int i = 0; i < 100; i++)
+		s[i] = i;
+	double t = scale(s, 100, d, 100);
+	printf("%g %g %g\n", t, d[1], d[99]);
+	printf("%g %g\n", drift(0.5), matrix(2.0));
+	printf("%d %d\n", empty(0), empty(5));
+	return 0;
+}
@@ -0,0 +1,22 @@
+#include <stdio.h>
+#include <stdint.h>
+
+struct Particle
+{
+	double x, v;
+	uint32_t id;
+};
+
+double aos (double dt);
+double soa (double dt);
+double fields (int k);
+double drift (struct Particle *ps, int64_t length, double dt);
+
+int main ()
+{
+	struct Particle ps[3] = {{1.0, 4.0, 10}, {2.0, -2.0, 20}, {3.0, 0.0, 30}};
+	printf("%g %g %g\n", aos(0.5), soa(0.5), fields(0));
+	double d = drift(ps, 3, 0.25);
+	printf("%g %g %g %g\n", d, ps[0].x, ps[1].x, ps[2].x);
+	return 0;
+}
@@ -0,0 +1,74 @@
+#!/bin/sh
+# Compiles every program in this directory with phi, links it with the C program of the same name and the runtime,
+# runs it and compares what it prints with the .out file of the same name. A program without a C program must fail
+# to compile instead, and its .out file lists the errors. Options for phi are given in a first line "// phi: ...".
+#
+# Usage: run.sh phi libphirt.a [llc] [name...]
+# Builds without NDEBUG print the module instead of writing output.o, which is then compiled with llc.
+
+if [ $# -lt 2 ]
+then
+	echo "Usage: $0 phi libphirt.a [llc] [name...]" >&2
+	exit 2
+fi
+absolute ()
+{
+	case "$1" in
+		/*) echo "$1" ;;
+		*) echo "$PWD/$1" ;;
+	esac
+}
+phi=$(absolute "$1")
+phirt=$(absolute "$2")
+llc=${3:-llc}
+shift 2
+[ $# -gt 0 ] && shift
+tests=$(cd "$(dirname "$0")" && pwd)
+cc=${CC:-cc}
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+if [ $# -eq 0 ]
+then
+	set -- $(cd "$tests" && ls *.phi | sed 's/\.phi$//')
+fi
+
+passed=0
+failed=0
+for name in "$@"
+do
+	rm -rf "$work"/*
+	options=$(sed -n '1s|^// phi: ||p' "$tests/$name.phi")
+	(cd "$work" && "$phi" $options "$tests/$name.phi" > /dev/null 2> phi.log)
+	if [ -f "$tests/$name.c" ]
+	then
+		if [ ! -f "$work/output.o" ]
+		then
+			"$llc" -relocation-model=pic -filetype=obj "$work/phi.log" -o "$work/output.o" 2> "$work/llc.log"
+		fi
+		if [ -f "$work/output.o" ] && "$cc" -no-pie -I"$tests/../runtime" -o "$work/$name" "$tests/$name.c" "$work/output.o" \
+			"$phirt" -lpthread -lm 2> "$work/cc.log"
+		then
+			# In the background, so that the shell does not add its report of a crash to the output
+			{ "$work/$name" > "$work/actual" 2>&1 & wait $!; } 2> /dev/null
+			status=$?
+			[ $status -ne 0 ] && echo "exit status $status" >> "$work/actual"
+		else
+			cat "$work/llc.log" "$work/cc.log" > "$work/actual" 2> /dev/null
+			grep ' Error ' "$work/phi.log" >> "$work/actual"
+		fi
+	else
+		grep ' Error ' "$work/phi.log" > "$work/actual"
+	fi
+	if cmp -s "$work/actual" "$tests/$name.out"
+	then
+		passed=$((passed + 1))
+	else
+		echo "FAIL: $name"
+		diff "$tests/$name.out" "$work/actual"
+		failed=$((failed + 1))
+	fi
+done
+echo "$passed passed, $failed failed"
+[ $failed -eq 0 ]
@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+double total (double *a, int64_t length);
+double axpy (double *x, int64_t xlength, double *y, int64_t ylength, double s);
+double local ();
+double halves (double *a, int64_t length);
+double fused (double *a, int64_t alength, double *b, int64_t blength, double *c, int64_t clength,
+	double *d, int64_t dlength);
+double elementwise (int k);
+int lookup (int i);
+double mixed (int i);
+double literal ();
+
+int main ()
+{
+	enum { N = 1000 };
+	double *a = malloc(N * sizeof(double)), *b = malloc(N * sizeof(double));
+	double *c = malloc(N * sizeof(double)), *d = malloc(N * sizeof(double));
+	for (int i = 0; i < N; i++)
+	{
+		a[i] = i;
+		b[i] = 1;
+	}
+	printf("%g %g %g\n", total(a, N), axpy(a, N, b, N, 2.0), local());
+	printf("%g %g\n", halves(a, N), halves(a, 0));
+	for (int i = 0; i < N; i++)
+	{
+		b[i] = 2;
+		c[i] = 1;
+		d[i] = i;
+	}
+	double f = fused(a, N, b, N, c, N, d, N);
+	printf("%g %g %g\n", f, a[N-1], elementwise(0));
+	printf("%d %g %g\n", lookup(3), mixed(1), literal());
+	free(a);
+	free(b);
+	free(c);
+	free(d);
+	return 0;
+}
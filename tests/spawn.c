@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include "phirt.h"
+
+int fib (int n);
+int untouched (int c);
+int overwritten (int c);
+int merged (int c);
+int squares ();
+int last ();
+int previous ();
+int pairs ();
+int branches ();
+
+int main ()
+{
+	phirt_set_num_threads(4);
+	printf("%d %d\n", fib(1), fib(20));
+	printf("%d %d\n", untouched(0), untouched(5));
+	printf("%d %d\n", overwritten(0), overwritten(5));
+	printf("%d %d\n", merged(0), merged(5));
+	printf("%d %d %d\n", squares(), last(), previous());
+	printf("%d %d\n", pairs(), branches());
+	return 0;
+}
@@ -0,0 +1,24 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+uint32_t quotient (uint32_t x);
+uint32_t halfmax ();
+int mixed ();
+bool compare ();
+uint32_t logical ();
+int arithmetic ();
+uint32_t lookup (int i);
+int64_t widened ();
+double converted ();
+uint32_t smaller (uint32_t a, uint32_t b);
+int signedsmaller (int a, int b);
+
+int main ()
+{
+	printf("%u %u %d %d\n", quotient(4000000000u), halfmax(), mixed(), compare());
+	printf("%u %d\n", logical(), arithmetic());
+	printf("%u %u %lld %g\n", lookup(0), lookup(2), (long long)widened(), converted());
+	printf("%u %d\n", smaller(4294967295u, 5u), signedsmaller(-1, 5));
+	return 0;
+}